@@ -0,0 +1,93 @@
+// Copyright 2026 François CROLLET
+
+// This file is part of VPS Player.
+// VPS Player is free software; you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation; either version 3 of the License, or (at your option) any later version.
+// VPS Player is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License along with VPS Player. If not, see <http://www.gnu.org/licenses/>.
+
+#include <atomic>
+#include <cerrno>
+#include <cstdlib>
+
+#include "Allocation_counter.h"
+
+
+static std::atomic<quint64> nb_allocations(0);
+
+
+#ifdef __GLIBC__
+
+// Allocation functions of glibc, called by the interposed ones below
+extern "C" void* __libc_malloc(size_t size);
+extern "C" void* __libc_calloc(size_t nb_elements, size_t size);
+extern "C" void* __libc_realloc(void *pointer, size_t size);
+extern "C" void* __libc_memalign(size_t alignment, size_t size);
+
+
+// Interposed allocation functions: they take precedence over glibc's ones in the whole process (operator new calls malloc())
+extern "C" void* malloc(size_t size)
+{
+  nb_allocations.fetch_add(1, std::memory_order_relaxed);
+  return __libc_malloc(size);
+}
+
+
+extern "C" void* calloc(size_t nb_elements, size_t size)
+{
+  nb_allocations.fetch_add(1, std::memory_order_relaxed);
+  return __libc_calloc(nb_elements, size);
+}
+
+
+extern "C" void* realloc(void *pointer, size_t size)
+{
+  nb_allocations.fetch_add(1, std::memory_order_relaxed);
+  return __libc_realloc(pointer, size);
+}
+
+
+extern "C" void* memalign(size_t alignment, size_t size)
+{
+  nb_allocations.fetch_add(1, std::memory_order_relaxed);
+  return __libc_memalign(alignment, size);
+}
+
+
+extern "C" void* aligned_alloc(size_t alignment, size_t size)
+{
+  nb_allocations.fetch_add(1, std::memory_order_relaxed);
+  return __libc_memalign(alignment, size);
+}
+
+
+extern "C" int posix_memalign(void **pointer, size_t alignment, size_t size)
+{
+  if ((alignment < sizeof(void*)) || ((alignment & (alignment - 1)) != 0)) [[unlikely]]
+    return EINVAL;
+  nb_allocations.fetch_add(1, std::memory_order_relaxed);
+  void *allocated = __libc_memalign(alignment, size);
+  if (allocated == nullptr) [[unlikely]]
+    return ENOMEM;
+  *pointer = allocated;
+  return 0;
+}
+
+#endif
+
+
+// Returns the number of allocations made since the process started
+quint64 AllocationCounter::count()
+{
+  return nb_allocations.load(std::memory_order_relaxed);
+}
+
+
+// Returns true if allocations can be counted (C library supported)
+bool AllocationCounter::isAvailable()
+{
+#ifdef __GLIBC__
+  return true;
+#else
+  return false;
+#endif
+}
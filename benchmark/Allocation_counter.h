@@ -0,0 +1,21 @@
+// Copyright 2026 François CROLLET
+
+// This file is part of VPS Player.
+// VPS Player is free software; you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation; either version 3 of the License, or (at your option) any later version.
+// VPS Player is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License along with VPS Player. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef ALLOCATION_COUNTER_H
+#define ALLOCATION_COUNTER_H
+
+#include <QtGlobal>
+
+
+// Counts heap allocations of the whole process (all threads, including the ones made by Rubber Band), by interposing the allocation functions of the C library
+namespace AllocationCounter
+{
+  quint64 count(); // Returns the number of allocations made since the process started
+  bool isAvailable(); // Returns true if allocations can be counted (C library supported)
+}
+
+#endif
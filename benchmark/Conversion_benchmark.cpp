@@ -0,0 +1,224 @@
+// Copyright 2026 François CROLLET
+
+// This file is part of VPS Player.
+// VPS Player is free software; you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation; either version 3 of the License, or (at your option) any later version.
+// VPS Player is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License along with VPS Player. If not, see <http://www.gnu.org/licenses/>.
+
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <QElapsedTimer>
+#include <QRandomGenerator>
+#include <QString>
+
+#include "Conversion_benchmark.h"
+#include "Sample_conversion.h"
+
+#define CHECK_MAX_CHANNELS 8 // Channel counts from 1 to CHECK_MAX_CHANNELS are checked
+#define CHECK_FRAMES 1031 // Odd number of frames, so that the tails of the vectorized loops are checked too
+#define CHECK_SPECIAL_INTERVAL 7 // One sample out of CHECK_SPECIAL_INTERVAL is an edge case value
+#define CHECK_DITHER_POSITION 0xFFFFFF00u // Dither position of checked conversions: the dither index wraps around within the checked frames
+#define MEASURE_FRAMES 65536 // Number of frames converted by each call while measuring speed
+#define MEASURE_DURATION 200 // Minimum duration of each measurement (in milliseconds)
+
+
+// Returns the name of an instruction set
+static QString instructionSetName(SampleConversion::InstructionSet instruction_set)
+{
+  switch (instruction_set) {
+  case SampleConversion::SSE2 :
+    return QStringLiteral("SSE2");
+  case SampleConversion::AVX2 :
+    return QStringLiteral("AVX2");
+  default :
+    return QStringLiteral("scalar");
+  }
+}
+
+
+// Fills nb_samples samples with random values slightly beyond full scale, mixed with edge cases of the 16-bit conversion
+static void fillCheckSamples(float *samples, qint64 nb_samples)
+{
+  static const float special_values[] = {0.0f, -0.0f, 1.0f, -1.0f, 0.5f / 32767.0f, -0.5f / 32767.0f, 1.5f / 32767.0f, -2.5f / 32767.0f, 32766.5f / 32767.0f, 1e10f, -1e10f,
+					 std::numeric_limits<float>::denorm_min(), std::numeric_limits<float>::infinity(), -std::numeric_limits<float>::infinity(), std::numeric_limits<float>::quiet_NaN()};
+  const qint64 nb_special_values = static_cast<qint64>(sizeof(special_values) / sizeof(float));
+
+  QRandomGenerator random_generator(1);
+  for (qint64 i = 0; i < nb_samples; i++)
+    samples[i] = ((i % CHECK_SPECIAL_INTERVAL) == 0) ? special_values[(i / CHECK_SPECIAL_INTERVAL) % nb_special_values] : static_cast<float>(random_generator.bounded(2.4) - 1.2);
+}
+
+
+// Fills nb_samples 16-bit samples with random values, mixed with both extremes
+static void fillCheckInt16Samples(qint16 *samples, qint64 nb_samples)
+{
+  QRandomGenerator random_generator(1);
+  for (qint64 i = 0; i < nb_samples; i++)
+    samples[i] = ((i % CHECK_SPECIAL_INTERVAL) == 0) ? (((i / CHECK_SPECIAL_INTERVAL) % 2 == 0) ? -32768 : 32767) : static_cast<qint16>(random_generator.bounded(-32768, 32768));
+}
+
+
+// Runs a kernel with every instruction set supported by the CPU, and compares the bytes it wrote with the ones written by the scalar kernel. Returns the number of instruction sets giving different results
+template<typename KERNEL>
+static int compareWithScalarKernel(KERNEL kernel, char *output, qsizetype output_size)
+{
+  const SampleConversion::InstructionSet best_instruction_set = SampleConversion::bestInstructionSet();
+  auto reference_output = std::make_unique<char[]>(static_cast<size_t>(output_size));
+  int nb_mismatches = 0;
+
+  SampleConversion::setInstructionSet(SampleConversion::Scalar);
+  std::memset(output, 0x5A, static_cast<size_t>(output_size)); // Writes beyond the converted frames are detected too
+  kernel();
+  std::memcpy(reference_output.get(), output, static_cast<size_t>(output_size));
+
+  for (int i = SampleConversion::Scalar + 1; i <= best_instruction_set; i++) {
+    SampleConversion::setInstructionSet(static_cast<SampleConversion::InstructionSet>(i));
+    std::memset(output, 0x5A, static_cast<size_t>(output_size));
+    kernel();
+    if (std::memcmp(reference_output.get(), output, static_cast<size_t>(output_size)) != 0)
+      nb_mismatches++;
+  }
+
+  SampleConversion::setInstructionSet(best_instruction_set);
+  return nb_mismatches;
+}
+
+
+// Returns the time taken by a kernel to convert a frame, in nanoseconds
+template<typename KERNEL>
+static double measureKernel(KERNEL kernel)
+{
+  QElapsedTimer measure_timer;
+  qint64 nb_calls = 0;
+  kernel(); // Warms caches up
+  measure_timer.start();
+  do {
+    kernel();
+    nb_calls++;
+  } while (measure_timer.elapsed() < MEASURE_DURATION);
+  return static_cast<double>(measure_timer.nsecsElapsed()) / static_cast<double>(nb_calls * MEASURE_FRAMES);
+}
+
+
+// Compares every instruction set supported by the CPU against the scalar kernels, reporting mismatches. Returns true if all results are identical
+bool ConversionBenchmark::checkKernels(QTextStream &output_stream)
+{
+  static const qint64 check_lengths[] = {0, 1, 2, 3, 4, 5, 7, 8, 9, 15, 16, 17, 31, 32, 33, CHECK_FRAMES};
+  const qsizetype planar_size = CHECK_MAX_CHANNELS * CHECK_FRAMES;
+  auto interleaved_samples = std::make_unique<float[]>(planar_size);
+  auto planar_samples = std::make_unique<float[]>(planar_size);
+  auto int16_samples = std::make_unique<qint16[]>(planar_size);
+  auto float_output = std::make_unique<float[]>(planar_size);
+  auto int16_output = std::make_unique<qint16[]>(planar_size);
+  auto int32_output = std::make_unique<qint32[]>(planar_size);
+  auto planar_input = std::make_unique<const float*[]>(CHECK_MAX_CHANNELS);
+  auto planar_output = std::make_unique<float*[]>(CHECK_MAX_CHANNELS);
+  fillCheckSamples(interleaved_samples.get(), planar_size);
+  fillCheckSamples(planar_samples.get(), planar_size);
+  fillCheckInt16Samples(int16_samples.get(), planar_size);
+  for (unsigned int i = 0; i < CHECK_MAX_CHANNELS; i++) {
+    planar_input[i] = planar_samples.get() + (i * CHECK_FRAMES);
+    planar_output[i] = float_output.get() + (i * CHECK_FRAMES);
+  }
+
+  int nb_failed_checks = 0;
+  auto reportMismatches = [&](int nb_mismatches, const QString &kernel_name, unsigned int nb_channels, qint64 nb_frames){
+    if (nb_mismatches > 0) {
+      output_stream << "MISMATCH: " << kernel_name << ", " << nb_channels << " channels, " << nb_frames << " frames" << Qt::endl;
+      nb_failed_checks++;
+    }
+  };
+
+  for (unsigned int nb_channels = 1; nb_channels <= CHECK_MAX_CHANNELS; nb_channels++)
+    for (qint64 nb_frames : check_lengths) {
+      reportMismatches(compareWithScalarKernel([&](){ SampleConversion::interleave(planar_input.get(), float_output.get(), nb_channels, nb_frames); }, reinterpret_cast<char*>(float_output.get()), planar_size * static_cast<qsizetype>(sizeof(float))),
+		       QStringLiteral("interleave"), nb_channels, nb_frames);
+      reportMismatches(compareWithScalarKernel([&](){ SampleConversion::interleaveToInt16(planar_input.get(), int16_output.get(), nb_channels, nb_frames); }, reinterpret_cast<char*>(int16_output.get()), planar_size * static_cast<qsizetype>(sizeof(qint16))),
+		       QStringLiteral("interleaveToInt16"), nb_channels, nb_frames);
+      reportMismatches(compareWithScalarKernel([&](){ quint32 dither_position = CHECK_DITHER_POSITION; SampleConversion::interleaveToInt16Dithered(planar_input.get(), int16_output.get(), nb_channels, nb_frames, dither_position); }, reinterpret_cast<char*>(int16_output.get()), planar_size * static_cast<qsizetype>(sizeof(qint16))),
+		       QStringLiteral("interleaveToInt16Dithered"), nb_channels, nb_frames);
+      reportMismatches(compareWithScalarKernel([&](){ SampleConversion::convertInt16ToFloat(int16_samples.get(), float_output.get(), nb_channels * nb_frames); }, reinterpret_cast<char*>(float_output.get()), planar_size * static_cast<qsizetype>(sizeof(float))),
+		       QStringLiteral("convertInt16ToFloat"), nb_channels, nb_frames);
+      reportMismatches(compareWithScalarKernel([&](){ SampleConversion::interleaveToInt32(planar_input.get(), int32_output.get(), nb_channels, nb_frames); }, reinterpret_cast<char*>(int32_output.get()), planar_size * static_cast<qsizetype>(sizeof(qint32))),
+		       QStringLiteral("interleaveToInt32"), nb_channels, nb_frames);
+      for (unsigned int nb_output_channels = 1; nb_output_channels <= nb_channels; nb_output_channels++)
+	reportMismatches(compareWithScalarKernel([&](){ SampleConversion::deinterleave(interleaved_samples.get(), nb_channels, planar_output.get(), nb_output_channels, nb_frames); }, reinterpret_cast<char*>(float_output.get()), planar_size * static_cast<qsizetype>(sizeof(float))),
+			 QStringLiteral("deinterleave to %1 channels").arg(nb_output_channels), nb_channels, nb_frames);
+    }
+
+  output_stream << "Sample conversion kernels (" << instructionSetName(SampleConversion::bestInstructionSet()) << " supported): " << ((nb_failed_checks == 0) ? "identical to scalar kernels" : "MISMATCHES FOUND") << Qt::endl;
+  return nb_failed_checks == 0;
+}
+
+
+// Reports the speed of each kernel with every instruction set supported by the CPU
+void ConversionBenchmark::measureKernels(QTextStream &output_stream)
+{
+  static const unsigned int measure_channels[] = {1, 2, 6};
+  static const char *const kernel_names[] = {"interleave", "interleaveToInt16", "interleaveToInt16Dithered", "interleaveToInt16NoiseShaped", "interleaveToInt32", "deinterleave", "convertInt16ToFloat"};
+  const SampleConversion::InstructionSet best_instruction_set = SampleConversion::bestInstructionSet();
+  const qsizetype buffer_size = 6 * MEASURE_FRAMES;
+  auto interleaved_samples = std::make_unique<float[]>(buffer_size);
+  auto planar_samples = std::make_unique<float[]>(buffer_size);
+  auto int16_samples = std::make_unique<qint16[]>(buffer_size);
+  auto float_output = std::make_unique<float[]>(buffer_size);
+  auto int16_output = std::make_unique<qint16[]>(buffer_size);
+  auto int32_output = std::make_unique<qint32[]>(buffer_size);
+  auto shaping_errors = std::make_unique<float[]>(2 * 6);
+  quint32 dither_position = 0;
+  auto planar_input = std::make_unique<const float*[]>(6);
+  auto planar_output = std::make_unique<float*[]>(6);
+  for (qsizetype i = 0; i < buffer_size; i++) {
+    interleaved_samples[i] = std::sin(static_cast<float>(i) * 0.001f) * 0.9f;
+    planar_samples[i] = interleaved_samples[i];
+    int16_samples[i] = static_cast<qint16>(interleaved_samples[i] * 32767.0f);
+  }
+  for (unsigned int i = 0; i < 6; i++) {
+    planar_input[i] = planar_samples.get() + (i * MEASURE_FRAMES);
+    planar_output[i] = float_output.get() + (i * MEASURE_FRAMES);
+  }
+
+  output_stream << Qt::endl << "Sample conversion speed (ns per frame)" << Qt::endl;
+  output_stream << qSetFieldWidth(30) << Qt::left << "kernel" << qSetFieldWidth(10) << "channels";
+  for (int i = SampleConversion::Scalar; i <= best_instruction_set; i++)
+    output_stream << Qt::right << instructionSetName(static_cast<SampleConversion::InstructionSet>(i));
+  output_stream << qSetFieldWidth(0) << Qt::left << Qt::endl;
+
+  for (int kernel_index = 0; kernel_index < 7; kernel_index++)
+    for (unsigned int nb_channels : measure_channels) {
+      output_stream << qSetFieldWidth(30) << kernel_names[kernel_index] << qSetFieldWidth(10) << nb_channels;
+      for (int i = SampleConversion::Scalar; i <= best_instruction_set; i++) {
+	SampleConversion::setInstructionSet(static_cast<SampleConversion::InstructionSet>(i));
+	double frame_time;
+	switch (kernel_index) {
+	case 0 :
+	  frame_time = measureKernel([&](){ SampleConversion::interleave(planar_input.get(), float_output.get(), nb_channels, MEASURE_FRAMES); });
+	  break;
+	case 1 :
+	  frame_time = measureKernel([&](){ SampleConversion::interleaveToInt16(planar_input.get(), int16_output.get(), nb_channels, MEASURE_FRAMES); });
+	  break;
+	case 2 :
+	  frame_time = measureKernel([&](){ SampleConversion::interleaveToInt16Dithered(planar_input.get(), int16_output.get(), nb_channels, MEASURE_FRAMES, dither_position); });
+	  break;
+	case 3 : // Not vectorized: the same with every instruction set
+	  frame_time = measureKernel([&](){ SampleConversion::interleaveToInt16NoiseShaped(planar_input.get(), int16_output.get(), nb_channels, MEASURE_FRAMES, dither_position, shaping_errors.get()); });
+	  break;
+	case 4 :
+	  frame_time = measureKernel([&](){ SampleConversion::interleaveToInt32(planar_input.get(), int32_output.get(), nb_channels, MEASURE_FRAMES); });
+	  break;
+	case 5 :
+	  frame_time = measureKernel([&](){ SampleConversion::deinterleave(interleaved_samples.get(), nb_channels, planar_output.get(), nb_channels, MEASURE_FRAMES); });
+	  break;
+	default : // As many samples as the other kernels convert
+	  frame_time = measureKernel([&](){ SampleConversion::convertInt16ToFloat(int16_samples.get(), float_output.get(), nb_channels * MEASURE_FRAMES); });
+	  break;
+	}
+	output_stream << Qt::right << QString::number(frame_time, 'f', 2);
+      }
+      output_stream << qSetFieldWidth(0) << Qt::left << Qt::endl;
+    }
+
+  SampleConversion::setInstructionSet(best_instruction_set);
+}
@@ -0,0 +1,21 @@
+// Copyright 2026 François CROLLET
+
+// This file is part of VPS Player.
+// VPS Player is free software; you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation; either version 3 of the License, or (at your option) any later version.
+// VPS Player is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License along with VPS Player. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef CONVERSION_BENCHMARK_H
+#define CONVERSION_BENCHMARK_H
+
+#include <QTextStream>
+
+
+// Checks that the vectorized sample conversion kernels give exactly the same results as the scalar ones, and measures the speed of each of them
+namespace ConversionBenchmark
+{
+  bool checkKernels(QTextStream &output_stream); // Compares every instruction set supported by the CPU against the scalar kernels, reporting mismatches. Returns true if all results are identical
+  void measureKernels(QTextStream &output_stream); // Reports the speed of each kernel with every instruction set supported by the CPU
+}
+
+#endif
@@ -0,0 +1,267 @@
+// Copyright 2026 François CROLLET
+
+// This file is part of VPS Player.
+// VPS Player is free software; you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation; either version 3 of the License, or (at your option) any later version.
+// VPS Player is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License along with VPS Player. If not, see <http://www.gnu.org/licenses/>.
+
+#include <algorithm>
+#include <cmath>
+#include <numbers>
+#include <utility>
+#include <vector>
+#include <QAudioBuffer>
+#include <QAudioFormat>
+#include <QElapsedTimer>
+#include <QMutexLocker>
+#include <QRandomGenerator>
+#include <QThreadPool>
+
+#include "Allocation_counter.h"
+#include "Parallel_stretcher.h"
+#include "Pipeline_benchmark.h"
+#include "Sample_conversion.h"
+
+#define DECODE_BUFFER_FRAMES 4096 // Number of frames in each buffer handed to the sample store, as a decoder would do
+#define NOTES_PER_SECOND 4 // Rate of the note onsets of the synthetic signal
+#define NOTE_DECAY 8.0 // Decay rate of the notes' envelope (per second)
+#define RENDERER_RENDER_AHEAD 2000 // Render-ahead duration of the audio renderer, as by default (ms)
+#define RENDERER_LATENCY 100 // Sink's buffer duration of the audio renderer (ms)
+#define RENDERER_PITCH_STEP 1.01 // Pitch scale change making the audio renderer fade in over the queued audio
+
+
+// Returns the value below which given percentage of sorted values fall
+static qint64 percentile(const std::vector<qint64> &sorted_values, int percentage)
+{
+  if (sorted_values.empty())
+    return 0;
+  const size_t index = static_cast<size_t>(std::ceil(static_cast<double>(percentage * sorted_values.size()) / 100.0));
+  return sorted_values[qMax(index, static_cast<size_t>(1)) - 1];
+}
+
+
+// Constructor. duration: length of the synthetic signal in seconds, input_block_size: number of frames fed to the stretcher at once, sample_format: format stretched audio is converted to (dithered if 16-bit, noise-shaped if shaped_dither is true)
+PipelineBenchmark::PipelineBenchmark(const PipelineBenchmark::Configuration &benchmark_configuration, int duration, qint64 input_block_size, QAudioFormat::SampleFormat sample_format, bool shaped_dither, SampleStore::StorageFormat format) :
+  configuration(benchmark_configuration),
+  signal_duration(duration),
+  block_size(input_block_size),
+  output_sample_format(sample_format),
+  noise_shaping(shaped_dither),
+  storage_format(format)
+{
+
+}
+
+
+// Destructor
+PipelineBenchmark::~PipelineBenchmark()
+{
+
+}
+
+
+// Decodes and renders the synthetic signal, and returns the measures
+PipelineBenchmark::Result PipelineBenchmark::run() const
+{
+  PipelineBenchmark::Result result;
+  const unsigned int nb_channels = configuration.nb_channels;
+  const std::shared_ptr<const SampleStore> samples = decodeSignal(generateSignal(), result.decoding_speed);
+  const qint64 nb_frames = samples->frameCount();
+
+  ParallelStretcher stretcher(static_cast<size_t>(configuration.sample_rate), nb_channels, configuration.settings.generateOptionsFlag(), configuration.settings.time_ratio, configuration.settings.pitch_scale, configuration.settings.parallel_channels);
+  stretcher.setMaxProcessSize(static_cast<size_t>(block_size));
+
+  auto stretcher_input = std::make_unique<const float*[]>(nb_channels);
+  auto input_samples = std::make_unique<float[]>(nb_channels * block_size);
+  auto input_conversion_buffer = std::make_unique<float*[]>(nb_channels);
+  auto output_samples = std::make_unique<float[]>(nb_channels * block_size);
+  auto stretcher_output = std::make_unique<float*[]>(nb_channels);
+  auto conversion_input = std::make_unique<const float*[]>(nb_channels);
+  auto converted_samples = std::make_unique<float[]>(nb_channels * block_size); // Also large enough for integer samples
+  auto shaping_errors = std::make_unique<float[]>(2 * nb_channels);
+  quint32 dither_position = 0;
+  auto silent_samples = std::make_unique<float[]>(block_size);
+  for (unsigned int i = 0; i < nb_channels; i++) {
+    stretcher_input[i] = silent_samples.get();
+    input_conversion_buffer[i] = input_samples.get() + (i * block_size);
+    stretcher_output[i] = output_samples.get() + (i * block_size);
+  }
+
+  // Like when playing starts, the start pad is fed as silence and the start delay is dropped
+  for (qint64 nb_pad_frames = static_cast<qint64>(stretcher.getPreferredStartPad()); nb_pad_frames > 0; nb_pad_frames -= block_size)
+    stretcher.process(stretcher_input.get(), static_cast<size_t>(qMin(nb_pad_frames, block_size)), false);
+  qint64 nb_frames_to_discard = static_cast<qint64>(stretcher.getStartDelay());
+
+  std::vector<qint64> block_times;
+  block_times.reserve(static_cast<size_t>((nb_frames / block_size) + 1)); // Nothing is allocated by the benchmark itself while rendering
+  qint64 nb_output_frames = 0;
+  qint64 rendering_time = 0;
+  QElapsedTimer block_timer;
+  const quint64 first_allocation = AllocationCounter::count();
+
+  for (qint64 frame = 0; frame < nb_frames;) {
+    block_timer.start();
+    const qint64 nb_input_frames = samples->readFrames(frame, block_size, stretcher_input.get(), input_conversion_buffer.get());
+    frame += nb_input_frames;
+    stretcher.process(stretcher_input.get(), static_cast<size_t>(nb_input_frames), frame >= nb_frames);
+
+    int nb_available_frames;
+    while ((nb_available_frames = stretcher.available()) > 0) {
+      const qint64 nb_retrieved_frames = static_cast<qint64>(stretcher.retrieve(stretcher_output.get(), static_cast<size_t>(qMin(static_cast<qint64>(nb_available_frames), block_size))));
+      const qint64 nb_discarded_frames = qMin(nb_retrieved_frames, nb_frames_to_discard);
+      nb_frames_to_discard -= nb_discarded_frames;
+      for (unsigned int i = 0; i < nb_channels; i++)
+	conversion_input[i] = stretcher_output[i] + nb_discarded_frames;
+      const qint64 nb_converted_frames = nb_retrieved_frames - nb_discarded_frames;
+      if (output_sample_format == QAudioFormat::Float)
+	SampleConversion::interleave(conversion_input.get(), converted_samples.get(), nb_channels, nb_converted_frames);
+      else if (output_sample_format == QAudioFormat::Int32)
+	SampleConversion::interleaveToInt32(conversion_input.get(), reinterpret_cast<qint32*>(converted_samples.get()), nb_channels, nb_converted_frames);
+      else if (noise_shaping)
+	SampleConversion::interleaveToInt16NoiseShaped(conversion_input.get(), reinterpret_cast<qint16*>(converted_samples.get()), nb_channels, nb_converted_frames, dither_position, shaping_errors.get());
+      else
+	SampleConversion::interleaveToInt16Dithered(conversion_input.get(), reinterpret_cast<qint16*>(converted_samples.get()), nb_channels, nb_converted_frames, dither_position);
+      nb_output_frames += nb_converted_frames;
+    }
+
+    const qint64 block_time = block_timer.nsecsElapsed();
+    block_times.push_back(block_time / 1000);
+    rendering_time += block_time;
+  }
+
+  result.nb_allocations = AllocationCounter::isAvailable() ? static_cast<qint64>(AllocationCounter::count() - first_allocation) : -1;
+  result.realtime_factor = (static_cast<double>(nb_output_frames) * 1e9) / (static_cast<double>(configuration.sample_rate) * static_cast<double>(qMax(rendering_time, static_cast<qint64>(1))));
+  result.block_duration = qRound64((static_cast<double>(block_size) * configuration.settings.time_ratio * 1e6) / static_cast<double>(configuration.sample_rate));
+  std::sort(block_times.begin(), block_times.end());
+  result.block_time_p50 = percentile(block_times, 50);
+  result.block_time_p90 = percentile(block_times, 90);
+  result.block_time_p99 = percentile(block_times, 99);
+  result.block_time_max = block_times.empty() ? 0 : block_times.back();
+  result.nb_renderer_allocations = countRendererAllocations(samples);
+  return result;
+}
+
+
+// Plays the samples through an audio renderer, changing its pitch, looping and prerendering on the way, and returns the allocations made while blocks were rendered and handed to the sink (-1 if they cannot be counted)
+qint64 PipelineBenchmark::countRendererAllocations(std::shared_ptr<const SampleStore> samples) const
+{
+  QAudioFormat format;
+  format.setSampleFormat(output_sample_format);
+  format.setChannelCount(static_cast<int>(configuration.nb_channels));
+  format.setSampleRate(configuration.sample_rate);
+  const qint64 nb_frames = samples->frameCount();
+  AudioRenderer renderer(std::move(samples), format, configuration.settings.generateOptionsFlag(), configuration.settings.time_ratio, configuration.settings.pitch_scale, configuration.settings.parallel_channels, RENDERER_RENDER_AHEAD, RENDERER_LATENCY, noise_shaping);
+  const qint64 queue_depth = qMin(renderer.nb_kept_blocks + 4, renderer.nb_queue_blocks); // Settings changes drop the blocks queued beyond the kept ones
+  const qint64 nb_phase_blocks = qMax(qRound64(static_cast<double>(nb_frames) * renderer.stretcherTimeRatio() / static_cast<double>(8 * renderer.block_frames)), static_cast<qint64>(1)); // An eighth of the stretched signal
+  auto data = std::make_unique<char[]>(static_cast<size_t>(renderer.block_frames * format.bytesPerFrame()));
+  quint64 nb_allocations = 0;
+
+  // Playing starts: the stretcher is primed, then the queue is filled
+  renderer.primeStretcher();
+  renderer.settings_timer.start();
+  renderBlocks(renderer, data.get(), 0, queue_depth);
+  nb_allocations += renderBlocks(renderer, data.get(), nb_phase_blocks, queue_depth);
+
+  // The pitch changes: the restarted stretcher is faded in over the dropped blocks
+  renderer.updatePitchScale(configuration.settings.pitch_scale * RENDERER_PITCH_STEP);
+  {
+    QMutexLocker locker(&renderer.queue_mutex);
+    renderer.applySettings();
+  }
+  nb_allocations += renderBlocks(renderer, data.get(), nb_phase_blocks, queue_depth);
+
+  // A loop is entered (preparing its cache allocates): its first pass is cached, the next ones are played from the cache
+  renderer.updateLoop(signal_duration * 600, signal_duration * 800);
+  {
+    QMutexLocker locker(&renderer.queue_mutex);
+    renderer.applySettings();
+  }
+  nb_allocations += renderBlocks(renderer, data.get(), 3 * ((renderer.loopPassFrames() / renderer.block_frames) + 1), queue_depth);
+
+  // The loop is left, and the rest of the file is prerendered (which allocates) before playback switches to it, up to the end of the file
+  renderer.updateLoop(0, 0);
+  {
+    QMutexLocker locker(&renderer.queue_mutex);
+    renderer.applySettings();
+  }
+  renderer.startPrerendering();
+  QThreadPool::globalInstance()->waitForDone();
+  nb_allocations += renderBlocks(renderer, data.get(), (8 * nb_phase_blocks) + renderer.nb_queue_blocks, queue_depth);
+
+  return AllocationCounter::isAvailable() ? static_cast<qint64>(nb_allocations) : -1;
+}
+
+
+// Appends the signal to a new sample store in decoder-sized buffers, and sets the decoding speed
+std::shared_ptr<SampleStore> PipelineBenchmark::decodeSignal(const QByteArray &signal, double &decoding_speed) const
+{
+  QAudioFormat format;
+  format.setSampleFormat(QAudioFormat::Float);
+  format.setChannelCount(static_cast<int>(configuration.nb_channels));
+  format.setSampleRate(configuration.sample_rate);
+  const qsizetype buffer_size = DECODE_BUFFER_FRAMES * format.bytesPerFrame();
+
+  auto samples = std::make_shared<SampleStore>(configuration.nb_channels, configuration.sample_rate, storage_format);
+  qint64 decoding_time = 0;
+  QElapsedTimer decoding_timer;
+  for (qsizetype offset = 0; offset < signal.size(); offset += buffer_size) {
+    const QAudioBuffer audio_buffer(QByteArray::fromRawData(signal.constData() + offset, qMin(buffer_size, signal.size() - offset)), format);
+    decoding_timer.start();
+    samples->append(audio_buffer);
+    decoding_time += decoding_timer.nsecsElapsed();
+  }
+  samples->setComplete();
+
+  decoding_speed = (static_cast<double>(signal_duration) * 1e9) / static_cast<double>(qMax(decoding_time, static_cast<qint64>(1)));
+  return samples;
+}
+
+
+// Returns the synthetic signal as interleaved float samples: decaying harmonic notes over a low drone and some noise, slightly different in each channel
+QByteArray PipelineBenchmark::generateSignal() const
+{
+  const unsigned int nb_channels = configuration.nb_channels;
+  const double sample_rate = static_cast<double>(configuration.sample_rate);
+  const qint64 nb_frames = static_cast<qint64>(signal_duration) * configuration.sample_rate;
+  const qint64 note_frames = configuration.sample_rate / NOTES_PER_SECOND;
+  QByteArray signal(static_cast<qsizetype>(nb_frames * nb_channels * sizeof(float)), Qt::Uninitialized);
+  float *signal_samples = reinterpret_cast<float*>(signal.data());
+  QRandomGenerator random_generator(1); // The signal is the same on every run
+
+  for (qint64 j = 0; j < nb_frames; j++) {
+    const double time = static_cast<double>(j) / sample_rate;
+    const double note_time = static_cast<double>(j % note_frames) / sample_rate;
+    const double note_frequency = 110.0 * std::pow(2.0, static_cast<double>(((j / note_frames) * 7) % 24) / 12.0); // Notes wander over two octaves by fifths
+    const double note_envelope = 0.3 * std::exp(-NOTE_DECAY * note_time);
+    for (unsigned int i = 0; i < nb_channels; i++) {
+      const double frequency = note_frequency * (1.0 + (0.002 * i));
+      double sample = 0.0;
+      for (int k = 1; k <= 3; k++)
+	sample += std::sin(2.0 * std::numbers::pi * k * frequency * time) / k;
+      sample = (note_envelope * sample) + (0.1 * std::sin(2.0 * std::numbers::pi * 55.0 * time)) + (0.02 * ((2.0 * random_generator.generateDouble()) - 1.0));
+      signal_samples[(j * nb_channels) + i] = static_cast<float>(sample);
+    }
+  }
+
+  return signal;
+}
+
+
+// Hands nb_blocks blocks to a fake sink (fewer at the end of the stream), rendering blocks beforehand so that queue_depth blocks are queued, as the render-ahead thread would. Returns the number of allocations made meanwhile
+quint64 PipelineBenchmark::renderBlocks(AudioRenderer &renderer, char *data, qint64 nb_blocks, qint64 queue_depth)
+{
+  const qint64 block_size = renderer.block_frames * static_cast<qint64>(renderer.output_format.bytesPerFrame());
+  const quint64 first_allocation = AllocationCounter::count();
+
+  for (qint64 i = 0; i <= nb_blocks; i++) {
+    while (!renderer.end_of_stream && ((renderer.queue_write_index - renderer.queue_read_index) < queue_depth)) {
+      QMutexLocker locker(&renderer.queue_mutex);
+      renderer.settings_timer.restart(); // Starting to prerender allocates: it never starts by itself, however long a phase takes, and is started explicitly before the phase reading prerendered audio
+      renderer.queueNextBlock();
+    }
+    if ((i == nb_blocks) || (renderer.readData(data, block_size) == 0)) // The queue is left filled for the next settings change
+      break;
+  }
+
+  return AllocationCounter::count() - first_allocation;
+}
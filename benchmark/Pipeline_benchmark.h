@@ -0,0 +1,64 @@
+// Copyright 2026 François CROLLET
+
+// This file is part of VPS Player.
+// VPS Player is free software; you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation; either version 3 of the License, or (at your option) any later version.
+// VPS Player is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License along with VPS Player. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef PIPELINE_BENCHMARK_H
+#define PIPELINE_BENCHMARK_H
+
+#include <memory>
+#include <QAudioFormat>
+#include <QByteArray>
+
+#include "Audio_renderer.h"
+#include "Sample_store.h"
+#include "Stretcher_settings.h"
+
+
+// Drives the playing path (decoded buffers deinterleaved into a sample store, stretcher fed in real-time mode, stretched audio converted to the output format) on a synthetic signal, without any audio device, and measures it
+class PipelineBenchmark
+{
+public:
+  struct Configuration
+  {
+    StretcherSettings settings;
+    unsigned int nb_channels;
+    int sample_rate;
+  };
+
+  struct Result
+  {
+    double decoding_speed; // Decoded duration over the time taken to store it
+    double realtime_factor; // Stretched duration over the time taken to render it
+    qint64 block_duration; // Duration of the audio rendered from an input block, in microseconds: rendering a block must take less than this
+    qint64 block_time_p50; // Percentiles of the time taken to render a block, in microseconds
+    qint64 block_time_p90;
+    qint64 block_time_p99;
+    qint64 block_time_max;
+    qint64 nb_allocations; // Heap allocations made while rendering (-1 if they cannot be counted)
+    qint64 nb_renderer_allocations; // Heap allocations made by the audio renderer while rendering and handing blocks to the sink between settings changes, which must be none (-1 if they cannot be counted)
+  };
+
+private:
+  PipelineBenchmark::Configuration configuration;
+  int signal_duration; // In seconds
+  qint64 block_size;
+  QAudioFormat::SampleFormat output_sample_format;
+  bool noise_shaping;
+  SampleStore::StorageFormat storage_format;
+
+public:
+  PipelineBenchmark(const PipelineBenchmark::Configuration &benchmark_configuration, int duration, qint64 input_block_size, QAudioFormat::SampleFormat sample_format, bool shaped_dither, SampleStore::StorageFormat format); // Constructor. duration: length of the synthetic signal in seconds, input_block_size: number of frames fed to the stretcher at once, sample_format: format stretched audio is converted to (dithered if 16-bit, noise-shaped if shaped_dither is true)
+  ~PipelineBenchmark(); // Destructor
+  PipelineBenchmark::Result run() const; // Decodes and renders the synthetic signal, and returns the measures
+
+private:
+  qint64 countRendererAllocations(std::shared_ptr<const SampleStore> samples) const; // Plays the samples through an audio renderer, changing its pitch, looping and prerendering on the way, and returns the allocations made while blocks were rendered and handed to the sink (-1 if they cannot be counted)
+  std::shared_ptr<SampleStore> decodeSignal(const QByteArray &signal, double &decoding_speed) const; // Appends the signal to a new sample store in decoder-sized buffers, and sets the decoding speed
+  QByteArray generateSignal() const; // Returns the synthetic signal as interleaved float samples: decaying harmonic notes over a low drone and some noise, slightly different in each channel
+  static quint64 renderBlocks(AudioRenderer &renderer, char *data, qint64 nb_blocks, qint64 queue_depth); // Hands nb_blocks blocks to a fake sink (fewer at the end of the stream), rendering blocks beforehand so that queue_depth blocks are queued, as the render-ahead thread would. Returns the number of allocations made meanwhile
+};
+
+#endif
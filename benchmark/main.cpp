@@ -0,0 +1,161 @@
+// Copyright 2026 François CROLLET
+
+// This file is part of VPS Player.
+// VPS Player is free software; you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation; either version 3 of the License, or (at your option) any later version.
+// VPS Player is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License along with VPS Player. If not, see <http://www.gnu.org/licenses/>.
+
+#include <cmath>
+#include <utility>
+#include <QCommandLineOption>
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QList>
+#include <QString>
+#include <QStringList>
+#include <QTextStream>
+
+#include "Allocation_counter.h"
+#include "Conversion_benchmark.h"
+#include "Pipeline_benchmark.h"
+
+
+// Parses a comma-separated list of positive integers. Returns an empty list if any value is invalid
+QList<int> parseIntegerList(const QString &value)
+{
+  QList<int> integers;
+  const QStringList fields = value.split(QLatin1Char(','), Qt::SkipEmptyParts);
+  for (const QString &field : fields) {
+    bool valid = false;
+    const int integer = field.trimmed().toInt(&valid);
+    if (!valid || (integer <= 0))
+      return QList<int>();
+    integers.append(integer);
+  }
+  return integers;
+}
+
+
+// Appends every combination of given engines, qualities, channel counts, sample rates and presets to the benchmarked configurations. Returns false if a value is invalid
+bool appendConfigurations(const QString &engine_values, const QString &quality_values, const QString &channel_values, const QString &rate_values, const QStringList &preset_values, const StretcherSettings &base_settings, QList<PipelineBenchmark::Configuration> &configurations)
+{
+  const QStringList engines = engine_values.toLower().split(QLatin1Char(','), Qt::SkipEmptyParts);
+  const QStringList qualities = quality_values.toLower().split(QLatin1Char(','), Qt::SkipEmptyParts);
+  const QList<int> channel_counts = parseIntegerList(channel_values);
+  const QList<int> sample_rates = parseIntegerList(rate_values);
+  if (engines.isEmpty() || qualities.isEmpty() || channel_counts.isEmpty() || sample_rates.isEmpty())
+    return false;
+
+  for (const QString &engine : engines)
+    for (const QString &quality : qualities)
+      for (int nb_channels : channel_counts)
+	for (int sample_rate : sample_rates)
+	  for (const QString &preset_value : preset_values) {
+	    const QStringList preset_fields = preset_value.split(QLatin1Char(':'));
+	    bool pitch_valid = false, speed_valid = false;
+	    double pitch = 0.0, speed_ratio = 0.0;
+	    if (preset_fields.size() == 2) {
+	      pitch = preset_fields.at(0).toDouble(&pitch_valid);
+	      speed_ratio = preset_fields.at(1).toDouble(&speed_valid);
+	    }
+	    if (!pitch_valid || !speed_valid || (speed_ratio <= 0.0) || ((engine != QStringLiteral("r2")) && (engine != QStringLiteral("r3"))) || ((quality != QStringLiteral("standard")) && (quality != QStringLiteral("high"))))
+	      return false;
+
+	    PipelineBenchmark::Configuration configuration{base_settings, static_cast<unsigned int>(nb_channels), sample_rate};
+	    configuration.settings.use_r3_engine = (engine == QStringLiteral("r3"));
+	    configuration.settings.high_quality = (quality == QStringLiteral("high"));
+	    configuration.settings.setPitch(pitch);
+	    configuration.settings.setSpeed(speed_ratio);
+	    configurations.append(configuration);
+	  }
+  return true;
+}
+
+
+int main(int argc, char *argv[])
+{
+  QCoreApplication app(argc, argv);
+  QCoreApplication::setApplicationName(QStringLiteral("VPS Player benchmark"));
+  QCoreApplication::setApplicationVersion(QStringLiteral(VERSION_STRING));
+  QTextStream output_stream(stdout);
+
+  QList<PipelineBenchmark::Configuration> configurations;
+  int duration = 0;
+  int block_size = 0;
+  QString output_format;
+  bool conversion_only;
+  SampleStore::StorageFormat storage_format;
+  {
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Measures VPS Player's processing path (decoded buffers stored, stretched and converted to the output format) on synthetic signals, without any audio device");
+    parser.addHelpOption();
+    parser.addVersionOption();
+    const QCommandLineOption engines_option(QStringLiteral("engines"), "Comma-separated Rubber Band engines: r2, r3 (default: both)", QStringLiteral("engines"), QStringLiteral("r2,r3"));
+    parser.addOption(engines_option);
+    const QCommandLineOption qualities_option(QStringLiteral("qualities"), "Comma-separated pitch qualities: standard, high (default: both)", QStringLiteral("qualities"), QStringLiteral("standard,high"));
+    parser.addOption(qualities_option);
+    const QCommandLineOption channels_option(QStringLiteral("channels"), "Comma-separated channel counts (default: 1,2,6)", QStringLiteral("counts"), QStringLiteral("1,2,6"));
+    parser.addOption(channels_option);
+    const QCommandLineOption rates_option(QStringLiteral("rates"), "Comma-separated sample rates (default: 44100,48000,96000)", QStringLiteral("rates"), QStringLiteral("44100,48000,96000"));
+    parser.addOption(rates_option);
+    const QCommandLineOption preset_option(QStringLiteral("preset"), "Pitch change (in semitones) and speed ratio, e.g. \"-2:0.8\". May be repeated (default: 0:1.0, 0:0.7, 5:1.0 and -3:1.3)", QStringLiteral("semitones:ratio"));
+    parser.addOption(preset_option);
+    const QCommandLineOption duration_option(QStringLiteral("duration"), "Duration of the synthetic signal, in seconds (default: 5)", QStringLiteral("seconds"), QStringLiteral("5"));
+    parser.addOption(duration_option);
+    const QCommandLineOption block_size_option(QStringLiteral("block-size"), "Number of frames fed to the stretcher at once (default: 1024)", QStringLiteral("frames"), QStringLiteral("1024"));
+    parser.addOption(block_size_option);
+    const QCommandLineOption output_format_option(QStringLiteral("output-format"), "Format stretched audio is converted to: float (default), int32, int16 (dithered) or int16-shaped (noise-shaped dither), as for sound cards without float support", QStringLiteral("format"), QStringLiteral("float"));
+    parser.addOption(output_format_option);
+    const QCommandLineOption reduced_memory_option(QStringLiteral("reduced-memory"), "Keep decoded audio as 16-bit integers");
+    parser.addOption(reduced_memory_option);
+    const QCommandLineOption no_formant_option(QStringLiteral("no-formant-preservation"), "Do not preserve formant shape");
+    parser.addOption(no_formant_option);
+    const QCommandLineOption channels_together_option(QStringLiteral("channels-together"), "Process channels together");
+    parser.addOption(channels_together_option);
+    const QCommandLineOption parallel_channels_option(QStringLiteral("parallel-channels"), "Process channels (or channel pairs) in parallel threads");
+    parser.addOption(parallel_channels_option);
+    const QCommandLineOption conversion_only_option(QStringLiteral("conversion-only"), "Only check and measure the sample conversion kernels");
+    parser.addOption(conversion_only_option);
+    parser.process(app);
+
+    StretcherSettings base_settings;
+    base_settings.formant_preserved = !parser.isSet(no_formant_option);
+    base_settings.channels_together = parser.isSet(channels_together_option);
+    base_settings.parallel_channels = parser.isSet(parallel_channels_option);
+    duration = parser.value(duration_option).toInt();
+    block_size = parser.value(block_size_option).toInt();
+    output_format = parser.value(output_format_option).toLower();
+    conversion_only = parser.isSet(conversion_only_option);
+    storage_format = parser.isSet(reduced_memory_option) ? SampleStore::Int16 : SampleStore::Float32;
+    QStringList preset_values = parser.values(preset_option);
+    if (preset_values.isEmpty())
+      preset_values = {QStringLiteral("0:1.0"), QStringLiteral("0:0.7"), QStringLiteral("5:1.0"), QStringLiteral("-3:1.3")};
+    if ((duration <= 0) || (block_size <= 0) || !QStringList({QStringLiteral("float"), QStringLiteral("int32"), QStringLiteral("int16"), QStringLiteral("int16-shaped")}).contains(output_format) || !appendConfigurations(parser.value(engines_option), parser.value(qualities_option), parser.value(channels_option), parser.value(rates_option), preset_values, base_settings, configurations)) {
+      QTextStream(stderr) << "Engines among r2 and r3, qualities among standard and high, an output format among float, int32, int16 and int16-shaped, positive channel counts, sample rates, duration and block size, valid pitches and positive speed ratios are expected" << Qt::endl;
+      return 1;
+    }
+  }
+
+  const bool conversion_exact = ConversionBenchmark::checkKernels(output_stream);
+  ConversionBenchmark::measureKernels(output_stream);
+  if (conversion_only)
+    return conversion_exact ? 0 : 1;
+
+  output_stream << Qt::endl << "Processing path (" << duration << " s signals, " << block_size << "-frame blocks, " << output_format << " output). Realtime factors are durations processed per second; block times are in microseconds, to be compared with the block's duration. Allocations of the audio renderer are counted while it renders and hands blocks to the sink (settings changes apart), and must be none" << Qt::endl;
+  output_stream << qSetFieldWidth(9) << Qt::left << "engine" << "quality" << "ch" << "rate" << "pitch" << "speed" << Qt::right << qSetFieldWidth(10) << "decode" << "realtime" << "duration" << "p50" << "p90" << "p99" << "max" << "allocs" << "renderer" << qSetFieldWidth(0) << Qt::left << Qt::endl;
+  bool renderer_allocation_free = true;
+  const QAudioFormat::SampleFormat output_sample_format = (output_format == QStringLiteral("float")) ? QAudioFormat::Float : ((output_format == QStringLiteral("int32")) ? QAudioFormat::Int32 : QAudioFormat::Int16);
+  for (const PipelineBenchmark::Configuration &configuration : std::as_const(configurations)) {
+    const PipelineBenchmark::Result result = PipelineBenchmark(configuration, duration, block_size, output_sample_format, output_format == QStringLiteral("int16-shaped"), storage_format).run();
+    output_stream << qSetFieldWidth(9) << (configuration.settings.use_r3_engine ? "r3" : "r2") << (configuration.settings.high_quality ? "high" : "standard") << configuration.nb_channels << configuration.sample_rate
+		  << QString::number(12.0 * std::log2(configuration.settings.pitch_scale), 'f', 1) << QString::number(1.0 / configuration.settings.time_ratio, 'f', 2) << Qt::right << qSetFieldWidth(10)
+		  << QString::number(result.decoding_speed, 'f', 0) << QString::number(result.realtime_factor, 'f', 1) << result.block_duration << result.block_time_p50 << result.block_time_p90 << result.block_time_p99 << result.block_time_max
+		  << (AllocationCounter::isAvailable() ? QString::number(result.nb_allocations) : QStringLiteral("n/a")) << (AllocationCounter::isAvailable() ? QString::number(result.nb_renderer_allocations) : QStringLiteral("n/a")) << qSetFieldWidth(0) << Qt::left << Qt::endl;
+    if (result.nb_renderer_allocations > 0)
+      renderer_allocation_free = false;
+  }
+
+  if (!renderer_allocation_free)
+    QTextStream(stderr) << "The audio renderer allocated memory while rendering" << Qt::endl;
+  return (conversion_exact && renderer_allocation_free) ? 0 : 1;
+}
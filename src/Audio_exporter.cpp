@@ -0,0 +1,129 @@
+// Copyright 2026 François CROLLET
+
+// This file is part of VPS Player.
+// VPS Player is free software; you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation; either version 3 of the License, or (at your option) any later version.
+// VPS Player is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License along with VPS Player. If not, see <http://www.gnu.org/licenses/>.
+
+#include "Audio_exporter.h"
+#include "Audio_file_writer.h"
+#include "Parallel_stretcher.h"
+
+#define EXPORT_BLOCK_SIZE 16384 // Decoded audio is studied and processed, and stretched audio is retrieved, in slices of at most EXPORT_BLOCK_SIZE frames
+#define EXPORT_STUDY_PROGRESS 10 // Share of the progress given to the study pass (in percent)
+
+
+// Constructor. The sample store must be complete
+AudioExporter::AudioExporter(std::shared_ptr<const SampleStore> samples, const StretcherSettings &stretcher_settings, const QString &filename, QObject *parent) : QObject(parent),
+  decoded_samples(std::move(samples)),
+  settings(stretcher_settings),
+  output_filename(filename),
+  cancelled(false),
+  progress(-1)
+{
+
+}
+
+
+// Destructor
+AudioExporter::~AudioExporter()
+{
+
+}
+
+
+// Ask the rendering to stop as soon as possible (may be called from any thread)
+void AudioExporter::cancel()
+{
+  cancelled.store(true, std::memory_order_relaxed);
+}
+
+
+// Returns a description of the error that made the rendering fail
+QString AudioExporter::errorString() const
+{
+  return error_string;
+}
+
+
+// Renders the file (blocking, may be called from any thread). Returns true if the output file has been written successfully
+bool AudioExporter::render()
+{
+  updateProgress(0);
+
+  const unsigned int nb_channels = decoded_samples->channelCount();
+  const qint64 nb_frames = decoded_samples->frameCount();
+  AudioFileWriter writer(output_filename, nb_channels, decoded_samples->sampleRate());
+  if (!writer.open()) {
+    error_string = writer.errorString();
+    emit finished(false);
+    return false;
+  }
+
+  ParallelStretcher stretcher(static_cast<size_t>(decoded_samples->sampleRate()), nb_channels, settings.generateOptionsFlag(false), settings.time_ratio, settings.pitch_scale, settings.parallel_channels);
+  stretcher.setExpectedInputDuration(static_cast<size_t>(nb_frames));
+  stretcher.setMaxProcessSize(EXPORT_BLOCK_SIZE);
+
+  auto stretcher_input = std::make_unique<const float*[]>(nb_channels);
+  auto input_samples = std::make_unique<float[]>(nb_channels * EXPORT_BLOCK_SIZE);
+  auto input_conversion_buffer = std::make_unique<float*[]>(nb_channels);
+  auto output_samples = std::make_unique<float[]>(nb_channels * EXPORT_BLOCK_SIZE);
+  auto stretcher_output = std::make_unique<float*[]>(nb_channels);
+  for (unsigned int i = 0; i < nb_channels; i++) {
+    input_conversion_buffer[i] = input_samples.get() + (i * EXPORT_BLOCK_SIZE);
+    stretcher_output[i] = output_samples.get() + (i * EXPORT_BLOCK_SIZE);
+  }
+
+  // Study pass: the offline stretcher analyses the whole file before processing it
+  qint64 frame = 0;
+  while ((frame < nb_frames) && !cancelled.load(std::memory_order_relaxed)) {
+    qint64 nb_input_frames = decoded_samples->readFrames(frame, EXPORT_BLOCK_SIZE, stretcher_input.get(), input_conversion_buffer.get());
+    frame += nb_input_frames;
+    stretcher.study(stretcher_input.get(), static_cast<size_t>(nb_input_frames), frame >= nb_frames);
+    updateProgress(static_cast<int>((EXPORT_STUDY_PROGRESS * frame) / nb_frames));
+  }
+
+  // Process pass: stretched audio is written to the file as soon as it is available
+  bool success = true;
+  frame = 0;
+  while (success && (frame < nb_frames) && !cancelled.load(std::memory_order_relaxed)) {
+    qint64 nb_input_frames = decoded_samples->readFrames(frame, EXPORT_BLOCK_SIZE, stretcher_input.get(), input_conversion_buffer.get());
+    frame += nb_input_frames;
+    stretcher.process(stretcher_input.get(), static_cast<size_t>(nb_input_frames), frame >= nb_frames);
+
+    int nb_available_frames;
+    while (success && ((nb_available_frames = stretcher.available()) > 0)) {
+      size_t nb_output_frames = stretcher.retrieve(stretcher_output.get(), static_cast<size_t>(qMin(nb_available_frames, EXPORT_BLOCK_SIZE)));
+      success = writer.write(stretcher_output.get(), static_cast<qint64>(nb_output_frames));
+    }
+    updateProgress(EXPORT_STUDY_PROGRESS + static_cast<int>(((100 - EXPORT_STUDY_PROGRESS) * frame) / nb_frames));
+  }
+
+  if (cancelled.load(std::memory_order_relaxed)) {
+    writer.discard();
+    error_string = QStringLiteral("Export cancelled");
+    emit finished(false);
+    return false;
+  }
+
+  success = success && writer.close();
+  if (!success) {
+    error_string = writer.errorString();
+    writer.discard();
+    emit finished(false);
+    return false;
+  }
+
+  emit finished(true);
+  return true;
+}
+
+
+// Emits progressChanged() if the progress has changed
+void AudioExporter::updateProgress(int new_progress)
+{
+  if (new_progress != progress) {
+    progress = new_progress;
+    emit progressChanged(progress);
+  }
+}
@@ -0,0 +1,48 @@
+// Copyright 2026 François CROLLET
+
+// This file is part of VPS Player.
+// VPS Player is free software; you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation; either version 3 of the License, or (at your option) any later version.
+// VPS Player is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License along with VPS Player. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef AUDIO_EXPORTER_H
+#define AUDIO_EXPORTER_H
+
+#include <atomic>
+#include <memory>
+#include <QObject>
+#include <QString>
+
+#include "Sample_store.h"
+#include "Stretcher_settings.h"
+
+
+// Renders a whole decoded file to an audio file with the offline stretcher, which studies the audio before processing it and gives better results than live playing
+class AudioExporter : public QObject
+{
+  Q_OBJECT
+
+private:
+  std::shared_ptr<const SampleStore> decoded_samples;
+  StretcherSettings settings;
+  QString output_filename;
+  std::atomic<bool> cancelled;
+  QString error_string;
+  int progress;
+
+public:
+  AudioExporter(std::shared_ptr<const SampleStore> samples, const StretcherSettings &stretcher_settings, const QString &filename, QObject *parent = nullptr); // Constructor. The sample store must be complete
+  ~AudioExporter(); // Destructor
+  void cancel(); // Ask the rendering to stop as soon as possible (may be called from any thread)
+  QString errorString() const; // Returns a description of the error that made the rendering fail
+  bool render(); // Renders the file (blocking, may be called from any thread). Returns true if the output file has been written successfully
+
+private:
+  void updateProgress(int new_progress); // Emits progressChanged() if the progress has changed
+
+signals:
+  void finished(bool); // This signal is emitted when the rendering ends. Parameter: true if the output file has been written successfully
+  void progressChanged(int); // This signal is emitted to indicate the current rendering progress. Parameter: progress between 0 and 100
+};
+
+#endif
@@ -0,0 +1,417 @@
+// Copyright 2026 François CROLLET
+
+// This file is part of VPS Player.
+// VPS Player is free software; you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation; either version 3 of the License, or (at your option) any later version.
+// VPS Player is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License along with VPS Player. If not, see <http://www.gnu.org/licenses/>.
+
+#include <cstdlib>
+#include <QtEndian>
+#include <QDataStream>
+#include <QFileInfo>
+
+#include "Audio_file_writer.h"
+#include "Sample_conversion.h"
+
+#define FLAC_BLOCK_SIZE 4096 // Number of frames per FLAC frame
+#define FLAC_BITS_PER_SAMPLE 24
+#define FLAC_MAX_CHANNELS 8
+#define FLAC_MAX_FIXED_ORDER 4
+#define FLAC_MAX_RICE_PARAMETER 30 // 31 is the escape code of 5-bit Rice parameters
+#define FLAC_STREAMINFO_TOTAL_OFFSET 18 // Position in the file of STREAMINFO's fields completed when the file is closed (sample rate, channels, bits per sample, total samples, MD5)
+#define WAV_HEADER_SIZE 94
+#define WAV_DS64_OFFSET 12 // Position in the file of the chunk reserved for RF64 sizes (JUNK, turned into ds64 if the data does not fit in 4 GiB)
+#define WAV_FACT_LENGTH_OFFSET 82 // Position in the file of the number of frames given by the fact chunk
+
+
+// Constructor. The file format is deduced from the file name's suffix (FLAC for ".flac", WAV otherwise)
+AudioFileWriter::AudioFileWriter(const QString &filename, unsigned int channel_count, int frame_rate) : file(filename),
+													 file_format(QFileInfo(filename).suffix().compare(QStringLiteral("flac"), Qt::CaseInsensitive) == 0 ? AudioFileWriter::Flac : AudioFileWriter::Wav),
+													 nb_channels(channel_count),
+													 sample_rate(frame_rate),
+													 nb_written_frames(0),
+													 nb_block_frames(0),
+													 flac_frame_number(0),
+													 bit_buffer(0),
+													 nb_buffered_bits(0),
+													 md5_hash(QCryptographicHash::Md5)
+{
+  if (file_format == AudioFileWriter::Flac) {
+    block_samples = std::make_unique<qint32[]>(nb_channels * FLAC_BLOCK_SIZE);
+    residuals = std::make_unique<qint32[]>(FLAC_BLOCK_SIZE);
+  }
+}
+
+
+// Destructor
+AudioFileWriter::~AudioFileWriter()
+{
+  if (file.isOpen())
+    file.close();
+}
+
+
+// Writes pending audio, completes the headers and closes the file
+bool AudioFileWriter::close()
+{
+  bool success = true;
+
+  if (file_format == AudioFileWriter::Flac) {
+    if (nb_block_frames > 0) {
+      encodeFlacFrame();
+      success = writeOutputData();
+    }
+    writeBits(sample_rate, 20);
+    writeBits(nb_channels - 1, 3);
+    writeBits(FLAC_BITS_PER_SAMPLE - 1, 5);
+    writeBits(nb_written_frames >> 32, 4);
+    writeBits(nb_written_frames, 32);
+    output_data.append(md5_hash.result());
+    success = success && file.seek(FLAC_STREAMINFO_TOTAL_OFFSET) && writeOutputData();
+  }
+  else {
+    const quint64 data_size = static_cast<quint64>(nb_written_frames) * nb_channels * sizeof(float);
+    const quint64 riff_size = WAV_HEADER_SIZE - 8 + data_size;
+    if (riff_size <= 0xFFFFFFFF) // The JUNK chunk stays
+      success = writeWavField<quint32>(4, static_cast<quint32>(riff_size)) && writeWavField<quint32>(WAV_FACT_LENGTH_OFFSET, static_cast<quint32>(nb_written_frames)) && writeWavField<quint32>(WAV_HEADER_SIZE - 4, static_cast<quint32>(data_size));
+    else { // RF64: 32-bit sizes are set to 0xFFFFFFFF, the actual ones are given by the ds64 chunk replacing the JUNK one
+      success = file.seek(0) && (file.write("RF64", 4) == 4) && writeWavField<quint32>(4, 0xFFFFFFFF);
+      success = success && file.seek(WAV_DS64_OFFSET) && (file.write("ds64", 4) == 4);
+      success = success && writeWavField<quint64>(WAV_DS64_OFFSET + 8, riff_size) && writeWavField<quint64>(WAV_DS64_OFFSET + 16, data_size) && writeWavField<quint64>(WAV_DS64_OFFSET + 24, static_cast<quint64>(nb_written_frames));
+      success = success && writeWavField<quint32>(WAV_FACT_LENGTH_OFFSET, 0xFFFFFFFF) && writeWavField<quint32>(WAV_HEADER_SIZE - 4, 0xFFFFFFFF);
+    }
+  }
+  if (!success)
+    error_string = file.errorString();
+
+  file.close();
+  return success;
+}
+
+
+// Closes and removes the file
+void AudioFileWriter::discard()
+{
+  file.remove();
+}
+
+
+// Returns a description of the last error
+QString AudioFileWriter::errorString() const
+{
+  return error_string;
+}
+
+
+// Returns the format of the file
+AudioFileWriter::FileFormat AudioFileWriter::getFileFormat() const
+{
+  return file_format;
+}
+
+
+// Creates the file and writes its headers
+bool AudioFileWriter::open()
+{
+  if ((file_format == AudioFileWriter::Flac) && (nb_channels > FLAC_MAX_CHANNELS)) [[unlikely]] {
+    error_string = QStringLiteral("FLAC files cannot hold more than %1 channels").arg(FLAC_MAX_CHANNELS);
+    return false;
+  }
+  if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+    error_string = file.errorString();
+    return false;
+  }
+
+  if (file_format == AudioFileWriter::Flac)
+    return writeFlacHeader();
+  else
+    return writeWavHeader();
+}
+
+
+// Appends planar float samples
+bool AudioFileWriter::write(const float *const *channel_data, qint64 nb_frames)
+{
+  nb_written_frames += nb_frames;
+
+  if (file_format == AudioFileWriter::Wav) {
+    output_data.resize(static_cast<qsizetype>(nb_frames * nb_channels * sizeof(float)));
+    float *output_samples = reinterpret_cast<float*>(output_data.data());
+    SampleConversion::interleave(channel_data, output_samples, nb_channels, nb_frames);
+    qToLittleEndian<float>(output_samples, static_cast<qsizetype>(nb_frames * nb_channels), output_samples); // Nothing to do on little-endian CPUs
+    return writeOutputData();
+  }
+
+  qint64 frame = 0;
+  while (frame < nb_frames) {
+    qint64 nb_copied_frames = qMin(nb_frames - frame, FLAC_BLOCK_SIZE - nb_block_frames);
+    for (unsigned int i = 0; i < nb_channels; i++) {
+      qint32 *block = block_samples.get() + (i * FLAC_BLOCK_SIZE) + nb_block_frames;
+      for (qint64 j = 0; j < nb_copied_frames; j++)
+	block[j] = qBound(-8388608, qRound(channel_data[i][frame + j] * 8388608.0f), 8388607);
+    }
+    nb_block_frames += nb_copied_frames;
+    frame += nb_copied_frames;
+
+    if (nb_block_frames == FLAC_BLOCK_SIZE) {
+      encodeFlacFrame();
+      if (!writeOutputData())
+	return false;
+    }
+  }
+  return true;
+}
+
+
+// Appends the nb_bits lowest bits of value to output_data (most significant bit first)
+template<typename T>
+inline void AudioFileWriter::writeBits(T value, int nb_bits)
+{
+  bit_buffer = (bit_buffer << nb_bits) | (static_cast<quint64>(value) & ((Q_UINT64_C(1) << nb_bits) - 1));
+  nb_buffered_bits += nb_bits;
+  while (nb_buffered_bits >= 8) {
+    nb_buffered_bits -= 8;
+    output_data.append(static_cast<char>(bit_buffer >> nb_buffered_bits));
+  }
+}
+
+
+// Writes a little-endian size field of the WAV headers at given position
+template<typename T>
+bool AudioFileWriter::writeWavField(qint64 position, T value)
+{
+  const T little_endian_value = qToLittleEndian(value);
+  return file.seek(position) && (file.write(reinterpret_cast<const char*>(&little_endian_value), sizeof(T)) == static_cast<qint64>(sizeof(T)));
+}
+
+
+// Returns the CRC-8 of data, as defined for FLAC frame headers
+quint8 AudioFileWriter::computeCrc8(QByteArrayView data) const
+{
+  quint8 crc = 0;
+  for (char byte : data) {
+    crc ^= static_cast<quint8>(byte);
+    for (int i = 0; i < 8; i++)
+      crc = (crc & 0x80) ? static_cast<quint8>((crc << 1) ^ 0x07) : static_cast<quint8>(crc << 1);
+  }
+  return crc;
+}
+
+
+// Returns the CRC-16 of data, as defined for FLAC frames
+quint16 AudioFileWriter::computeCrc16(QByteArrayView data) const
+{
+  quint16 crc = 0;
+  for (char byte : data) {
+    crc ^= static_cast<quint16>(static_cast<quint8>(byte) << 8);
+    for (int i = 0; i < 8; i++)
+      crc = (crc & 0x8000) ? static_cast<quint16>((crc << 1) ^ 0x8005) : static_cast<quint16>(crc << 1);
+  }
+  return crc;
+}
+
+
+// Encodes buffered samples as a FLAC frame and writes it
+void AudioFileWriter::encodeFlacFrame()
+{
+  // The stream's MD5 signature is computed on interleaved little-endian samples
+  QByteArray signed_data(static_cast<qsizetype>(nb_block_frames * nb_channels * 3), Qt::Uninitialized);
+  char *signed_bytes = signed_data.data();
+  for (qint64 j = 0; j < nb_block_frames; j++)
+    for (unsigned int i = 0; i < nb_channels; i++) {
+      const qint32 sample = block_samples[(i * FLAC_BLOCK_SIZE) + j];
+      *signed_bytes++ = static_cast<char>(sample);
+      *signed_bytes++ = static_cast<char>(sample >> 8);
+      *signed_bytes++ = static_cast<char>(sample >> 16);
+    }
+  md5_hash.addData(signed_data);
+
+  const qsizetype frame_start = output_data.size();
+  writeBits(0x3FFE, 14); // Sync code
+  writeBits(0, 1); // Reserved
+  writeBits(0, 1); // Fixed block size
+  writeBits(0x7, 4); // Block size is given at the end of the header
+  writeBits(0x0, 4); // Sample rate is given by STREAMINFO
+  writeBits(nb_channels - 1, 4); // Channels are coded independently
+  writeBits(0x0, 3); // Sample size is given by STREAMINFO
+  writeBits(0, 1); // Reserved
+  writeUtf8Number(flac_frame_number);
+  writeBits(nb_block_frames - 1, 16);
+  writeBits(computeCrc8(QByteArrayView(output_data).sliced(frame_start)), 8);
+
+  for (unsigned int i = 0; i < nb_channels; i++)
+    encodeFlacSubframe(block_samples.get() + (i * FLAC_BLOCK_SIZE));
+  flushBits();
+  writeBits(computeCrc16(QByteArrayView(output_data).sliced(frame_start)), 16);
+
+  flac_frame_number++;
+  nb_block_frames = 0;
+}
+
+
+// Encodes the samples of one channel of the buffered block
+void AudioFileWriter::encodeFlacSubframe(const qint32 *samples)
+{
+  bool constant = true;
+  for (qint64 i = 1; constant && (i < nb_block_frames); i++)
+    constant = (samples[i] == samples[0]);
+  if (constant) { // Typically silence
+    writeBits(0x00, 8); // CONSTANT subframe
+    writeBits(samples[0], FLAC_BITS_PER_SAMPLE);
+    return;
+  }
+
+  // Choose the fixed predictor order that gives the smallest residuals
+  quint64 residual_sums[FLAC_MAX_FIXED_ORDER + 1] = {};
+  for (qint64 i = FLAC_MAX_FIXED_ORDER; i < nb_block_frames; i++) {
+    const qint64 s0 = samples[i], s1 = samples[i - 1], s2 = samples[i - 2], s3 = samples[i - 3], s4 = samples[i - 4];
+    residual_sums[0] += static_cast<quint64>(std::llabs(s0));
+    residual_sums[1] += static_cast<quint64>(std::llabs(s0 - s1));
+    residual_sums[2] += static_cast<quint64>(std::llabs(s0 - (2 * s1) + s2));
+    residual_sums[3] += static_cast<quint64>(std::llabs(s0 - (3 * s1) + (3 * s2) - s3));
+    residual_sums[4] += static_cast<quint64>(std::llabs(s0 - (4 * s1) + (6 * s2) - (4 * s3) + s4));
+  }
+  int order = 0;
+  for (int i = 1; i <= FLAC_MAX_FIXED_ORDER; i++)
+    if (residual_sums[i] < residual_sums[order])
+      order = i;
+
+  quint64 residual_sum = 0;
+  for (qint64 i = order; i < nb_block_frames; i++) {
+    switch(order) {
+    case 0 :
+      residuals[i] = samples[i];
+      break;
+    case 1 :
+      residuals[i] = samples[i] - samples[i - 1];
+      break;
+    case 2 :
+      residuals[i] = samples[i] - (2 * samples[i - 1]) + samples[i - 2];
+      break;
+    case 3 :
+      residuals[i] = samples[i] - (3 * samples[i - 1]) + (3 * samples[i - 2]) - samples[i - 3];
+      break;
+    default :
+      residuals[i] = samples[i] - (4 * samples[i - 1]) + (6 * samples[i - 2]) - (4 * samples[i - 3]) + samples[i - 4];
+    }
+    residual_sum += static_cast<quint64>(std::abs(residuals[i]));
+  }
+
+  // Rice parameter close to log2 of the mean residual, and resulting size compared to plain samples
+  const quint64 nb_residuals = static_cast<quint64>(nb_block_frames - order);
+  unsigned int parameter = 0;
+  while ((parameter < FLAC_MAX_RICE_PARAMETER) && ((nb_residuals << parameter) < residual_sum))
+    parameter++;
+  quint64 nb_encoded_bits = (static_cast<quint64>(order) * FLAC_BITS_PER_SAMPLE) + 11 + (nb_residuals * (parameter + 1));
+  for (qint64 i = order; i < nb_block_frames; i++)
+    nb_encoded_bits += ((static_cast<quint32>(residuals[i]) << 1) ^ static_cast<quint32>(residuals[i] >> 31)) >> parameter;
+
+  if (nb_encoded_bits >= static_cast<quint64>(nb_block_frames * FLAC_BITS_PER_SAMPLE)) {
+    writeBits(0x02, 8); // VERBATIM subframe
+    for (qint64 i = 0; i < nb_block_frames; i++)
+      writeBits(samples[i], FLAC_BITS_PER_SAMPLE);
+    return;
+  }
+
+  writeBits(0x10 | (order << 1), 8); // FIXED subframe with given predictor order
+  for (qint64 i = 0; i < order; i++) // Warm-up samples
+    writeBits(samples[i], FLAC_BITS_PER_SAMPLE);
+  writeBits(0x1, 2); // Residuals are Rice-coded with 5-bit parameters
+  writeBits(0x0, 4); // A single partition
+  writeBits(parameter, 5);
+  for (qint64 i = order; i < nb_block_frames; i++)
+    writeRiceResidual(residuals[i], parameter);
+}
+
+
+// Pads output_data to a byte boundary
+void AudioFileWriter::flushBits()
+{
+  if (nb_buffered_bits > 0)
+    writeBits(0, 8 - nb_buffered_bits);
+}
+
+
+// Writes FLAC stream marker and STREAMINFO block
+bool AudioFileWriter::writeFlacHeader()
+{
+  output_data.append("fLaC", 4);
+  writeBits(0x80, 8); // Last metadata block, of type STREAMINFO
+  writeBits(34, 24); // Block length
+  writeBits(FLAC_BLOCK_SIZE, 16); // Minimum block size
+  writeBits(FLAC_BLOCK_SIZE, 16); // Maximum block size
+  writeBits(0, 24); // Minimum frame size (unknown)
+  writeBits(0, 24); // Maximum frame size (unknown)
+  writeBits(sample_rate, 20);
+  writeBits(nb_channels - 1, 3);
+  writeBits(FLAC_BITS_PER_SAMPLE - 1, 5);
+  writeBits(0, 4); // Total number of frames and MD5 signature are written when the file is closed
+  writeBits(0, 32);
+  output_data.append(16, '\0');
+  return writeOutputData();
+}
+
+
+// Writes output_data to the file and clears it
+bool AudioFileWriter::writeOutputData()
+{
+  const bool success = (file.write(output_data) == output_data.size());
+  if (!success)
+    error_string = file.errorString();
+  output_data.clear();
+  return success;
+}
+
+
+// Appends a residual, Rice-coded with given parameter
+void AudioFileWriter::writeRiceResidual(qint32 residual, unsigned int parameter)
+{
+  const quint32 folded_residual = (static_cast<quint32>(residual) << 1) ^ static_cast<quint32>(residual >> 31);
+  quint32 quotient = folded_residual >> parameter;
+  while (quotient >= 32) {
+    writeBits(0, 32);
+    quotient -= 32;
+  }
+  writeBits(1, static_cast<int>(quotient) + 1); // Quotient in unary
+  if (parameter > 0)
+    writeBits(folded_residual, static_cast<int>(parameter));
+}
+
+
+// Appends a number coded the way FLAC frame headers do (extended UTF-8)
+void AudioFileWriter::writeUtf8Number(quint64 value)
+{
+  if (value < 0x80) {
+    writeBits(value, 8);
+    return;
+  }
+
+  int nb_bytes = 2;
+  while ((nb_bytes < 7) && (value >= (Q_UINT64_C(1) << ((5 * nb_bytes) + 1))))
+    nb_bytes++;
+  writeBits((0xFF00 >> nb_bytes) | (value >> (6 * (nb_bytes - 1))), 8);
+  for (int i = nb_bytes - 2; i >= 0; i--)
+    writeBits(0x80 | ((value >> (6 * i)) & 0x3F), 8);
+}
+
+
+// Writes WAV headers (sizes are completed when the file is closed, as RF64 ones if the data exceeds 4 GiB)
+bool AudioFileWriter::writeWavHeader()
+{
+  QDataStream header(&output_data, QIODevice::WriteOnly);
+  header.setByteOrder(QDataStream::LittleEndian);
+  header.writeRawData("RIFF", 4);
+  header << quint32(0);
+  header.writeRawData("WAVE", 4);
+  header.writeRawData("JUNK", 4); // Room for a ds64 chunk, in case the file ends up needing RF64
+  header << quint32(28);
+  header.writeRawData(QByteArray(28, '\0').constData(), 28);
+  header.writeRawData("fmt ", 4);
+  header << quint32(18) << quint16(3) << quint16(nb_channels) << quint32(sample_rate); // Format 3: IEEE float
+  header << quint32(static_cast<quint32>(sample_rate) * nb_channels * sizeof(float)) << quint16(nb_channels * sizeof(float)) << quint16(32) << quint16(0);
+  header.writeRawData("fact", 4);
+  header << quint32(4) << quint32(0);
+  header.writeRawData("data", 4);
+  header << quint32(0);
+  return writeOutputData();
+}
@@ -0,0 +1,74 @@
+// Copyright 2026 François CROLLET
+
+// This file is part of VPS Player.
+// VPS Player is free software; you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation; either version 3 of the License, or (at your option) any later version.
+// VPS Player is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License along with VPS Player. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef AUDIO_FILE_WRITER_H
+#define AUDIO_FILE_WRITER_H
+
+#include <memory>
+#include <QByteArray>
+#include <QByteArrayView>
+#include <QCryptographicHash>
+#include <QFile>
+#include <QString>
+
+
+// Writes planar float audio to a WAV file (32-bit float samples, RF64 beyond 4 GiB) or to a FLAC file (24-bit samples, encoded with fixed predictors)
+class AudioFileWriter
+{
+public:
+  enum FileFormat
+    {
+     Wav = 0,
+     Flac = 1
+    };
+
+private:
+  QFile file;
+  AudioFileWriter::FileFormat file_format;
+  unsigned int nb_channels;
+  int sample_rate;
+  qint64 nb_written_frames;
+  QString error_string;
+  QByteArray output_data;
+  std::unique_ptr<qint32[]> block_samples; // Planar samples waiting to be encoded in the next FLAC frame
+  std::unique_ptr<qint32[]> residuals;
+  qint64 nb_block_frames;
+  quint64 flac_frame_number;
+  quint64 bit_buffer;
+  int nb_buffered_bits;
+  QCryptographicHash md5_hash;
+
+public:
+  AudioFileWriter(const QString &filename, unsigned int channel_count, int frame_rate); // Constructor. The file format is deduced from the file name's suffix (FLAC for ".flac", WAV otherwise)
+  ~AudioFileWriter(); // Destructor
+  bool close(); // Writes pending audio, completes the headers and closes the file
+  void discard(); // Closes and removes the file
+  QString errorString() const; // Returns a description of the last error
+  AudioFileWriter::FileFormat getFileFormat() const; // Returns the format of the file
+  bool open(); // Creates the file and writes its headers
+  bool write(const float *const *channel_data, qint64 nb_frames); // Appends planar float samples
+
+private:
+  template<typename T>
+  void writeBits(T value, int nb_bits); // Appends the nb_bits lowest bits of value to output_data (most significant bit first)
+
+  template<typename T>
+  bool writeWavField(qint64 position, T value); // Writes a little-endian size field of the WAV headers at given position
+
+  quint8 computeCrc8(QByteArrayView data) const; // Returns the CRC-8 of data, as defined for FLAC frame headers
+  quint16 computeCrc16(QByteArrayView data) const; // Returns the CRC-16 of data, as defined for FLAC frames
+  void encodeFlacFrame(); // Encodes buffered samples as a FLAC frame and writes it
+  void encodeFlacSubframe(const qint32 *samples); // Encodes the samples of one channel of the buffered block
+  void flushBits(); // Pads output_data to a byte boundary
+  bool writeFlacHeader(); // Writes FLAC stream marker and STREAMINFO block
+  bool writeOutputData(); // Writes output_data to the file and clears it
+  void writeRiceResidual(qint32 residual, unsigned int parameter); // Appends a residual, Rice-coded with given parameter
+  void writeUtf8Number(quint64 value); // Appends a number coded the way FLAC frame headers do (extended UTF-8)
+  bool writeWavHeader(); // Writes WAV headers (sizes are completed when the file is closed, as RF64 ones if the data exceeds 4 GiB)
+};
+
+#endif
@@ -0,0 +1,381 @@
+// Copyright 2026 François CROLLET
+
+// This file is part of VPS Player.
+// VPS Player is free software; you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation; either version 3 of the License, or (at your option) any later version.
+// VPS Player is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License along with VPS Player. If not, see <http://www.gnu.org/licenses/>.
+
+#include <limits>
+#include <QMetaObject>
+#include <QMutexLocker>
+#include <QtDebug>
+#include <QThreadPool>
+#include <QUrl>
+
+#include "Audio_loader.h"
+#include "Decode_cache.h"
+
+#define DECODING_SEGMENT_MIN_DURATION 10 // Minimum duration of the segments decoded concurrently, in seconds
+#define PROGRESS_REPORT_INTERVAL 50 // Minimum interval between progress reports of native decoding, in milliseconds
+
+
+// Constructor
+AudioLoader::AudioLoader(const QString &file, SampleStore::StorageFormat format, QObject *parent) : QObject(parent),
+												    filename(file),
+												    storage_format(format),
+												    decode_cache_enabled(false),
+												    audio_decoder(nullptr),
+												    nb_decoding_segments(0),
+												    decoding_cancelled(false),
+												    nb_finished_segments(0),
+												    decoding_failed(false)
+{
+
+}
+
+
+// Destructor
+AudioLoader::~AudioLoader()
+{
+  if (isLoading())
+    releaseDecoder();
+}
+
+
+// Stop loading the file (no signal is emitted afterwards)
+void AudioLoader::cancel()
+{
+  if (isLoading())
+    releaseDecoder();
+  disconnect(this, nullptr, nullptr, nullptr);
+}
+
+
+// Returns the sample store (nullptr until samplesAvailable() has been emitted)
+std::shared_ptr<SampleStore> AudioLoader::getSamples() const
+{
+  return decoded_samples;
+}
+
+
+// Returns true while the file is being loaded
+bool AudioLoader::isLoading() const
+{
+  return (audio_decoder != nullptr) || (decoding_segments != nullptr);
+}
+
+
+// Enable or disable the on-disk cache of decoded files
+void AudioLoader::setDecodeCacheEnabled(bool enabled)
+{
+  decode_cache_enabled = enabled;
+}
+
+
+// Sets the function choosing, from the file format, the channel count and sample rate decoded samples are converted to. By default, the file format is kept
+void AudioLoader::setFormatSelector(const std::function<QAudioFormat(const QAudioFormat&)> &selector)
+{
+  format_selector = selector;
+}
+
+
+// Start loading the file
+void AudioLoader::start()
+{
+  emit loadingProgressChanged(0);
+  if (decode_cache_enabled && loadCachedFile())
+    return;
+  if (startNativeDecoding())
+    return;
+
+  audio_decoder = new QAudioDecoder(this);
+  audio_decoder->setSource(QUrl::fromLocalFile(filename));
+
+  connect(audio_decoder, &QAudioDecoder::bufferReady, this, &AudioLoader::firstDecodedBufferReady);
+  connect(audio_decoder, qOverload<QAudioDecoder::Error>(&QAudioDecoder::error), this, &AudioLoader::abortDecoding);
+
+  audio_decoder->start();
+}
+
+
+// Abort audio file decoding after a decoder error
+void AudioLoader::abortDecoding(QAudioDecoder::Error error)
+{
+  releaseDecoder();
+  decoded_samples.reset();
+  qDebug() << "Error while decoding audio file:" << error;
+  emit decodingError(error);
+}
+
+
+// Decodes a segment of the file with its native decoder, until the segment's end, an error or cancellation (body of the segment's thread)
+void AudioLoader::decodeSegment(int index)
+{
+  AudioLoader::DecodingSegment &segment = decoding_segments[index];
+  const unsigned int nb_channels = segment.decoder->channelCount();
+  qint64 frame = segment.start_frame;
+  qint64 nb_block_frames = 0;
+
+  while ((frame < segment.end_frame) && !decoding_cancelled.load(std::memory_order_relaxed)) {
+    const void *block_samples;
+    QAudioFormat::SampleFormat block_format;
+    nb_block_frames = segment.decoder->decodeNextBlock(&block_samples, &block_format);
+    if (nb_block_frames <= 0)
+      break;
+    nb_block_frames = qMin(nb_block_frames, segment.end_frame - frame); // The next segment is never written over
+    decoded_samples->write(frame, block_samples, block_format, nb_block_frames, nb_channels);
+    frame += nb_block_frames;
+
+    QMutexLocker locker(&segments_mutex);
+    segment.decoded_frame = frame;
+    updateDecodedFrames();
+  }
+
+  // The last segment ends with the file, the others where the next one starts
+  const bool success = (index == (nb_decoding_segments - 1)) ? (nb_block_frames == 0) : (frame == segment.end_frame);
+  QMutexLocker locker(&segments_mutex);
+  if (!success) {
+    decoding_failed = true;
+    decoding_cancelled = true; // Other segments are useless
+  }
+  nb_finished_segments++;
+  if (nb_finished_segments == nb_decoding_segments)
+    QMetaObject::invokeMethod(this, [this, success = !decoding_failed](){ finishNativeDecoding(success); }, Qt::QueuedConnection);
+}
+
+
+// End audio file decoding
+void AudioLoader::finishDecoding()
+{
+  releaseDecoder();
+  decoded_samples->setComplete();
+
+  emit loadingProgressChanged(100);
+  emit decodedPositionChanged(static_cast<int>(decoded_samples->decodedDuration() / 1000));
+  if (decode_cache_enabled)
+    QThreadPool::globalInstance()->start([samples = decoded_samples, file = filename](){ DecodeCache::save(*samples, file); });
+  emit finished();
+}
+
+
+// End audio file decoding once all segments are decoded. Parameter: false if the file is corrupt
+void AudioLoader::finishNativeDecoding(bool success)
+{
+  if (decoding_segments == nullptr) // Posted just before decoding was cancelled
+    return;
+  if (!success) {
+    abortDecoding(QAudioDecoder::FormatError);
+    return;
+  }
+
+  if (decoded_samples->frameCount() != decoding_segments[0].decoder->frameCount()) // Unknown length, or truncated file
+    emit durationChanged(static_cast<int>(decoded_samples->decodedDuration() / 1000));
+  finishDecoding();
+}
+
+
+// Reads the first decoded buffer and sets audio format accordingly for further decoding
+void AudioLoader::firstDecodedBufferReady()
+{
+  const QAudioBuffer first_buffer = audio_decoder->read();
+  const QAudioFormat file_format = first_buffer.format();
+  qDebug() << "File format:" << file_format;
+  disconnect(audio_decoder, &QAudioDecoder::bufferReady, this, &AudioLoader::firstDecodedBufferReady);
+
+  const QAudioFormat target_format = selectFormat(file_format);
+  decoded_samples = std::make_shared<SampleStore>(static_cast<unsigned int>(target_format.channelCount()), target_format.sampleRate(), storage_format);
+
+  if (target_format.sampleRate() != file_format.sampleRate()) {
+    // The decoder has to resample (Rubber Band cannot process this rate): a new decoding session is needed with the target format, which remixes channels too
+    qDebug() << "Restarting decoder to convert to selected format";
+    const QUrl file_url = audio_decoder->source();
+    releaseDecoder();
+
+    audio_decoder = new QAudioDecoder(this);
+    audio_decoder->setSource(file_url);
+
+    QAudioFormat decode_format(target_format);
+    decode_format.setSampleFormat(QAudioFormat::Float);
+    audio_decoder->setAudioFormat(decode_format);
+    connect(audio_decoder, qOverload<QAudioDecoder::Error>(&QAudioDecoder::error), this, &AudioLoader::abortDecoding);
+  }
+  else
+    decoded_samples->setInputChannels(static_cast<unsigned int>(file_format.channelCount()), file_format.channelConfig());
+
+  // Otherwise the current decoding session goes on: samples are converted to planar float (and remixed if needed) by the store as they arrive
+  connect(audio_decoder, &QAudioDecoder::bufferReady, this, &AudioLoader::readDecoderBuffer);
+  connect(audio_decoder, &QAudioDecoder::durationChanged, [this](qint64 duration){ if (duration > 0) emit durationChanged(static_cast<int>(duration)); });
+  connect(audio_decoder, &QAudioDecoder::finished, this, &AudioLoader::finishDecoding);
+  emit samplesAvailable();
+
+  if (audio_decoder->isDecoding()) {
+    if (audio_decoder->duration() > 0)
+      emit durationChanged(static_cast<int>(audio_decoder->duration()));
+    storeDecodedBuffer(first_buffer);
+    while (audio_decoder && audio_decoder->bufferAvailable()) // The decoder may have been cancelled by a receiver of the signals emitted so far
+      readDecoderBuffer();
+  }
+  else
+    audio_decoder->start();
+}
+
+
+// Loads decoded audio from the on-disk cache. Returns false if the file is not cached or its cached format (channels, sample rate or storage format) is not the selected one
+bool AudioLoader::loadCachedFile()
+{
+  std::shared_ptr<SampleStore> cached_samples = DecodeCache::load(filename);
+  if (!cached_samples)
+    return false;
+
+  QAudioFormat file_format;
+  file_format.setChannelCount(static_cast<int>(cached_samples->channelCount()));
+  file_format.setSampleRate(cached_samples->sampleRate());
+  const QAudioFormat target_format = selectFormat(file_format);
+  if ((target_format.channelCount() != file_format.channelCount()) || (target_format.sampleRate() != file_format.sampleRate()) || (cached_samples->getStorageFormat() != storage_format))
+    return false;
+
+  decoded_samples = std::move(cached_samples);
+  emit samplesAvailable();
+  emit durationChanged(static_cast<int>(decoded_samples->decodedDuration() / 1000));
+  emit loadingProgressChanged(100);
+  emit decodedPositionChanged(static_cast<int>(decoded_samples->decodedDuration() / 1000));
+  emit finished();
+  return true;
+}
+
+
+// Read buffer from the decoder
+void AudioLoader::readDecoderBuffer()
+{
+  const QAudioBuffer audio_buffer = audio_decoder->read();
+  if (decoded_samples.get() && audio_buffer.isValid()) [[likely]]
+    storeDecodedBuffer(audio_buffer);
+}
+
+
+// Stop and dispose of the decoder
+void AudioLoader::releaseDecoder()
+{
+  if (decoding_segments) {
+    decoding_cancelled = true;
+    for (int i = 0; i < nb_decoding_segments; i++) {
+      decoding_segments[i].thread->wait();
+      delete decoding_segments[i].thread;
+    }
+    decoding_segments.reset();
+    nb_decoding_segments = 0;
+  }
+  if (audio_decoder) {
+    audio_decoder->stop();
+    disconnect(audio_decoder, nullptr, nullptr, nullptr);
+    audio_decoder->deleteLater();
+    audio_decoder = nullptr;
+  }
+}
+
+
+// Emits the progress of native decoding, summed over all segments
+void AudioLoader::reportDecodingProgress()
+{
+  if (decoding_segments == nullptr) // Posted just before decoding ended
+    return;
+
+  qint64 nb_decoded_frames = 0;
+  {
+    QMutexLocker locker(&segments_mutex);
+    for (int i = 0; i < nb_decoding_segments; i++)
+      nb_decoded_frames += decoding_segments[i].decoded_frame - decoding_segments[i].start_frame;
+  }
+  const qint64 nb_frames = decoding_segments[0].decoder->frameCount();
+  if (nb_frames > 0)
+    emit loadingProgressChanged(static_cast<int>(qMin((100 * nb_decoded_frames) / nb_frames, static_cast<qint64>(100))));
+  emit decodedPositionChanged(static_cast<int>(decoded_samples->decodedDuration() / 1000));
+}
+
+
+// Returns the format decoded samples are converted to
+QAudioFormat AudioLoader::selectFormat(const QAudioFormat &file_format) const
+{
+  if (format_selector)
+    return format_selector(file_format);
+  return file_format;
+}
+
+
+// Starts decoding the file natively if a native decoder supports it and the selected sample rate is the file's (channels are remixed by the store): files of known length are split in segments, as many as cores. Returns false otherwise
+bool AudioLoader::startNativeDecoding()
+{
+  std::unique_ptr<NativeDecoder> decoder = NativeDecoder::create(filename);
+  if (!decoder)
+    return false;
+
+  QAudioFormat file_format;
+  file_format.setChannelCount(static_cast<int>(decoder->channelCount()));
+  file_format.setSampleRate(decoder->sampleRate());
+  const QAudioFormat target_format = selectFormat(file_format);
+  if (target_format.sampleRate() != file_format.sampleRate()) // Resampling is left to QAudioDecoder
+    return false;
+  qDebug() << "File format:" << file_format << "(decoded natively)";
+
+  // Each segment starts where its decoder could seek to, near an even split of the file
+  const qint64 nb_frames = decoder->frameCount();
+  const int nb_segments = static_cast<int>(qBound(static_cast<qint64>(1), nb_frames / (static_cast<qint64>(DECODING_SEGMENT_MIN_DURATION) * file_format.sampleRate()), static_cast<qint64>(QThread::idealThreadCount())));
+  decoding_segments = std::make_unique<AudioLoader::DecodingSegment[]>(nb_segments);
+  decoding_segments[0].decoder = std::move(decoder);
+  decoding_segments[0].start_frame = 0;
+  nb_decoding_segments = 1;
+  for (int i = 1; i < nb_segments; i++) {
+    std::unique_ptr<NativeDecoder> segment_decoder = NativeDecoder::create(filename);
+    const qint64 start_frame = segment_decoder ? segment_decoder->seek((nb_frames * i) / nb_segments) : -1;
+    if ((start_frame <= decoding_segments[nb_decoding_segments - 1].start_frame) || (start_frame >= nb_frames))
+      continue;
+    decoding_segments[nb_decoding_segments].decoder = std::move(segment_decoder);
+    decoding_segments[nb_decoding_segments].start_frame = start_frame;
+    nb_decoding_segments++;
+  }
+  for (int i = 0; i < nb_decoding_segments; i++) {
+    decoding_segments[i].end_frame = (i < (nb_decoding_segments - 1)) ? decoding_segments[i + 1].start_frame : std::numeric_limits<qint64>::max();
+    decoding_segments[i].decoded_frame = decoding_segments[i].start_frame;
+  }
+
+  // Samples can be read as soon as the threads have started: receivers of the signals may then cancel loading
+  decoded_samples = std::make_shared<SampleStore>(static_cast<unsigned int>(target_format.channelCount()), file_format.sampleRate(), storage_format);
+  decoded_samples->setInputChannels(static_cast<unsigned int>(file_format.channelCount()));
+  decoding_cancelled = false;
+  nb_finished_segments = 0;
+  decoding_failed = false;
+  report_timer.start();
+  for (int i = 0; i < nb_decoding_segments; i++) {
+    decoding_segments[i].thread = QThread::create(&AudioLoader::decodeSegment, this, i);
+    decoding_segments[i].thread->start();
+  }
+  emit samplesAvailable();
+  if (nb_frames > 0)
+    emit durationChanged(static_cast<int>((nb_frames * 1000) / file_format.sampleRate()));
+  return true;
+}
+
+
+// Append a decoded buffer to the sample store
+void AudioLoader::storeDecodedBuffer(const QAudioBuffer &audio_buffer)
+{
+  decoded_samples->append(audio_buffer);
+  if (audio_decoder->duration() > 0)
+    emit loadingProgressChanged(static_cast<int>((100 * audio_decoder->position()) / audio_decoder->duration()));
+  emit decodedPositionChanged(static_cast<int>(decoded_samples->decodedDuration() / 1000));
+}
+
+
+// Makes the frames decoded without any gap from the start of the file readable, and posts a progress report if the last one is old enough (segments_mutex held)
+void AudioLoader::updateDecodedFrames()
+{
+  int segment = 0;
+  while ((segment < (nb_decoding_segments - 1)) && (decoding_segments[segment].decoded_frame == decoding_segments[segment].end_frame))
+    segment++;
+  decoded_samples->setFrameCount(decoding_segments[segment].decoded_frame);
+
+  if (report_timer.hasExpired(PROGRESS_REPORT_INTERVAL)) {
+    QMetaObject::invokeMethod(this, &AudioLoader::reportDecodingProgress, Qt::QueuedConnection);
+    report_timer.restart();
+  }
+}
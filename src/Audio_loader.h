@@ -0,0 +1,90 @@
+// Copyright 2026 François CROLLET
+
+// This file is part of VPS Player.
+// VPS Player is free software; you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation; either version 3 of the License, or (at your option) any later version.
+// VPS Player is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License along with VPS Player. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef AUDIO_LOADER_H
+#define AUDIO_LOADER_H
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <QAudioBuffer>
+#include <QAudioDecoder>
+#include <QAudioFormat>
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QObject>
+#include <QString>
+#include <QThread>
+
+#include "Native_decoder.h"
+#include "Sample_store.h"
+
+
+// Loads an audio file into a sample store, from the on-disk cache if possible, otherwise by decoding it (natively for WAV, AIFF and FLAC files, in segments decoded concurrently, with QAudioDecoder for other formats). Samples can be read while the file is still being decoded
+class AudioLoader : public QObject
+{
+  Q_OBJECT
+
+private:
+  struct DecodingSegment // Region of the file decoded natively, in a thread of its own
+  {
+    std::unique_ptr<NativeDecoder> decoder;
+    qint64 start_frame;
+    qint64 end_frame; // Frame the next segment starts at
+    qint64 decoded_frame; // Frame following the last decoded one (protected by segments_mutex)
+    QThread *thread;
+  };
+
+  QString filename;
+  SampleStore::StorageFormat storage_format;
+  bool decode_cache_enabled;
+  std::function<QAudioFormat(const QAudioFormat&)> format_selector;
+  QAudioDecoder *audio_decoder;
+  std::unique_ptr<AudioLoader::DecodingSegment[]> decoding_segments;
+  int nb_decoding_segments;
+  std::atomic<bool> decoding_cancelled;
+  QMutex segments_mutex;
+  int nb_finished_segments; // Protected by segments_mutex, as well as what follows
+  bool decoding_failed;
+  QElapsedTimer report_timer;
+  std::shared_ptr<SampleStore> decoded_samples;
+
+public:
+  AudioLoader(const QString &file, SampleStore::StorageFormat format = SampleStore::Float32, QObject *parent = nullptr); // Constructor
+  ~AudioLoader(); // Destructor
+  void cancel(); // Stop loading the file (no signal is emitted afterwards)
+  std::shared_ptr<SampleStore> getSamples() const; // Returns the sample store (nullptr until samplesAvailable() has been emitted)
+  bool isLoading() const; // Returns true while the file is being loaded
+  void setDecodeCacheEnabled(bool enabled); // Enable or disable the on-disk cache of decoded files
+  void setFormatSelector(const std::function<QAudioFormat(const QAudioFormat&)> &selector); // Sets the function choosing, from the file format, the channel count and sample rate decoded samples are converted to. By default, the file format is kept
+  void start(); // Start loading the file
+
+private:
+  void abortDecoding(QAudioDecoder::Error error); // Abort audio file decoding after a decoder error
+  void decodeSegment(int index); // Decodes a segment of the file with its native decoder, until the segment's end, an error or cancellation (body of the segment's thread)
+  void finishDecoding(); // End audio file decoding
+  void finishNativeDecoding(bool success); // End audio file decoding once all segments are decoded. Parameter: false if the file is corrupt
+  void firstDecodedBufferReady(); // Reads the first decoded buffer and sets audio format accordingly for further decoding
+  bool loadCachedFile(); // Loads decoded audio from the on-disk cache. Returns false if the file is not cached or its cached format (channels, sample rate or storage format) is not the selected one
+  void readDecoderBuffer(); // Read buffer from the decoder
+  void releaseDecoder(); // Stop and dispose of the decoder
+  void reportDecodingProgress(); // Emits the progress of native decoding, summed over all segments
+  QAudioFormat selectFormat(const QAudioFormat &file_format) const; // Returns the format decoded samples are converted to
+  bool startNativeDecoding(); // Starts decoding the file natively if a native decoder supports it and the selected sample rate is the file's (channels are remixed by the store): files of known length are split in segments, as many as cores. Returns false otherwise
+  void storeDecodedBuffer(const QAudioBuffer &audio_buffer); // Append a decoded buffer to the sample store
+  void updateDecodedFrames(); // Makes the frames decoded without any gap from the start of the file readable, and posts a progress report if the last one is old enough (segments_mutex held)
+
+signals:
+  void decodedPositionChanged(int); // This signal is emitted each time more audio has been decoded. Parameter: end of the decoded region in milliseconds
+  void decodingError(QAudioDecoder::Error); // This signal is emitted if an error occurs while trying to decode audio file
+  void durationChanged(int); // This signal is emitted each time the total duration of the file changes. Parameter: duration in milliseconds
+  void finished(); // This signal is emitted once the whole file has been loaded
+  void loadingProgressChanged(int); // This signal is emitted to indicate the current loading progress. Parameter: progress between 0 and 100
+  void samplesAvailable(); // This signal is emitted once the sample store has been created: its samples can then be read while the file is being loaded
+};
+
+#endif
@@ -6,78 +6,138 @@
 // You should have received a copy of the GNU General Public License along with VPS Player. If not, see <http://www.gnu.org/licenses/>.
 
 #include <QtDebug>
-#include <QtMath>
 #include <QMediaDevices>
-#include <QUrl>
 
 #include "Audio_player.h"
 
 #define RUBBERBAND_MIN_SAMPLERATE 8000
 #define RUBBERBAND_MAX_SAMPLERATE 192000
+#define PLAYBACK_START_THRESHOLD 500000 // Playing starts as soon as this much audio (in microseconds) has been decoded
+#define STATISTICS_UPDATE_INTERVAL 500 // Interval between two reports of performance counters (in milliseconds)
+#define DEFAULT_RENDER_AHEAD 2000 // Maximum duration of stretched audio rendered ahead of playback (in milliseconds)
+#define DEFAULT_LATENCY 200 // Duration of the audio sink's buffer (in milliseconds)
 
 
 // Constructor
 AudioPlayer::AudioPlayer(QObject *parent) : QObject(parent),
 					    status(AudioPlayer::NoFileLoaded),
 					    output_volume(1.0),
-					    time_ratio(1.0),
-					    pitch_scale(1.0),
-					    option_use_r3_engine(true),
-					    option_formant_preserved(true),
-					    option_high_quality(true),
-					    option_channels_together(false),
+					    decode_cache_enabled(false),
+					    render_ahead(DEFAULT_RENDER_AHEAD),
+					    latency(DEFAULT_LATENCY),
+					    noise_shaping(false),
+					    storage_format(SampleStore::Float32),
 					    audio_device(QMediaDevices::defaultAudioOutput()),
 					    min_channel_count(audio_device.minimumChannelCount()),
 					    max_channel_count(audio_device.maximumChannelCount()),
 					    min_sample_rate(qMax(audio_device.minimumSampleRate(), RUBBERBAND_MIN_SAMPLERATE)),
 					    max_sample_rate(qMin(audio_device.maximumSampleRate(), RUBBERBAND_MAX_SAMPLERATE)),
-					    float_output(audio_device.supportedSampleFormats().contains(QAudioFormat::Float))
+					    output_sample_format(audio_device.supportedSampleFormats().contains(QAudioFormat::Float) ? QAudioFormat::Float : (audio_device.supportedSampleFormats().contains(QAudioFormat::Int32) ? QAudioFormat::Int32 : QAudioFormat::Int16)),
+					    loop_start(0),
+					    loop_end(0),
+					    audio_loader(nullptr),
+					    renderer(nullptr),
+					    exporter(nullptr),
+					    export_thread(nullptr)
 {
   qDebug() << "Minimum channel_count:" << min_channel_count;
   qDebug() << "Maximum channel count:" << max_channel_count;
   qDebug() << "Minimum sample rate:" << min_sample_rate;
   qDebug() << "Maximum sample rate:" << max_sample_rate;
+
+  render_thread = new QThread(this);
+  render_thread->setObjectName(QStringLiteral("Audio renderer"));
+  render_thread->start(QThread::TimeCriticalPriority);
+
+  statistics_timer = new QTimer(this);
+  statistics_timer->setInterval(STATISTICS_UPDATE_INTERVAL);
+  connect(statistics_timer, &QTimer::timeout, this, &AudioPlayer::updateStatistics);
 }
 
 
 // Destructor
 AudioPlayer::~AudioPlayer()
 {
-  
+  if (export_thread) {
+    exporter->cancel();
+    export_thread->wait();
+  }
+  if (audio_loader)
+    releaseLoader();
+  if (renderer)
+    releaseRenderer();
+  render_thread->quit();
+  render_thread->wait();
 }
 
 
 // Cancel current file decoding
 void AudioPlayer::cancelDecoding()
 {
-  if (status != AudioPlayer::Loading) [[unlikely]]
+  if (audio_loader == nullptr) [[unlikely]]
     return;
 
   abortDecoding(QAudioDecoder::NoError);
 }
 
 
+// Cancel current export
+void AudioPlayer::cancelExport()
+{
+  if (exporter) [[likely]]
+    exporter->cancel();
+}
+
+
 // Decode an audio file
 void AudioPlayer::decodeFile(const QString &filename)
 {
   if (status == AudioPlayer::Loading) [[unlikely]]
     return;
   
-  if ((status == AudioPlayer::Paused) || (status == AudioPlayer::Playing))
+  if (audio_loader)
+    abortDecoding(QAudioDecoder::NoError);
+  else if ((status == AudioPlayer::Paused) || (status == AudioPlayer::Playing))
     stopPlaying();
   
   status = AudioPlayer::Loading;
+  decoded_samples.reset();
+  loop_start = 0;
+  loop_end = 0;
   emit statusChanged(status);
   emit readingPositionChanged(-1);
-  emit loadingProgressChanged(0);
+  emit decodedPositionChanged(-1);
+  emit waveformChanged(nullptr);
+
+  audio_loader = new AudioLoader(filename, storage_format, this);
+  audio_loader->setDecodeCacheEnabled(decode_cache_enabled);
+  audio_loader->setFormatSelector([this](const QAudioFormat &file_format){ return selectDecodingFormat(file_format); }); // Samples are remixed to the output channel count while decoding, the stretcher converts the sample rate
+  connect(audio_loader, &AudioLoader::samplesAvailable, [this](){
+    decoded_samples = audio_loader->getSamples();
+    emit waveformChanged(decoded_samples->waveformOverview());
+  });
+  connect(audio_loader, &AudioLoader::durationChanged, this, &AudioPlayer::durationChanged);
+  connect(audio_loader, &AudioLoader::loadingProgressChanged, this, &AudioPlayer::loadingProgressChanged);
+  connect(audio_loader, &AudioLoader::decodedPositionChanged, this, &AudioPlayer::updateDecodedPosition);
+  connect(audio_loader, &AudioLoader::decodingError, this, &AudioPlayer::abortDecoding);
+  connect(audio_loader, &AudioLoader::finished, this, &AudioPlayer::finishDecoding);
+  audio_loader->start();
+}
 
-  audio_decoder = new QAudioDecoder(this);
-  audio_decoder->setSource(QUrl::fromLocalFile(filename));
 
-  connect(audio_decoder, &QAudioDecoder::bufferReady, this, &AudioPlayer::firstDecodedBufferReady);
-  connect(audio_decoder, qOverload<QAudioDecoder::Error>(&QAudioDecoder::error), this, &AudioPlayer::abortDecoding);
-  
-  audio_decoder->start();
+// Render the whole decoded file with current settings to a WAV or FLAC file, faster than real time
+void AudioPlayer::exportFile(const QString &filename)
+{
+  if ((decoded_samples == nullptr) || (audio_loader != nullptr) || (exporter != nullptr)) [[unlikely]]
+    return;
+
+  exporter = new AudioExporter(decoded_samples, stretcher_settings, filename, this);
+  connect(exporter, &AudioExporter::progressChanged, this, &AudioPlayer::exportProgressChanged);
+  connect(exporter, &AudioExporter::finished, this, &AudioPlayer::finishExport);
+  export_thread = QThread::create(&AudioExporter::render, exporter); // Signals emitted from this thread are queued to the exporter's (and player's) thread
+  export_thread->setObjectName(QStringLiteral("Audio exporter"));
+  export_thread->start(QThread::LowPriority);
+  emit statusChanged(status); // Export state is part of the displayed status
 }
 
 
@@ -88,22 +148,30 @@ AudioPlayer::Status AudioPlayer::getStatus() const
 }
 
 
+// Returns true while the file is still being decoded (playing may already have started)
+bool AudioPlayer::isDecoding() const
+{
+  return audio_loader != nullptr;
+}
+
+
+// Returns true while a file is being exported
+bool AudioPlayer::isExporting() const
+{
+  return exporter != nullptr;
+}
+
+
 // Move reading position. Parameter: position in milliseconds
 void AudioPlayer::moveReadingPosition(int position)
 {
   if ((status != AudioPlayer::Playing) && (status != AudioPlayer::Paused)) [[unlikely]]
     return;
   
-  reading_index = 0;
-  while ((reading_index < nb_audio_buffers) && (static_cast<int>(decoded_samples->at(reading_index).startTime() / 1000) < position))
-    reading_index++;
-
+  if (audio_loader)
+    position = qMin(position, static_cast<int>(decoded_samples->decodedDuration() / 1000));
   emit readingPositionChanged(position);
-  
-  temp_buffer->close();
-  temp_buffer->buffer().clear();
-  stretcher->reset();
-  fillAudioBuffer();
+  QMetaObject::invokeMethod(renderer, &AudioRenderer::moveReadingPosition, Qt::QueuedConnection, position);
 }
 
 
@@ -115,8 +183,7 @@ void AudioPlayer::pausePlaying()
 
   status = AudioPlayer::Paused;
   emit statusChanged(status);
-  audio_output->suspend();
-  timer->stop();
+  QMetaObject::invokeMethod(renderer, &AudioRenderer::pauseOutput, Qt::QueuedConnection);
 }
 
 
@@ -128,9 +195,7 @@ void AudioPlayer::resumePlaying()
 
   status = AudioPlayer::Playing;
   emit statusChanged(status);
-  timer->start();
-  audio_output->resume();
-  fillAudioBuffer();
+  QMetaObject::invokeMethod(renderer, &AudioRenderer::resumeOutput, Qt::QueuedConnection);
 }
 
 
@@ -143,40 +208,72 @@ void AudioPlayer::startPlaying()
   status = AudioPlayer::Playing;
   emit statusChanged(status);
 
-  reading_index = 0;
-  no_more_data = false;
-
-  stretcher = std::make_unique<RubberBand::RubberBandStretcher>(static_cast<size_t>(target_format.sampleRate()),
-								static_cast<size_t>(nb_channels),
-								generateStretcherOptionsFlag(),
-								time_ratio,
-								pitch_scale);
-  int max_sample_count = 0;
-  for (QAudioBuffer const& audio_buffer : *decoded_samples) {
-    int sample_count = audio_buffer.sampleCount();
-    if (sample_count > max_sample_count)
-      max_sample_count = sample_count;
-  }
-  stretcher->setMaxProcessSize(static_cast<size_t>(max_sample_count));
-
-  audio_output = new QAudioSink(audio_device, target_format, this);
-  audio_output->setBufferSize(static_cast<qsizetype>(target_format.bytesForDuration(200000))); // Audio buffer size should correspond to about 200 ms.
-  audio_output->setVolume(output_volume);
-  timer = new QChronoTimer(std::chrono::nanoseconds(10000), this);
-  temp_buffer = new QBuffer(this);
-  connect(audio_output, &QAudioSink::stateChanged, this, &AudioPlayer::manageAudioOutputState);
-  output_buffer = audio_output->start();
-  QAudio::Error error_status = audio_output->error();
-  if ((error_status == QAudio::NoError) || (error_status == QAudio::UnderrunError)) {
-    fillAudioBuffer();
-    connect(timer, &QChronoTimer::timeout, this, &AudioPlayer::fillAudioBuffer);
-    timer->start();
-  }
-  else {
-    qDebug() << "Error while opening audio device:" << error_status;
-    emit audioOutputError(error_status);
-    stopPlaying();
-  }
+  renderer = new AudioRenderer(decoded_samples, target_format, generateStretcherOptionsFlag(), stretcher_settings.time_ratio, stretcher_settings.pitch_scale, stretcher_settings.parallel_channels, render_ahead, latency, noise_shaping);
+  renderer->moveToThread(render_thread);
+  connect(renderer, &AudioRenderer::playingFinished, this, &AudioPlayer::finishPlaying);
+  connect(renderer, &AudioRenderer::audioOutputError, this, &AudioPlayer::abortPlaying);
+  connect(renderer, &AudioRenderer::latencyChanged, this, &AudioPlayer::latencyChanged);
+  connect(renderer, &AudioRenderer::readingPositionChanged, this, &AudioPlayer::updateRenderingPosition);
+  if (loop_end > loop_start)
+    QMetaObject::invokeMethod(renderer, &AudioRenderer::updateLoop, Qt::QueuedConnection, loop_start, loop_end);
+  QMetaObject::invokeMethod(renderer, &AudioRenderer::startOutput, Qt::QueuedConnection, audio_device, output_volume);
+}
+
+
+// Enable or disable the on-disk cache of decoded files
+void AudioPlayer::setDecodeCacheEnabled(bool enabled)
+{
+  decode_cache_enabled = enabled;
+}
+
+
+// Keep decoded samples as 16-bit integers (instead of float) for files loaded from now on
+void AudioPlayer::setReducedMemoryUsage(bool enabled)
+{
+  storage_format = enabled ? SampleStore::Int16 : SampleStore::Float32;
+}
+
+
+// Shape the dither of 16-bit output, so that quantization noise is less audible (only used if the audio device supports neither float nor 32-bit samples)
+void AudioPlayer::setNoiseShapingEnabled(bool enabled)
+{
+  noise_shaping = enabled;
+  if (status == AudioPlayer::Paused || status == AudioPlayer::Playing)
+    QMetaObject::invokeMethod(renderer, &AudioRenderer::updateNoiseShaping, Qt::QueuedConnection, enabled);
+}
+
+
+// Loops playback between given positions in milliseconds, without stretching the loop again on each pass (no loop if end is not after start)
+void AudioPlayer::setLoop(int start, int end)
+{
+  loop_start = start;
+  loop_end = end;
+  if (status == AudioPlayer::Paused || status == AudioPlayer::Playing)
+    QMetaObject::invokeMethod(renderer, &AudioRenderer::updateLoop, Qt::QueuedConnection, start, end);
+}
+
+
+// Sets the duration of the audio sink's buffer in milliseconds, which also sizes rendered blocks (applies from the next playing start)
+void AudioPlayer::setLatency(int duration)
+{
+  latency = duration;
+}
+
+
+// Sets the maximum duration of stretched audio rendered ahead of playback, in milliseconds (applies from the next playing start)
+void AudioPlayer::setRenderAhead(int duration)
+{
+  render_ahead = duration;
+}
+
+
+// Enable or disable the periodic report of performance counters
+void AudioPlayer::setStatisticsEnabled(bool enabled)
+{
+  if (enabled)
+    statistics_timer->start();
+  else
+    statistics_timer->stop();
 }
 
 
@@ -190,61 +287,65 @@ void AudioPlayer::stopPlaying()
   emit statusChanged(status);
   emit readingPositionChanged(0);
 
-  disconnect(timer, nullptr, nullptr, nullptr);
-  timer->deleteLater();
-  audio_output->stop();
-  disconnect(audio_output, nullptr, nullptr, nullptr);
-  audio_output->deleteLater();
-  temp_buffer->deleteLater();
-  stretcher.reset();
+  releaseRenderer();
 }
 
 
 // Sets pitch shifting engine
 void AudioPlayer::updateOptionUseR3Engine(bool option)
 {
-  option_use_r3_engine = option;
+  stretcher_settings.use_r3_engine = option;
+  updateRendererOptions();
 }
 
 
 // Change "formant preserved" option
 void AudioPlayer::updateOptionFormantPreserved(bool option)
 {
-  option_formant_preserved = option;
-  if (status == AudioPlayer::Paused || status == AudioPlayer::Playing)
-    stretcher->setFormantOption(generateStretcherOptionsFlag());
+  stretcher_settings.formant_preserved = option;
+  updateRendererOptions();
 }
 
 
 // Change "high quality" option
 void AudioPlayer::updateOptionHighQuality(bool option)
 {
-  option_high_quality = option;
+  stretcher_settings.high_quality = option;
+  updateRendererOptions();
 }
 
 
 // Change "process channels together" option
 void AudioPlayer::updateOptionChannelsTogether(bool option)
 {
-  option_channels_together = option;
+  stretcher_settings.channels_together = option;
+  updateRendererOptions();
+}
+
+
+// Change "process channels in parallel" option
+void AudioPlayer::updateOptionParallelChannels(bool option)
+{
+  stretcher_settings.parallel_channels = option;
+  updateRendererOptions();
 }
 
 
 // Update pitch
 void AudioPlayer::updatePitch(int pitch)
 {
-  pitch_scale = static_cast<double>(qPow(qreal(2.0), pitch / qreal(12.0)));
+  stretcher_settings.setPitch(pitch);
   if (status == AudioPlayer::Paused || status == AudioPlayer::Playing)
-    stretcher->setPitchScale(pitch_scale);
+    QMetaObject::invokeMethod(renderer, &AudioRenderer::updatePitchScale, Qt::QueuedConnection, stretcher_settings.pitch_scale);
 }
 
 
 // Update speed
 void AudioPlayer::updateSpeed(double speed_ratio)
 {
-  time_ratio = 1.0 / speed_ratio;
+  stretcher_settings.setSpeed(speed_ratio);
   if (status == AudioPlayer::Paused || status == AudioPlayer::Playing)
-    stretcher->setTimeRatio(time_ratio);
+    QMetaObject::invokeMethod(renderer, &AudioRenderer::updateTimeRatio, Qt::QueuedConnection, stretcher_settings.time_ratio);
 }
 
 
@@ -253,210 +354,176 @@ void AudioPlayer::updateVolume(qreal volume)
 {
   output_volume = volume;
   if (status == AudioPlayer::Paused || status == AudioPlayer::Playing)
-    audio_output->setVolume(output_volume);
+    QMetaObject::invokeMethod(renderer, &AudioRenderer::updateVolume, Qt::QueuedConnection, output_volume);
 }
 
 
-// Converts a float sample to output format <qint16>
-template<>
-inline qint16 AudioPlayer::convertFloatSampleToOutputFormat<qint16>(float sample)
+// Abort audio file decoding
+void AudioPlayer::abortDecoding(QAudioDecoder::Error error)
 {
-  return static_cast<qint16>(qBound(-32767, qRound(sample * 32767.0f), 32767));
+  if ((status == AudioPlayer::Paused) || (status == AudioPlayer::Playing))
+    stopPlaying();
+
+  status = AudioPlayer::NoFileLoaded;
+  releaseLoader();
+  decoded_samples.reset();
+  emit statusChanged(status);
+  emit durationChanged(-1);
+  emit decodedPositionChanged(-1);
+  emit waveformChanged(nullptr);
+  
+  if (error != QAudioDecoder::NoError)
+    emit audioDecodingError(error);
 }
 
 
-// Converts a float sample to output format <float>
-template<>
-inline float AudioPlayer::convertFloatSampleToOutputFormat<float>(float sample)
+// Stop playing after an audio output error
+void AudioPlayer::abortPlaying(QAudio::Error error)
 {
-  return sample;
+  if ((renderer == nullptr) || (sender() != renderer)) [[unlikely]]
+    return;
+
+  emit audioOutputError(error);
+  stopPlaying();
 }
 
 
-// Retrieves the stretcher output and puts it into temp_buffer
-template<typename OUTPUT_FORMAT>
-void AudioPlayer::moveStretcherOutputToTempBuffer()
+// End audio file decoding
+void AudioPlayer::finishDecoding()
 {
-  unsigned int nb_output_frames = static_cast<unsigned int>(stretcher->available());
+  if (audio_loader == nullptr) [[unlikely]]
+    return;
 
-  if (nb_output_frames > 0) {
-    temp_buffer->close();
+  releaseLoader();
+  if (status == AudioPlayer::Loading)
+    playDecodedAudio();
+  else
+    emit statusChanged(status); // Decoding state is part of the displayed status
+}
 
-    float **stretcher_output = new float*[nb_channels];
-    for (unsigned int i = 0; i < nb_channels; i++)
-      stretcher_output[i] = new float[nb_output_frames];
-    nb_output_frames = static_cast<unsigned int>(stretcher->retrieve(stretcher_output, static_cast<size_t>(nb_output_frames)));
 
-    unsigned int nb_output_samples = nb_output_frames * nb_channels;
-    OUTPUT_FORMAT *output_samples = new OUTPUT_FORMAT[nb_output_samples];
-    for (unsigned int i = 0; i < nb_channels; i++){
-      for (unsigned int j = 0; j < nb_output_frames; j++)
-	output_samples[(nb_channels * j) + i] = convertFloatSampleToOutputFormat<OUTPUT_FORMAT>(stretcher_output[i][j]);
-      delete[] stretcher_output[i];
-    }
-    delete[] stretcher_output;
+// Dispose of the exporter once the export has ended
+void AudioPlayer::finishExport(bool success)
+{
+  if (exporter == nullptr) [[unlikely]]
+    return;
 
-    temp_buffer->setData(reinterpret_cast<char*>(output_samples), static_cast<int>(sizeof(OUTPUT_FORMAT) * nb_output_samples));
-    delete[] output_samples;
- 
-    temp_buffer->open(QIODevice::ReadOnly);
-    temp_buffer->seek(0);
-  }
+  export_thread->wait();
+  delete export_thread;
+  export_thread = nullptr;
+  const QString error_message = success ? QString() : exporter->errorString();
+  exporter->deleteLater();
+  exporter = nullptr;
+  emit statusChanged(status);
+  emit exportFinished(error_message);
 }
 
 
-// Abort audio file decoding
-void AudioPlayer::abortDecoding(QAudioDecoder::Error error)
+// Stop playing once the renderer has played all decoded audio
+void AudioPlayer::finishPlaying()
 {
-  status = AudioPlayer::NoFileLoaded;
-  audio_decoder->stop();
-  disconnect(audio_decoder, nullptr, nullptr, nullptr);
-  audio_decoder->deleteLater();
-  decoded_samples.reset();
-  emit statusChanged(status);
-  emit durationChanged(-1);
-  
-  if (error != QAudioDecoder::NoError) {
-    qDebug() << "Error while decoding audio file:" << error;
-    emit audioDecodingError(error);
-  }
+  if ((renderer == nullptr) || (sender() != renderer)) [[unlikely]]
+    return;
+
+  stopPlaying();
 }
 
 
-// Fill output audio buffer
-void AudioPlayer::fillAudioBuffer()
-{
-  int bytes_needed = audio_output->bytesFree();
-
-  while (bytes_needed > 0) {
-    while (temp_buffer->atEnd()){
-      if (reading_index >= nb_audio_buffers) {
-	no_more_data = true;
-	return;
-      }
-      
-      const QAudioBuffer &current_audio_buffer = decoded_samples->at(reading_index);
-      reading_index++;
-      const float *audio_buffer_data = current_audio_buffer.constData<float>();
-      
-      unsigned int nb_input_frames = static_cast<unsigned int>(current_audio_buffer.frameCount());
-      float **stretcher_input = new float*[nb_channels];
-      for (unsigned int i = 0; i < nb_channels; i++){
-	stretcher_input[i] = new float[nb_input_frames];
-	for (unsigned int j = 0; j < nb_input_frames; j++)
-	  stretcher_input[i][j] = audio_buffer_data[(nb_channels * j) + i];
-      }
-      stretcher->process(stretcher_input, static_cast<size_t>(nb_input_frames), reading_index == nb_audio_buffers);
-      for (unsigned int i = 0; i < nb_channels; i++)
-	delete[] stretcher_input[i];
-      delete[] stretcher_input;
-
-      if (float_output)
-	moveStretcherOutputToTempBuffer<float>();
-      else
-	moveStretcherOutputToTempBuffer<qint16>();
-
-      emit readingPositionChanged(static_cast<int>(current_audio_buffer.startTime() / 1000));
-    }
-
-    qint64 size_to_write = qMin(temp_buffer->size() - temp_buffer->pos(), static_cast<qint64>(bytes_needed));
-    qint64 actually_written = output_buffer->write(temp_buffer->read(size_to_write));
-    bytes_needed -= static_cast<int>(actually_written);
-    if (actually_written < size_to_write) { // Should not happen, but does happen on Windows 10!
-      temp_buffer->seek(temp_buffer->pos() - size_to_write + actually_written);
-      return;
-    }
-  }
+// Returns options' flag that can be passed to the stretcher
+RubberBand::RubberBandStretcher::Options AudioPlayer::generateStretcherOptionsFlag() const
+{
+  return stretcher_settings.generateOptionsFlag();
 }
 
 
-// End audio file decoding
-void AudioPlayer::finishDecoding()
+// Leave loading state and start playing decoded audio
+void AudioPlayer::playDecodedAudio()
 {
-  if (status != AudioPlayer::Loading) [[unlikely]]
-    return;
-  
-  decoded_samples->squeeze();
-  nb_audio_buffers = decoded_samples->size();
-  nb_channels = static_cast<unsigned int>(target_format.channelCount());
-
-  emit loadingProgressChanged(100);
-  disconnect(audio_decoder, nullptr, nullptr, nullptr);
-  audio_decoder->deleteLater();
   status = AudioPlayer::Stopped;
   emit readingPositionChanged(0);
   startPlaying();
 }
 
 
-// Reads the first decoded buffer and sets audio format accordingly for further decoding
-void AudioPlayer::firstDecodedBufferReady()
+// Stop loading and dispose of the loader
+void AudioPlayer::releaseLoader()
 {
-  const QAudioFormat file_format = audio_decoder->read().format();
-  qDebug() << "File format:" << file_format;
-  const QUrl file_url = audio_decoder->source();
-  audio_decoder->stop();
-  disconnect(audio_decoder, nullptr, nullptr, nullptr);
-  audio_decoder->deleteLater();
+  audio_loader->cancel();
+  audio_loader->deleteLater();
+  audio_loader = nullptr;
+}
 
-  QAudioFormat::SampleFormat sample_format = float_output ? QAudioFormat::Float : QAudioFormat::Int16;
-  target_format.setChannelCount(qBound(min_channel_count, file_format.channelCount(), max_channel_count));
-  target_format.setSampleRate(qBound(min_sample_rate, file_format.sampleRate(), max_sample_rate));
-  target_format.setSampleFormat(sample_format);
-  if (!audio_device.isFormatSupported(target_format)) {
-    target_format = audio_device.preferredFormat();
-    target_format.setSampleFormat(sample_format);
-    qDebug() << "Format not supported, falling back on default format";
-  }
-  qDebug() << "Output format:" << target_format;
 
-  decoded_samples = std::make_unique<QList<QAudioBuffer>>();
+// Stop the audio output and dispose of the renderer
+void AudioPlayer::releaseRenderer()
+{
+  disconnect(renderer, nullptr, this, nullptr);
+  QMetaObject::invokeMethod(renderer, &AudioRenderer::stopOutput, Qt::BlockingQueuedConnection);
+  renderer->deleteLater();
+  renderer = nullptr;
+}
 
-  audio_decoder = new QAudioDecoder(this);
-  audio_decoder->setSource(file_url);
 
-  QAudioFormat decode_format(target_format);
-  decode_format.setSampleFormat(QAudioFormat::Float);
-  audio_decoder->setAudioFormat(decode_format);
-  
-  connect(audio_decoder, &QAudioDecoder::bufferReady, this, &AudioPlayer::readDecoderBuffer);
-  connect(audio_decoder, &QAudioDecoder::durationChanged, [this](qint64 duration){ if (duration > 0) emit durationChanged(static_cast<int>(duration)); });
-  connect(audio_decoder, &QAudioDecoder::finished, this, &AudioPlayer::finishDecoding);
-  connect(audio_decoder, qOverload<QAudioDecoder::Error>(&QAudioDecoder::error), this, &AudioPlayer::abortDecoding);
+// Sets the output format for given file format and returns the format decoded samples are converted to: the file's sample rate (within Rubber Band's range) and the output channel count
+QAudioFormat AudioPlayer::selectDecodingFormat(const QAudioFormat &file_format)
+{
+  updateTargetFormat(file_format);
 
-  audio_decoder->start();
+  // The stretcher absorbs any difference between the decoded and output sample rates: the decoder only resamples files Rubber Band cannot process
+  QAudioFormat decoding_format(file_format);
+  decoding_format.setChannelCount(target_format.channelCount());
+  decoding_format.setSampleRate(qBound(RUBBERBAND_MIN_SAMPLERATE, file_format.sampleRate(), RUBBERBAND_MAX_SAMPLERATE));
+  return decoding_format;
 }
 
 
-// Returns options' flag that can be passed to the stretcher
-RubberBand::RubberBandStretcher::Options AudioPlayer::generateStretcherOptionsFlag() const
+// Forward the end of the decoded region and start playing once enough audio is available
+void AudioPlayer::updateDecodedPosition(int position)
 {
-  RubberBand::RubberBandStretcher::Options options = static_cast<RubberBand::RubberBandStretcher::Option>(RubberBand::RubberBandStretcher::DefaultOptions) | RubberBand::RubberBandStretcher::OptionProcessRealTime | RubberBand::RubberBandStretcher::OptionThreadingNever;
-  if (option_use_r3_engine)
-    options |= RubberBand::RubberBandStretcher::OptionEngineFiner;
-  if (option_formant_preserved)
-    options |= RubberBand::RubberBandStretcher::OptionFormantPreserved;
-  if (option_high_quality)
-    options |= RubberBand::RubberBandStretcher::OptionPitchHighQuality;
-  if (option_channels_together)
-    options |= RubberBand::RubberBandStretcher::OptionChannelsTogether;
-  return options;
+  emit decodedPositionChanged(position);
+  if ((status == AudioPlayer::Loading) && (static_cast<qint64>(position) * 1000 >= PLAYBACK_START_THRESHOLD))
+    playDecodedAudio();
 }
 
 
-// Handle changes of audio output's state
-void AudioPlayer::manageAudioOutputState(QAudio::State state)
+// Forward stretcher options to the renderer, which applies them live
+void AudioPlayer::updateRendererOptions()
 {
-  if ((state == QAudio::IdleState) && no_more_data)
-    stopPlaying();
+  if (status == AudioPlayer::Paused || status == AudioPlayer::Playing)
+    QMetaObject::invokeMethod(renderer, &AudioRenderer::updateStretcherOptions, Qt::QueuedConnection, generateStretcherOptionsFlag(), stretcher_settings.parallel_channels);
 }
 
 
-// Read buffer from the decoder
-void AudioPlayer::readDecoderBuffer()
+// Forward the renderer's reading position (positions reported before playing was paused are dropped)
+void AudioPlayer::updateRenderingPosition(int position)
 {
-  if (decoded_samples.get()) [[likely]] {
-    decoded_samples->append(audio_decoder->read());
-    emit loadingProgressChanged(static_cast<int>((100 * audio_decoder->position()) / audio_decoder->duration()));
+  if (status == AudioPlayer::Playing) [[likely]]
+    emit readingPositionChanged(position);
+}
+
+
+// Gathers and reports performance counters
+void AudioPlayer::updateStatistics()
+{
+  PlaybackStatistics statistics;
+  if ((status == AudioPlayer::Paused) || (status == AudioPlayer::Playing))
+    statistics = renderer->takeStatistics();
+  if (decoded_samples)
+    statistics.decoded_memory = decoded_samples->memoryUsage();
+  emit statisticsChanged(statistics);
+}
+
+
+// Sets the output format that best suits given file format and the audio device
+void AudioPlayer::updateTargetFormat(const QAudioFormat &file_format)
+{
+  target_format.setChannelCount(qBound(min_channel_count, file_format.channelCount(), max_channel_count));
+  target_format.setSampleRate(qBound(min_sample_rate, file_format.sampleRate(), max_sample_rate));
+  target_format.setSampleFormat(output_sample_format);
+  if (!audio_device.isFormatSupported(target_format)) {
+    target_format = audio_device.preferredFormat();
+    target_format.setSampleFormat(output_sample_format);
+    qDebug() << "Format not supported, falling back on default format";
   }
+  qDebug() << "Output format:" << target_format;
 }
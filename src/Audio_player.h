@@ -10,17 +10,20 @@
 
 #include <rubberband/RubberBandStretcher.h>
 #include <memory>
-#include <QAudioBuffer>
 #include <QAudioDecoder>
 #include <QAudioDevice>
 #include <QAudioFormat>
-#include <QAudioSink>
-#include <QBuffer>
-#include <QChronoTimer>
-#include <QIODevice>
-#include <QList>
 #include <QObject>
 #include <QString>
+#include <QThread>
+#include <QTimer>
+
+#include "Audio_exporter.h"
+#include "Audio_loader.h"
+#include "Audio_renderer.h"
+#include "Playback_statistics.h"
+#include "Sample_store.h"
+#include "Stretcher_settings.h"
 
 
 class AudioPlayer : public QObject
@@ -40,72 +43,90 @@ public:
 private:
   AudioPlayer::Status status;
   qreal output_volume;
-  double time_ratio;
-  double pitch_scale;
-  bool option_use_r3_engine;
-  bool option_formant_preserved;
-  bool option_high_quality;
-  bool option_channels_together;
+  StretcherSettings stretcher_settings;
+  bool decode_cache_enabled;
+  int render_ahead;
+  int latency;
+  bool noise_shaping;
+  SampleStore::StorageFormat storage_format;
   QAudioFormat target_format;
   QAudioDevice audio_device;
   int min_channel_count;
   int max_channel_count;
   int min_sample_rate;
   int max_sample_rate;
-  bool float_output;
-  QAudioDecoder *audio_decoder;
-  std::unique_ptr<QList<QAudioBuffer>> decoded_samples;
-  qsizetype nb_audio_buffers;
-  unsigned int nb_channels;
-  QAudioSink *audio_output;
-  QIODevice *output_buffer;
-  QBuffer *temp_buffer;
-  qsizetype reading_index;
-  bool no_more_data;
-  std::unique_ptr<RubberBand::RubberBandStretcher> stretcher;
-  QChronoTimer *timer;
+  QAudioFormat::SampleFormat output_sample_format; // Float if the audio device supports it, else 32-bit or 16-bit integers
+  int loop_start; // A–B loop, in milliseconds (no loop if loop_end is not after loop_start)
+  int loop_end;
+  AudioLoader *audio_loader;
+  std::shared_ptr<SampleStore> decoded_samples;
+  QThread *render_thread;
+  AudioRenderer *renderer;
+  QTimer *statistics_timer;
+  AudioExporter *exporter;
+  QThread *export_thread;
   
 public:
   AudioPlayer(QObject *parent = nullptr); // Constructor
   ~AudioPlayer(); // Destructor
   void cancelDecoding(); // Cancel current file decoding
+  void cancelExport(); // Cancel current export
   void decodeFile(const QString &filename); // Decode an audio file
+  void exportFile(const QString &filename); // Render the whole decoded file with current settings to a WAV or FLAC file, faster than real time
   AudioPlayer::Status getStatus() const; // Get current status
+  bool isDecoding() const; // Returns true while the file is still being decoded (playing may already have started)
+  bool isExporting() const; // Returns true while a file is being exported
   void moveReadingPosition(int position); // Move reading position. Parameter: position in milliseconds
   void pausePlaying(); // Pause audio playing
   void resumePlaying(); // Resume audio playing
+  void setDecodeCacheEnabled(bool enabled); // Enable or disable the on-disk cache of decoded files
+  void setReducedMemoryUsage(bool enabled); // Keep decoded samples as 16-bit integers (instead of float) for files loaded from now on
+  void setNoiseShapingEnabled(bool enabled); // Shape the dither of 16-bit output, so that quantization noise is less audible (only used if the audio device supports neither float nor 32-bit samples)
+  void setLoop(int start, int end); // Loops playback between given positions in milliseconds, without stretching the loop again on each pass (no loop if end is not after start)
+  void setLatency(int duration); // Sets the duration of the audio sink's buffer in milliseconds, which also sizes rendered blocks (applies from the next playing start)
+  void setRenderAhead(int duration); // Sets the maximum duration of stretched audio rendered ahead of playback, in milliseconds (applies from the next playing start)
+  void setStatisticsEnabled(bool enabled); // Enable or disable the periodic report of performance counters
   void startPlaying(); // Start audio playing
   void stopPlaying(); // Stop audio playing
   void updateOptionUseR3Engine(bool option); // Sets pitch shifting engine
   void updateOptionFormantPreserved(bool option); // Change "formant preserved" option
   void updateOptionHighQuality(bool option); // Change "high quality" option
   void updateOptionChannelsTogether(bool option); // Change "process channels together" option
+  void updateOptionParallelChannels(bool option); // Change "process channels in parallel" option
   void updatePitch(int pitch); // Update pitch
   void updateSpeed(double speed_ratio); // Update speed
   void updateVolume(qreal volume); // Update output volume
 
 private:
-  template<typename OUTPUT_FORMAT>
-  inline OUTPUT_FORMAT convertFloatSampleToOutputFormat(float sample); // Converts a float sample to output format (qint16 or float)
-
-  template<typename OUTPUT_FORMAT>
-  void moveStretcherOutputToTempBuffer(); // Retrieves the stretcher output and puts it into temp_buffer
-
   void abortDecoding(QAudioDecoder::Error error); // Abort audio file decoding
-  void fillAudioBuffer(); // Fill output audio buffer
+  void abortPlaying(QAudio::Error error); // Stop playing after an audio output error
   void finishDecoding(); // End audio file decoding
-  void firstDecodedBufferReady(); // Reads the first decoded buffer and sets audio format accordingly for further decoding
+  void finishExport(bool success); // Dispose of the exporter once the export has ended
+  void finishPlaying(); // Stop playing once the renderer has played all decoded audio
   RubberBand::RubberBandStretcher::Options generateStretcherOptionsFlag() const; // Returns options' flag that can be passed to the stretcher
-  void manageAudioOutputState(QAudio::State state); // Handle changes of audio output's state
-  void readDecoderBuffer(); // Read buffer from the decoder
+  void playDecodedAudio(); // Leave loading state and start playing decoded audio
+  void releaseLoader(); // Stop loading and dispose of the loader
+  void releaseRenderer(); // Stop the audio output and dispose of the renderer
+  QAudioFormat selectDecodingFormat(const QAudioFormat &file_format); // Sets the output format for given file format and returns the format decoded samples are converted to: the file's sample rate (within Rubber Band's range) and the output channel count
+  void updateDecodedPosition(int position); // Forward the end of the decoded region and start playing once enough audio is available
+  void updateRendererOptions(); // Forward stretcher options to the renderer, which applies them live
+  void updateRenderingPosition(int position); // Forward the renderer's reading position (positions reported before playing was paused are dropped)
+  void updateStatistics(); // Gathers and reports performance counters
+  void updateTargetFormat(const QAudioFormat &file_format); // Sets the output format that best suits given file format and the audio device
   
 signals:
   void audioDecodingError(QAudioDecoder::Error); // This signal is emitted if an error occurs while trying to decode audio file
   void audioOutputError(QAudio::Error); // This signal is emitted if an error occurs while trying to access audio device
+  void decodedPositionChanged(int); // This signal is emitted each time more audio has been decoded. Parameter: end of the decoded region in milliseconds (-1 if no valid audio file loaded)
   void durationChanged(int); // This signal is emitted each time the total duration of the file changes. Parameter: duration in milliseconds (-1 if no valid audio file loaded)
+  void exportFinished(QString); // This signal is emitted when an export ends. Parameter: error message (empty if the file has been written successfully)
+  void exportProgressChanged(int); // This signal is emitted to indicate the current export progress. Parameter: progress between 0 and 100
+  void latencyChanged(int); // This signal is emitted when the end-to-end output latency is known or changes while playing. Parameter: latency in milliseconds
   void loadingProgressChanged(int); // This signal is emitted to indicate the current loading progress. Parameter: progress between 0 and 100
   void readingPositionChanged(int); // This signal is emitted each time the reading position changes. Parameter: position in milliseconds (-1 if no valid audio file loaded)
+  void statisticsChanged(PlaybackStatistics); // This signal is emitted periodically while statistics are enabled. Parameter: performance counters (only decoded memory is set while not playing)
   void statusChanged(AudioPlayer::Status); // This signal is emitted each time the status changes.
+  void waveformChanged(std::shared_ptr<const WaveformOverview>); // This signal is emitted when a file starts being decoded. Parameter: waveform overview, filled as decoding progresses (nullptr if no valid audio file loaded)
 };
 
 #endif
@@ -0,0 +1,150 @@
+// Copyright 2026 François CROLLET
+
+// This file is part of VPS Player.
+// VPS Player is free software; you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation; either version 3 of the License, or (at your option) any later version.
+// VPS Player is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License along with VPS Player. If not, see <http://www.gnu.org/licenses/>.
+
+
+#include <QThread>
+
+#include "Audio_prerenderer.h"
+#include "Parallel_stretcher.h"
+
+#define PRERENDER_BLOCK_SIZE 16384 // Decoded audio is processed, and stretched audio is retrieved, in slices of at most PRERENDER_BLOCK_SIZE frames
+
+
+// Constructor. The sample store must be complete. time_ratio, pitch_scale: given to the stretcher as is (including the sample rate conversion), start_frame: decoded frame matching the first rendered frame, max_frames: maximum number of rendered frames
+AudioPrerenderer::AudioPrerenderer(std::shared_ptr<const SampleStore> samples, int output_sample_rate, RubberBand::RubberBandStretcher::Options options, double time_ratio, double pitch_scale, bool parallel_channels, qint64 start_frame, qint64 max_frames) :
+  decoded_samples(std::move(samples)),
+  stretcher_options(options),
+  time_ratio(time_ratio),
+  pitch_scale(pitch_scale),
+  parallel_channels(parallel_channels),
+  start_frame(start_frame),
+  max_frames(max_frames),
+  rendered_samples(decoded_samples->channelCount(), output_sample_rate, decoded_samples->getStorageFormat()), // Stretched audio is kept like decoded audio, in 16 bits when memory usage is reduced
+  cancelled(false),
+  file_end_reached(false)
+{
+
+}
+
+
+// Destructor
+AudioPrerenderer::~AudioPrerenderer()
+{
+
+}
+
+
+// Ask the rendering to stop as soon as possible (may be called from any thread)
+void AudioPrerenderer::cancel()
+{
+  cancelled.store(true, std::memory_order_relaxed);
+}
+
+
+// Returns true once the rendering has stopped (may be called from any thread)
+bool AudioPrerenderer::isComplete() const
+{
+  return rendered_samples.isComplete();
+}
+
+
+// Points channel_data to contiguous planar rendered samples starting at given frame, like SampleStore::readFrames() (may be called from any thread). Returns the number of frames readable from these pointers
+qint64 AudioPrerenderer::readFrames(qint64 frame, qint64 max_frames, const float **channel_data, float *const *conversion_buffer) const
+{
+  return rendered_samples.readFrames(frame, max_frames, channel_data, conversion_buffer);
+}
+
+
+// Returns true if the rendered audio goes on up to the end of the file (may be called from any thread, meaningful once complete)
+bool AudioPrerenderer::reachedFileEnd() const
+{
+  return file_end_reached.load(std::memory_order_acquire);
+}
+
+
+// Renders the stretched audio (blocking, meant to run in a thread of the global pool, whose priority is lowered meanwhile)
+void AudioPrerenderer::render()
+{
+  QThread *thread = QThread::currentThread();
+  const QThread::Priority pool_priority = thread->priority();
+  thread->setPriority(QThread::IdlePriority); // Playback, decoding and the rest of the system come first
+
+  const unsigned int nb_channels = decoded_samples->channelCount();
+  const qint64 nb_decoded_frames = decoded_samples->frameCount();
+  ParallelStretcher stretcher(static_cast<size_t>(decoded_samples->sampleRate()), nb_channels, stretcher_options, time_ratio, pitch_scale, parallel_channels, QThread::IdlePriority);
+  stretcher.setMaxProcessSize(PRERENDER_BLOCK_SIZE);
+
+  auto stretcher_input = std::make_unique<const float*[]>(nb_channels);
+  auto input_samples = std::make_unique<float[]>(nb_channels * PRERENDER_BLOCK_SIZE);
+  auto input_conversion_buffer = std::make_unique<float*[]>(nb_channels);
+  auto output_samples = std::make_unique<float[]>(nb_channels * PRERENDER_BLOCK_SIZE);
+  auto stretcher_output = std::make_unique<float*[]>(nb_channels);
+  auto silent_samples = std::make_unique<float[]>(PRERENDER_BLOCK_SIZE);
+  auto silent_input = std::make_unique<const float*[]>(nb_channels);
+  for (unsigned int i = 0; i < nb_channels; i++) {
+    input_conversion_buffer[i] = input_samples.get() + (i * PRERENDER_BLOCK_SIZE);
+    stretcher_output[i] = output_samples.get() + (i * PRERENDER_BLOCK_SIZE);
+    silent_input[i] = silent_samples.get();
+  }
+
+  // The stretcher is primed like for live playing, so that the rendered audio can be swapped with the live one
+  qint64 reading_frame = start_frame - static_cast<qint64>(stretcher.getPreferredStartPad());
+  while (reading_frame < 0) {
+    const size_t nb_frames = static_cast<size_t>(qMin(-reading_frame, static_cast<qint64>(PRERENDER_BLOCK_SIZE)));
+    stretcher.process(silent_input.get(), nb_frames, false);
+    reading_frame += static_cast<qint64>(nb_frames);
+  }
+  while (reading_frame < start_frame) {
+    const qint64 nb_frames = decoded_samples->readFrames(reading_frame, qMin(start_frame - reading_frame, static_cast<qint64>(PRERENDER_BLOCK_SIZE)), stretcher_input.get(), input_conversion_buffer.get());
+    stretcher.process(stretcher_input.get(), static_cast<size_t>(nb_frames), false);
+    reading_frame += nb_frames;
+  }
+
+  qint64 nb_frames_to_discard = static_cast<qint64>(stretcher.getStartDelay());
+  qint64 nb_rendered_frames = 0;
+  bool final_processed = false;
+  while (!cancelled.load(std::memory_order_relaxed) && (nb_rendered_frames < max_frames)) {
+    const int nb_available_frames = stretcher.available();
+    if (nb_available_frames > 0) {
+      const qint64 nb_wanted_frames = (nb_frames_to_discard > 0) ? nb_frames_to_discard : (max_frames - nb_rendered_frames);
+      const qint64 nb_retrieved_frames = static_cast<qint64>(stretcher.retrieve(stretcher_output.get(), static_cast<size_t>(qMin(qMin(static_cast<qint64>(nb_available_frames), static_cast<qint64>(PRERENDER_BLOCK_SIZE)), nb_wanted_frames))));
+      if (nb_frames_to_discard > 0)
+	nb_frames_to_discard -= nb_retrieved_frames;
+      else {
+	rendered_samples.append(stretcher_output.get(), nb_retrieved_frames);
+	nb_rendered_frames += nb_retrieved_frames;
+      }
+    }
+    else if (final_processed) { // The stretcher has been flushed
+      file_end_reached.store(true, std::memory_order_release);
+      break;
+    }
+    else {
+      const qint64 nb_frames = decoded_samples->readFrames(reading_frame, PRERENDER_BLOCK_SIZE, stretcher_input.get(), input_conversion_buffer.get());
+      reading_frame += nb_frames;
+      final_processed = (reading_frame >= nb_decoded_frames);
+      stretcher.process(stretcher_input.get(), static_cast<size_t>(nb_frames), final_processed);
+    }
+  }
+  rendered_samples.setComplete();
+
+  thread->setPriority((pool_priority == QThread::InheritPriority) ? QThread::NormalPriority : pool_priority); // Pool threads are started with the priority of the thread starting them, which cannot be restored as such
+}
+
+
+// Returns the number of frames rendered so far (may be called from any thread)
+qint64 AudioPrerenderer::renderedFrames() const
+{
+  return rendered_samples.frameCount();
+}
+
+
+// Returns the decoded frame matching the first rendered frame
+qint64 AudioPrerenderer::startFrame() const
+{
+  return start_frame;
+}
@@ -0,0 +1,46 @@
+// Copyright 2026 François CROLLET
+
+// This file is part of VPS Player.
+// VPS Player is free software; you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation; either version 3 of the License, or (at your option) any later version.
+// VPS Player is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License along with VPS Player. If not, see <http://www.gnu.org/licenses/>.
+
+
+#ifndef AUDIO_PRERENDERER_H
+#define AUDIO_PRERENDERER_H
+
+#include <rubberband/RubberBandStretcher.h>
+#include <atomic>
+#include <memory>
+
+#include "Sample_store.h"
+
+
+// Renders the rest of a decoded file with fixed stretcher settings, at idle priority, so that playback can stream the stretched audio instead of stretching it live
+class AudioPrerenderer
+{
+private:
+  std::shared_ptr<const SampleStore> decoded_samples;
+  RubberBand::RubberBandStretcher::Options stretcher_options;
+  double time_ratio; // In output frames per decoded frame
+  double pitch_scale;
+  bool parallel_channels;
+  qint64 start_frame;
+  qint64 max_frames;
+  SampleStore rendered_samples;
+  std::atomic<bool> cancelled;
+  std::atomic<bool> file_end_reached;
+
+public:
+  AudioPrerenderer(std::shared_ptr<const SampleStore> samples, int output_sample_rate, RubberBand::RubberBandStretcher::Options options, double time_ratio, double pitch_scale, bool parallel_channels, qint64 start_frame, qint64 max_frames); // Constructor. The sample store must be complete. time_ratio, pitch_scale: given to the stretcher as is (including the sample rate conversion), start_frame: decoded frame matching the first rendered frame, max_frames: maximum number of rendered frames
+  ~AudioPrerenderer(); // Destructor
+  void cancel(); // Ask the rendering to stop as soon as possible (may be called from any thread)
+  bool isComplete() const; // Returns true once the rendering has stopped (may be called from any thread)
+  qint64 readFrames(qint64 frame, qint64 max_frames, const float **channel_data, float *const *conversion_buffer) const; // Points channel_data to contiguous planar rendered samples starting at given frame, like SampleStore::readFrames() (may be called from any thread). Returns the number of frames readable from these pointers
+  bool reachedFileEnd() const; // Returns true if the rendered audio goes on up to the end of the file (may be called from any thread, meaningful once complete)
+  void render(); // Renders the stretched audio (blocking, meant to run in a thread of the global pool, whose priority is lowered meanwhile)
+  qint64 renderedFrames() const; // Returns the number of frames rendered so far (may be called from any thread)
+  qint64 startFrame() const; // Returns the decoded frame matching the first rendered frame
+};
+
+#endif
@@ -0,0 +1,1081 @@
+// Copyright 2026 François CROLLET
+
+// This file is part of VPS Player.
+// VPS Player is free software; you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation; either version 3 of the License, or (at your option) any later version.
+// VPS Player is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License along with VPS Player. If not, see <http://www.gnu.org/licenses/>.
+
+#include <cstring>
+#include <QDeadlineTimer>
+#include <QElapsedTimer>
+#include <QMutexLocker>
+#include <QThreadPool>
+#include <QtMath>
+#include <QtDebug>
+
+#include "Audio_renderer.h"
+#include "Sample_conversion.h"
+
+#define MIN_BLOCK_FRAMES 256 // Stretched audio is queued in blocks of at least this many frames...
+#define MAX_BLOCK_FRAMES 1024 // ... and at most this many frames
+#define BLOCKS_PER_SINK_BUFFER 4 // Blocks are sized so that the sink's buffer holds about this many of them
+#define BLOCKS_PER_PROCESS 4 // Decoded audio is fed to the stretcher in slices of at most this many blocks
+#define RENDER_AHEAD_MIN 500 // Audio rendered ahead of playback while processing is cheap (ms)
+#define RENDER_AHEAD_POLL_INTERVAL 10 // Delay between two attempts to render audio while playing has caught up with decoding (ms)
+#define PREFILL_TIMEOUT 1000 // Maximum time spent waiting for the queue to fill before starting the sink (ms)
+#define PROCESSING_COST_DECAY 0.995 // Decay of the peak processing cost for each processed slice
+#define PROCESSING_COST_FULL_DEPTH 0.5 // Processing cost from which the queue is filled up to its maximum depth
+#define POSITION_UPDATE_INTERVAL 33 // Interval between two reports of the reading position, about 30 per second (ms)
+#define LOOP_CACHE_MAX_DURATION 300 // Longest stretched pass of an A–B loop that is cached, to bound memory usage (s)
+#define PRERENDER_DELAY 5000 // Settings left unchanged for this long start the prerendering of the rest of the file (ms)
+#define PRERENDER_MAX_DURATION 600 // Longest stretched audio prerendered at once, to bound memory usage (s)
+#define PRERENDER_MIN_LEAD 2000 // Playback switches to the prerendered audio once it is at least this far ahead (ms)
+
+
+// Constructor
+AudioRenderer::AudioRenderer(std::shared_ptr<const SampleStore> samples, const QAudioFormat &format, RubberBand::RubberBandStretcher::Options options, double time_ratio, double pitch_scale, bool parallel_channels, int render_ahead, int latency, bool noise_shaping) : QIODevice(),
+  decoded_samples(std::move(samples)),
+  output_format(format),
+  nb_channels(static_cast<unsigned int>(format.channelCount())),
+  rate_ratio(static_cast<double>(format.sampleRate()) / static_cast<double>(decoded_samples->sampleRate())),
+  sink_buffer_duration(static_cast<qint64>(latency) * 1000),
+  block_frames(qBound(static_cast<qint64>(MIN_BLOCK_FRAMES), static_cast<qint64>(qNextPowerOfTwo(static_cast<quint64>(format.framesForDuration(sink_buffer_duration) / BLOCKS_PER_SINK_BUFFER)) / 2), static_cast<qint64>(MAX_BLOCK_FRAMES))),
+  max_process_size(block_frames * BLOCKS_PER_PROCESS),
+  stretcher_input(std::make_unique<const float*[]>(nb_channels)),
+  input_samples(std::make_unique<float[]>(nb_channels * max_process_size)),
+  input_conversion_buffer(std::make_unique<float*[]>(nb_channels)),
+  output_samples(std::make_unique<float[]>(nb_channels * max_process_size)),
+  stretcher_output(std::make_unique<float*[]>(nb_channels)),
+  block_output(std::make_unique<float*[]>(nb_channels)),
+  silent_samples(std::make_unique<float[]>(max_process_size)),
+  silent_input(std::make_unique<const float*[]>(nb_channels)),
+  crossfade_samples(std::make_unique<float[]>(nb_channels * block_frames)),
+  reading_frame(0),
+  nb_frames_to_discard(0),
+  no_more_data(false),
+  final_processed(false),
+  time_ratio(time_ratio),
+  pitch_scale(pitch_scale),
+  stretcher_options(options),
+  parallel_channels(parallel_channels),
+  segment_source_frame(0),
+  segment_output_frames(0),
+  crossfade_length(0),
+  crossfade_position(0),
+  loop_start_frame(0),
+  loop_end_frame(0),
+  loop_cache(),
+  playing_loop_cache(false),
+  playing_prerendered_audio(false),
+  prerendered_input(std::make_unique<const float*[]>(nb_channels)),
+  render_generation(0),
+  peak_processing_cost(0.0),
+  render_ahead_thread(nullptr),
+  queue_read_index(0),
+  queue_write_index(0),
+  block_read_offset(0),
+  nb_queued_frames(0),
+  playback_generation(0),
+  end_of_stream(false),
+  stopping(false),
+  settings_changed(false),
+  pending_time_ratio(time_ratio),
+  pending_pitch_scale(pitch_scale),
+  pending_options(options),
+  pending_parallel_channels(parallel_channels),
+  pending_loop_start_frame(0),
+  pending_loop_end_frame(0),
+  pending_seek_frame(-1),
+  nb_underruns(0),
+  processing_time(0),
+  peak_processing_time(0),
+  nb_processed_slices(0),
+  processed_duration(0.0),
+  max_sink_request(0),
+  output_buffer_duration(sink_buffer_duration),
+  stretcher_delay(0),
+  output_latency(0),
+  queued_input(std::make_unique<const float*[]>(nb_channels)),
+  noise_shaping(noise_shaping),
+  dither_position(0),
+  shaping_errors(std::make_unique<float[]>(2 * nb_channels)),
+  output_suspended(false),
+  first_played_segment(0),
+  nb_played_segments(0),
+  sink_frames(0),
+  handed_frame(0),
+  reported_position(-1),
+  position_timer(nullptr),
+  audio_output(nullptr)
+{
+  stretcher = createStretcher(options, time_ratio, pitch_scale, parallel_channels);
+  stretcher_delay = static_cast<qint64>(stretcher->getStartDelay()) * 1000000 / output_format.sampleRate();
+
+  for (unsigned int i = 0; i < nb_channels; i++) {
+    input_conversion_buffer[i] = input_samples.get() + (i * max_process_size);
+    stretcher_output[i] = output_samples.get() + (i * max_process_size);
+    silent_input[i] = silent_samples.get();
+  }
+
+  // The queue can hold the maximum render-ahead depth, plus the blocks being played and rendered
+  max_queued_frames = qMax(static_cast<qint64>(output_format.framesForDuration(static_cast<qint64>(render_ahead) * 1000)), block_frames);
+  min_queued_frames = qMin(static_cast<qint64>(output_format.framesForDuration(RENDER_AHEAD_MIN * 1000)), max_queued_frames);
+  target_queued_frames = min_queued_frames;
+  // Settings changes are heard after about two sink buffers: one kept in the queue, one in the sink
+  nb_kept_blocks = (static_cast<qint64>(output_format.framesForDuration(sink_buffer_duration)) + block_frames - 1) / block_frames;
+  nb_queue_blocks = ((max_queued_frames + block_frames - 1) / block_frames) + 2;
+  queue_samples = std::make_unique<float[]>(static_cast<size_t>(nb_queue_blocks) * nb_channels * block_frames);
+  queue_blocks = std::make_unique<QueuedBlock[]>(static_cast<size_t>(nb_queue_blocks));
+  // Each block handed to the sink starts at most one segment, and silence another
+  max_played_segments = 2 * nb_queue_blocks;
+  played_segments = std::make_unique<PlayedSegment[]>(static_cast<size_t>(max_played_segments));
+}
+
+
+// Destructor
+AudioRenderer::~AudioRenderer()
+{
+  stopRenderAhead();
+}
+
+
+// Reimplementation of QIODevice's isSequential()
+bool AudioRenderer::isSequential() const
+{
+  return true;
+}
+
+
+// Move reading position. Parameter: position in milliseconds
+void AudioRenderer::moveReadingPosition(int position)
+{
+  const qint64 frame = qMin(decoded_samples->frameForPosition(static_cast<qint64>(position) * 1000), decoded_samples->frameCount());
+  {
+    QMutexLocker locker(&queue_mutex);
+    playback_generation++; // The block being rendered, if any, is dropped as well
+    queue_read_index = queue_write_index;
+    block_read_offset = 0;
+    nb_queued_frames = 0;
+    end_of_stream = false;
+    pending_seek_frame = frame;
+    render_condition.wakeOne();
+  }
+  handed_frame = frame;
+  nb_played_segments = 0;
+  sink_frames = 0;
+
+  if (audio_output) { // Drop the audio already queued in the sink, so that the requested frame is the next one heard
+    audio_output->stop();
+    waitForQueuedAudio();
+    audio_output->start(this);
+  {
+    QMutexLocker locker(&queue_mutex);
+    output_buffer_duration = output_format.durationForBytes(static_cast<qint32>(audio_output->bufferSize())); // The requested size is only a hint, that backends may round up
+    updateLatency();
+  }
+    if (output_suspended)
+      audio_output->suspend();
+  }
+}
+
+
+// Suspend the audio output
+void AudioRenderer::pauseOutput()
+{
+  output_suspended = true;
+  if (audio_output) [[likely]] {
+    audio_output->suspend();
+    position_timer->stop();
+  }
+}
+
+
+// Resume the audio output
+void AudioRenderer::resumeOutput()
+{
+  output_suspended = false;
+  if (audio_output) [[likely]] {
+    audio_output->resume();
+    position_timer->start();
+  }
+}
+
+
+// Create the audio output and start pulling audio from this device
+void AudioRenderer::startOutput(const QAudioDevice &device, qreal volume)
+{
+  render_ahead_thread = QThread::create(&AudioRenderer::renderAhead, this);
+  render_ahead_thread->setObjectName(QStringLiteral("Audio render-ahead"));
+  render_ahead_thread->start(QThread::HighPriority);
+
+  audio_output = new QAudioSink(device, output_format, this);
+  audio_output->setBufferSize(static_cast<qsizetype>(output_format.bytesForDuration(sink_buffer_duration)));
+  audio_output->setVolume(volume);
+  connect(audio_output, &QAudioSink::stateChanged, this, &AudioRenderer::manageAudioOutputState);
+  open(QIODevice::ReadOnly);
+  waitForQueuedAudio();
+  audio_output->start(this);
+
+  position_timer = new QTimer(this);
+  position_timer->setInterval(POSITION_UPDATE_INTERVAL);
+  connect(position_timer, &QTimer::timeout, this, &AudioRenderer::reportReadingPosition);
+  position_timer->start();
+
+  QAudio::Error error_status = audio_output->error();
+  if ((error_status != QAudio::NoError) && (error_status != QAudio::UnderrunError)) {
+    qDebug() << "Error while opening audio device:" << error_status;
+    emit audioOutputError(error_status);
+  }
+}
+
+
+// Stop and release the audio output
+void AudioRenderer::stopOutput()
+{
+  if (audio_output) {
+    delete position_timer;
+    position_timer = nullptr;
+    disconnect(audio_output, nullptr, nullptr, nullptr);
+    audio_output->stop();
+    delete audio_output;
+    audio_output = nullptr;
+  }
+  close();
+  stopRenderAhead();
+}
+
+
+// Returns the performance counters, those measured over an interval covering the time since the previous call (may be called from any thread)
+PlaybackStatistics AudioRenderer::takeStatistics()
+{
+  PlaybackStatistics statistics;
+  QMutexLocker locker(&queue_mutex);
+  const qint64 sink_buffer_size = output_format.bytesForDuration(output_buffer_duration);
+
+  statistics.nb_underruns = nb_underruns;
+  if (nb_processed_slices > 0) {
+    statistics.mean_processing_time = static_cast<double>(processing_time) / static_cast<double>(nb_processed_slices) / 1000.0;
+    statistics.peak_processing_time = static_cast<double>(peak_processing_time) / 1000.0;
+    statistics.realtime_factor = processed_duration / static_cast<double>(qMax(processing_time, static_cast<qint64>(1)));
+  }
+  statistics.queued_duration = static_cast<int>(nb_queued_frames * 1000 / output_format.sampleRate());
+  statistics.min_sink_fill_level = static_cast<int>(qMax(sink_buffer_size - max_sink_request, static_cast<qint64>(0)) * 100 / qMax(sink_buffer_size, static_cast<qint64>(1)));
+  statistics.latency = output_latency;
+
+  processing_time = 0;
+  peak_processing_time = 0;
+  nb_processed_slices = 0;
+  processed_duration = 0.0;
+  max_sink_request = 0;
+  return statistics;
+}
+
+
+// Loop playback between given positions in milliseconds (no loop if end is not after start). A new loop is entered at its start, unless the audio heard next is already in it
+void AudioRenderer::updateLoop(int start, int end)
+{
+  qint64 start_frame = decoded_samples->frameForPosition(static_cast<qint64>(start) * 1000);
+  qint64 end_frame = qMin(decoded_samples->frameForPosition(static_cast<qint64>(end) * 1000), decoded_samples->frameCount());
+  if (end_frame <= start_frame) {
+    start_frame = 0;
+    end_frame = 0;
+  }
+
+  QMutexLocker locker(&queue_mutex);
+  pending_loop_start_frame = start_frame;
+  pending_loop_end_frame = end_frame;
+  settings_changed = true;
+  render_condition.wakeOne();
+}
+
+
+// Enable or disable noise shaping of the dither of 16-bit output
+void AudioRenderer::updateNoiseShaping(bool enabled)
+{
+  noise_shaping = enabled;
+}
+
+
+// Update stretcher's options (the stretcher is replaced if anything else than formant preservation changes)
+void AudioRenderer::updateStretcherOptions(RubberBand::RubberBandStretcher::Options options, bool parallel_channels)
+{
+  QMutexLocker locker(&queue_mutex);
+  pending_options = options;
+  pending_parallel_channels = parallel_channels;
+  settings_changed = true;
+  render_condition.wakeOne();
+}
+
+
+// Update stretcher's pitch scale
+void AudioRenderer::updatePitchScale(double pitch_scale)
+{
+  QMutexLocker locker(&queue_mutex);
+  pending_pitch_scale = pitch_scale;
+  settings_changed = true;
+  render_condition.wakeOne();
+}
+
+
+// Update stretcher's time ratio
+void AudioRenderer::updateTimeRatio(double time_ratio)
+{
+  QMutexLocker locker(&queue_mutex);
+  pending_time_ratio = time_ratio;
+  settings_changed = true;
+  render_condition.wakeOne();
+}
+
+
+// Update output volume
+void AudioRenderer::updateVolume(qreal volume)
+{
+  if (audio_output)
+    audio_output->setVolume(volume);
+}
+
+
+// Reimplementation of QIODevice's readData(): called by the audio sink when it needs more audio
+qint64 AudioRenderer::readData(char *data, qint64 max_size)
+{
+  const qint64 frame_size = static_cast<qint64>(output_format.bytesPerFrame());
+  qint64 written = 0;
+  QMutexLocker locker(&queue_mutex);
+  max_sink_request = qMax(max_sink_request, max_size);
+
+  while (((max_size - written) >= frame_size) && (queue_read_index < queue_write_index)) {
+    const qint64 slot = queue_read_index % nb_queue_blocks;
+    const QueuedBlock &block = queue_blocks[slot];
+    qint64 nb_frames = block.nb_frames - block_read_offset;
+    if (block.generation == playback_generation) {
+      nb_frames = qMin(nb_frames, (max_size - written) / frame_size);
+      moveQueuedAudioToData(data + written, slot, nb_frames);
+      addPlayedSegment(block.source_frame + qRound64(static_cast<double>(block_read_offset) * block.source_step), block.source_step);
+      written += nb_frames * frame_size;
+      sink_frames += nb_frames;
+      nb_queued_frames -= nb_frames;
+      handed_frame = qMin(block.source_frame + qRound64(static_cast<double>(block_read_offset + nb_frames) * block.source_step), decoded_samples->frameCount()); // The stretcher's tail would map beyond the end of the file
+    }
+
+    block_read_offset += nb_frames;
+    if (block_read_offset >= block.nb_frames) {
+      queue_read_index++;
+      block_read_offset = 0;
+    }
+  }
+  render_condition.wakeOne();
+
+  if (!end_of_stream && ((max_size - written) >= frame_size)) { // Rendering has fallen behind (or playing has caught up with decoding): play silence until more audio is queued
+    qint64 silence_size = max_size - written;
+    silence_size -= silence_size % frame_size;
+    std::memset(data + written, 0, static_cast<size_t>(silence_size));
+    addPlayedSegment(handed_frame, 0.0);
+    written += silence_size;
+    sink_frames += silence_size / frame_size;
+    nb_underruns++;
+  }
+
+  return written;
+}
+
+
+// Reimplementation of QIODevice's writeData() (read-only device)
+qint64 AudioRenderer::writeData(const char *data, qint64 max_size)
+{
+  Q_UNUSED(data);
+  Q_UNUSED(max_size);
+  return -1;
+}
+
+
+// Records that the audio handed to the sink from now on maps to decoded frames from source_frame on, source_step apart
+void AudioRenderer::addPlayedSegment(qint64 source_frame, double source_step)
+{
+  if (nb_played_segments > 0) {
+    const PlayedSegment &last_segment = played_segments[(first_played_segment + nb_played_segments - 1) % max_played_segments];
+    const qint64 expected_frame = last_segment.source_frame + qRound64(static_cast<double>(sink_frames - last_segment.sink_frame) * last_segment.source_step);
+    if ((source_step == last_segment.source_step) && (qAbs(source_frame - expected_frame) <= 1)) // Rest of a block already partly handed to the sink, or more silence
+      return;
+  }
+
+  if (nb_played_segments == max_played_segments) { // Only happens with many tiny blocks: the oldest segment is given up
+    first_played_segment++;
+    nb_played_segments--;
+  }
+  played_segments[(first_played_segment + nb_played_segments) % max_played_segments] = PlayedSegment{sink_frames, source_frame, source_step};
+  nb_played_segments++;
+}
+
+
+// Applies pending stretcher settings, dropping the queued audio beyond the kept blocks so that they are heard shortly (render-ahead thread, queue_mutex held)
+void AudioRenderer::applySettings()
+{
+  settings_changed = false;
+  const double new_time_ratio = pending_time_ratio;
+  const double new_pitch_scale = pending_pitch_scale;
+  const RubberBand::RubberBandStretcher::Options new_options = pending_options;
+  const bool new_parallel_channels = pending_parallel_channels;
+  const qint64 new_loop_start_frame = pending_loop_start_frame;
+  const qint64 new_loop_end_frame = pending_loop_end_frame;
+  const bool loop_changed = (new_loop_start_frame != loop_start_frame) || (new_loop_end_frame != loop_end_frame);
+  const bool stretcher_replaced = requiresNewStretcher(new_options, new_parallel_channels);
+
+  // Engine, quality and channel options cannot change live: a new stretcher is built while the queued audio keeps playing, then it is primed and faded in like after any other change
+  std::unique_ptr<ParallelStretcher> new_stretcher;
+  if (stretcher_replaced) {
+    queue_mutex.unlock();
+    new_stretcher = createStretcher(new_options, new_time_ratio, new_pitch_scale, new_parallel_channels);
+    queue_mutex.lock();
+  }
+
+  const qint64 first_dropped_index = queue_read_index + 1 + nb_kept_blocks; // The block being played is kept as well
+  const bool tail_dropped = (first_dropped_index < queue_write_index) && (queue_blocks[first_dropped_index % nb_queue_blocks].generation == playback_generation);
+  qint64 restart_frame = 0;
+
+  if (tail_dropped) {
+    // Rendering restarts where the first dropped block started, fading in over it
+    const qint64 first_dropped_slot = first_dropped_index % nb_queue_blocks;
+    const QueuedBlock &first_dropped = queue_blocks[first_dropped_slot];
+    restart_frame = first_dropped.source_frame;
+    crossfade_length = first_dropped.nb_frames;
+    crossfade_position = 0;
+    std::memcpy(crossfade_samples.get(), queue_samples.get() + (first_dropped_slot * nb_channels * block_frames), sizeof(float) * nb_channels * block_frames);
+
+    for (qint64 i = first_dropped_index; i < queue_write_index; i++)
+      if (queue_blocks[i % nb_queue_blocks].generation == playback_generation)
+	nb_queued_frames -= queue_blocks[i % nb_queue_blocks].nb_frames;
+    queue_write_index = first_dropped_index;
+    end_of_stream = false;
+  }
+  else // Less audio is queued than what is kept: new settings apply to the following blocks, and the current segment ends here
+    restart_frame = renderingSourceFrame();
+
+  time_ratio = new_time_ratio;
+  pitch_scale = new_pitch_scale;
+  stretcher_options = new_options;
+  parallel_channels = new_parallel_channels;
+  loop_start_frame = new_loop_start_frame;
+  loop_end_frame = new_loop_end_frame;
+  const bool loop_entered = loop_changed && (loop_end_frame > 0) && ((restart_frame < loop_start_frame) || (restart_frame >= loop_end_frame));
+  if (loop_entered)
+    restart_frame = loop_start_frame;
+  queue_mutex.unlock();
+  if (stretcher_replaced)
+    stretcher = std::move(new_stretcher);
+  if (tail_dropped || stretcher_replaced || loop_entered || playing_loop_cache || playing_prerendered_audio) // The loop cache is left if it does not match the new settings, prerendered audio always is
+    resumeRendering(restart_frame);
+  else {
+    stretcher->setTimeRatio(stretcherTimeRatio());
+    stretcher->setPitchScale(stretcherPitchScale());
+    stretcher->setFormantOption(stretcher_options);
+    segment_source_frame = restart_frame;
+    segment_output_frames = 0;
+  }
+  releasePrerenderer();
+  settings_timer.restart();
+  if (stretcher_replaced)
+    reportLatency();
+  queue_mutex.lock();
+}
+
+
+// Creates a stretcher converting decoded audio to the output format with given settings
+std::unique_ptr<ParallelStretcher> AudioRenderer::createStretcher(RubberBand::RubberBandStretcher::Options options, double time_ratio, double pitch_scale, bool parallel_channels) const
+{
+  auto new_stretcher = std::make_unique<ParallelStretcher>(static_cast<size_t>(decoded_samples->sampleRate()),
+							   nb_channels,
+							   options,
+							   time_ratio * rate_ratio,
+							   pitch_scale / rate_ratio,
+							   parallel_channels);
+  new_stretcher->setMaxProcessSize(max_process_size); // Decoded audio is fed to the stretcher, and stretched audio is retrieved, in slices of at most max_process_size frames
+  return new_stretcher;
+}
+
+
+// Fades a freshly rendered block in over the dropped audio it replaces
+void AudioRenderer::crossfadeBlock(float *block_samples, qint64 nb_frames)
+{
+  const qint64 nb_faded_frames = qMin(nb_frames, crossfade_length - crossfade_position);
+  for (unsigned int i = 0; i < nb_channels; i++) {
+    float *channel_samples = block_samples + (i * block_frames);
+    const float *dropped_samples = crossfade_samples.get() + (i * block_frames) + crossfade_position;
+    for (qint64 j = 0; j < nb_faded_frames; j++) {
+      const float gain = static_cast<float>(crossfade_position + j) / static_cast<float>(crossfade_length);
+      channel_samples[j] = (channel_samples[j] * gain) + (dropped_samples[j] * (1.0f - gain));
+    }
+  }
+  crossfade_position += nb_faded_frames;
+}
+
+
+// Retrieves and drops the stretcher's start delay
+void AudioRenderer::discardStretcherOutput()
+{
+  int nb_available_frames;
+  while ((nb_frames_to_discard > 0) && ((nb_available_frames = stretcher->available()) > 0)) {
+    size_t nb_frames = static_cast<size_t>(qMin(qMin(static_cast<qint64>(nb_available_frames), max_process_size), nb_frames_to_discard));
+    nb_frames_to_discard -= static_cast<qint64>(stretcher->retrieve(stretcher_output.get(), nb_frames));
+  }
+}
+
+
+// Completes the loop cache once a whole pass is cached: the stretcher renders on past the end of the pass, and the start of the pass is faded in over this continuation, so that passes follow each other seamlessly
+void AudioRenderer::finishLoopCache()
+{
+  loop_cache.nb_pass_frames = loop_cache.nb_cached_frames; // The file may end before the loop
+  loop_cache.crossfade_length = qMin(loop_cache.crossfade_length, loop_cache.nb_pass_frames / 2);
+  const qint64 nb_tail_frames = retrieveStretchedAudio(loop_cache.samples.get() + loop_cache.nb_pass_frames, loop_cache.capacity, loop_cache.crossfade_length);
+
+  for (unsigned int i = 0; i < nb_channels; i++) {
+    float *pass_samples = loop_cache.samples.get() + (i * loop_cache.capacity);
+    float *tail_samples = pass_samples + loop_cache.nb_pass_frames;
+    std::memset(tail_samples + nb_tail_frames, 0, sizeof(float) * (loop_cache.crossfade_length - nb_tail_frames));
+    for (qint64 j = 0; j < loop_cache.crossfade_length; j++) {
+      const float gain = static_cast<float>(j) / static_cast<float>(loop_cache.crossfade_length);
+      pass_samples[j] = (pass_samples[j] * gain) + (tail_samples[j] * (1.0f - gain));
+    }
+  }
+  loop_cache.complete = true;
+}
+
+
+// Returns true if the pass of the loop rendered by the stretcher is being cached: it started at the loop start, with the settings the cache was prepared for
+bool AudioRenderer::isCachingLoopPass() const
+{
+  return !loop_cache.complete && (segment_source_frame == loop_start_frame) && (segment_output_frames == loop_cache.nb_cached_frames) && loopCacheMatches();
+}
+
+
+// Returns true if the loop cache holds a whole pass rendered with current loop bounds and stretcher settings
+bool AudioRenderer::isLoopCacheValid() const
+{
+  return loop_cache.complete && loopCacheMatches();
+}
+
+
+// Goes back to the stretcher where playback of the prerendered audio stands, fading in over the prerendered audio that follows (the prerenderer is released if it is complete)
+void AudioRenderer::leavePrerenderedAudio()
+{
+  crossfade_length = readPrerenderedAudio(crossfade_samples.get(), block_frames);
+  crossfade_position = 0;
+  const qint64 frame = renderingSourceFrame();
+  if (prerenderer->isComplete()) // Otherwise prerendering fell behind playback, and may get ahead of it again
+    releasePrerenderer();
+  restartRendering(frame);
+}
+
+
+// Returns true if the loop cache was prepared for current loop bounds and stretcher settings
+bool AudioRenderer::loopCacheMatches() const
+{
+  return (loop_cache.samples != nullptr) && (loop_end_frame > 0) && (loop_cache.start_frame == loop_start_frame) && (loop_cache.end_frame == loop_end_frame) && (loop_cache.time_ratio == time_ratio) && (loop_cache.pitch_scale == pitch_scale) && (loop_cache.options == stretcher_options) && (loop_cache.parallel_channels == parallel_channels);
+}
+
+
+// Returns the number of stretched frames in a pass of the loop with current settings
+qint64 AudioRenderer::loopPassFrames() const
+{
+  return qRound64(static_cast<double>(loop_end_frame - loop_start_frame) * stretcherTimeRatio());
+}
+
+
+// Handle changes of audio output's state
+void AudioRenderer::manageAudioOutputState(QAudio::State state)
+{
+  if (state != QAudio::IdleState)
+    return;
+  QMutexLocker locker(&queue_mutex);
+  if (end_of_stream && (queue_read_index == queue_write_index)) {
+    locker.unlock();
+    emit playingFinished();
+  }
+}
+
+
+// Starts prerendering the rest of the file once settings have been stable for a while, and releases prerendered audio that playback went past
+void AudioRenderer::managePrerendering()
+{
+  if (prerenderer && !playing_prerendered_audio && prerenderer->isComplete() && (renderingSourceFrame() >= prerenderer->startFrame() + qRound64(static_cast<double>(prerenderer->renderedFrames()) / stretcherTimeRatio())))
+    releasePrerenderer();
+  if (!prerenderer && (loop_end_frame == 0) && !no_more_data && decoded_samples->isComplete() && settings_timer.hasExpired(PRERENDER_DELAY)) // The loop cache already spares the stretcher while looping
+    startPrerendering();
+}
+
+
+// Writes nb_frames frames of the block queued in given slot, from the current read offset, interleaved into data
+void AudioRenderer::moveQueuedAudioToData(char *data, qint64 slot, qint64 nb_frames)
+{
+  const float *block_samples = queue_samples.get() + (slot * nb_channels * block_frames) + block_read_offset;
+  for (unsigned int i = 0; i < nb_channels; i++)
+    queued_input[i] = block_samples + (i * block_frames);
+
+  switch(output_format.sampleFormat()) {
+  case QAudioFormat::Float :
+    SampleConversion::interleave(queued_input.get(), reinterpret_cast<float*>(data), nb_channels, nb_frames);
+    break;
+  case QAudioFormat::Int32 :
+    SampleConversion::interleaveToInt32(queued_input.get(), reinterpret_cast<qint32*>(data), nb_channels, nb_frames);
+    break;
+  default : // 16-bit output is dithered
+    if (noise_shaping)
+      SampleConversion::interleaveToInt16NoiseShaped(queued_input.get(), reinterpret_cast<qint16*>(data), nb_channels, nb_frames, dither_position, shaping_errors.get());
+    else
+      SampleConversion::interleaveToInt16Dithered(queued_input.get(), reinterpret_cast<qint16*>(data), nb_channels, nb_frames, dither_position);
+    break;
+  }
+}
+
+
+// Feed the next slice of decoded audio to the stretcher. Returns false if there is no more data
+bool AudioRenderer::processNextAudioBuffer()
+{
+  bool decoding_complete = decoded_samples->isComplete(); // Must be checked before the number of frames
+  qint64 nb_input_frames = decoded_samples->readFrames(reading_frame, max_process_size, stretcher_input.get(), input_conversion_buffer.get());
+  if ((nb_input_frames == 0) && (!decoding_complete || final_processed)) {
+    no_more_data = decoding_complete;
+    return false;
+  }
+
+  reading_frame += nb_input_frames;
+  final_processed = decoding_complete && (reading_frame >= decoded_samples->frameCount());
+  QElapsedTimer processing_timer;
+  processing_timer.start();
+  stretcher->process(stretcher_input.get(), static_cast<size_t>(nb_input_frames), final_processed); // When decoding completed after the last slice, this flushes the stretcher with an empty slice
+
+  // The queue gets deeper as processing gets more expensive, so that a slow slice does not starve the sink
+  if (nb_input_frames > 0) {
+    const qint64 slice_processing_time = processing_timer.nsecsElapsed();
+    const double rendered_duration = static_cast<double>(nb_input_frames) * time_ratio * 1e9 / static_cast<double>(decoded_samples->sampleRate());
+    const double processing_cost = static_cast<double>(slice_processing_time) / rendered_duration;
+    peak_processing_cost = qMax(processing_cost, peak_processing_cost * PROCESSING_COST_DECAY);
+    target_queued_frames = min_queued_frames + qRound64(static_cast<double>(max_queued_frames - min_queued_frames) * qMin(peak_processing_cost / PROCESSING_COST_FULL_DEPTH, 1.0));
+
+    QMutexLocker locker(&queue_mutex); // Performance counters are read by takeStatistics()
+    processing_time += slice_processing_time;
+    peak_processing_time = qMax(peak_processing_time, slice_processing_time);
+    nb_processed_slices++;
+    processed_duration += rendered_duration;
+  }
+  return true;
+}
+
+
+// Prepares the loop cache to store the pass rendered from the loop start with current settings (the cache is dropped if the loop is too long)
+void AudioRenderer::prepareLoopCache()
+{
+  const qint64 nb_pass_frames = loopPassFrames();
+  const qint64 crossfade_length = qMin(block_frames, nb_pass_frames / 2);
+  if (nb_pass_frames > static_cast<qint64>(LOOP_CACHE_MAX_DURATION) * output_format.sampleRate()) {
+    loop_cache = AudioRenderer::LoopCache();
+    return;
+  }
+
+  if (loop_cache.capacity < nb_pass_frames + crossfade_length) {
+    loop_cache.capacity = nb_pass_frames + crossfade_length;
+    loop_cache.samples = std::make_unique_for_overwrite<float[]>(static_cast<size_t>(loop_cache.capacity) * nb_channels);
+  }
+  loop_cache.start_frame = loop_start_frame;
+  loop_cache.end_frame = loop_end_frame;
+  loop_cache.time_ratio = time_ratio;
+  loop_cache.pitch_scale = pitch_scale;
+  loop_cache.options = stretcher_options;
+  loop_cache.parallel_channels = parallel_channels;
+  loop_cache.nb_pass_frames = nb_pass_frames;
+  loop_cache.nb_cached_frames = 0;
+  loop_cache.crossfade_length = crossfade_length;
+  loop_cache.complete = false;
+}
+
+
+// Feeds the stretcher with the audio preceding the reading position, so that the first output frame corresponds to the reading frame
+void AudioRenderer::primeStretcher()
+{
+  qint64 preroll_frame = reading_frame - static_cast<qint64>(stretcher->getPreferredStartPad());
+
+  while (preroll_frame < 0) { // Not enough audio before the reading position: pad with silence
+    size_t nb_frames = static_cast<size_t>(qMin(-preroll_frame, max_process_size));
+    stretcher->process(silent_input.get(), nb_frames, false);
+    preroll_frame += static_cast<qint64>(nb_frames);
+  }
+  while (preroll_frame < reading_frame) {
+    qint64 nb_frames = decoded_samples->readFrames(preroll_frame, qMin(reading_frame - preroll_frame, max_process_size), stretcher_input.get(), input_conversion_buffer.get());
+    stretcher->process(stretcher_input.get(), static_cast<size_t>(nb_frames), false);
+    preroll_frame += nb_frames;
+  }
+
+  nb_frames_to_discard = static_cast<qint64>(stretcher->getStartDelay());
+  segment_source_frame = reading_frame;
+  segment_output_frames = 0;
+}
+
+
+// Renders the next block and queues it, flagging the end of the stream once the last one is queued. Returns the number of rendered frames (render-ahead thread, queue_mutex held, released while rendering)
+qint64 AudioRenderer::queueNextBlock()
+{
+  // The slot following the last queued block is never read (nor moved) by the render thread
+  const qint64 slot = queue_write_index % nb_queue_blocks;
+  const quint64 generation = render_generation;
+  const qint64 source_frame = renderingSourceFrame();
+  queue_mutex.unlock();
+  const qint64 nb_frames = renderBlock(slot);
+  managePrerendering();
+  queue_mutex.lock();
+
+  if (nb_frames > 0) {
+    queue_blocks[slot] = QueuedBlock{generation, source_frame, 1.0 / stretcherTimeRatio(), nb_frames};
+    queue_write_index++;
+    if (generation == playback_generation)
+      nb_queued_frames += nb_frames;
+    queue_condition.wakeAll();
+  }
+  if (no_more_data)
+    end_of_stream = (generation == playback_generation);
+  return nb_frames;
+}
+
+
+// Copies up to max_frames prerendered frames from the playback position into planar samples (channels block_frames apart), flagging the end of the file once it is read. Returns the number of copied frames
+qint64 AudioRenderer::readPrerenderedAudio(float *samples, qint64 max_frames)
+{
+  const bool file_end_reached = prerenderer->isComplete() && prerenderer->reachedFileEnd(); // Must be checked before the number of frames
+  qint64 nb_frames = 0;
+  qint64 nb_read_frames;
+
+  while ((nb_frames < max_frames) && ((nb_read_frames = prerenderer->readFrames(segment_output_frames + nb_frames, max_frames - nb_frames, prerendered_input.get(), input_conversion_buffer.get())) > 0)) { // Chunk by chunk
+    for (unsigned int i = 0; i < nb_channels; i++)
+      std::memcpy(samples + (i * block_frames) + nb_frames, prerendered_input[i], sizeof(float) * nb_read_frames);
+    nb_frames += nb_read_frames;
+  }
+
+  if (file_end_reached && (segment_output_frames + nb_frames >= prerenderer->renderedFrames()))
+    no_more_data = true;
+  return nb_frames;
+}
+
+
+// Cancels the prerendering job, if any, and drops its audio
+void AudioRenderer::releasePrerenderer()
+{
+  if (prerenderer) {
+    prerenderer->cancel(); // The job stops shortly, and releases the prerenderer then
+    prerenderer.reset();
+  }
+}
+
+
+// Keeps the queue filled until the output is stopped (body of the render-ahead thread)
+void AudioRenderer::renderAhead()
+{
+  primeStretcher();
+  reportLatency();
+  settings_timer.start();
+  QMutexLocker locker(&queue_mutex);
+
+  while (!stopping) {
+    if (pending_seek_frame >= 0) {
+      const qint64 frame = pending_seek_frame;
+      const bool settings_applied = settings_changed;
+      const bool stretcher_replaced = requiresNewStretcher(pending_options, pending_parallel_channels);
+      pending_seek_frame = -1;
+      settings_changed = false;
+      time_ratio = pending_time_ratio;
+      pitch_scale = pending_pitch_scale;
+      stretcher_options = pending_options;
+      parallel_channels = pending_parallel_channels;
+      loop_start_frame = pending_loop_start_frame;
+      loop_end_frame = pending_loop_end_frame;
+      render_generation = playback_generation;
+      crossfade_length = 0;
+      crossfade_position = 0;
+      locker.unlock();
+      if (stretcher_replaced) // Nothing queued is kept: the new stretcher is simply primed at the new position
+	stretcher = createStretcher(stretcher_options, time_ratio, pitch_scale, parallel_channels);
+      if (settings_applied) {
+	releasePrerenderer();
+	settings_timer.restart();
+      }
+      else if (prerenderer && (frame < prerenderer->startFrame())) // Prerendered audio is kept as long as playback may reach it
+	releasePrerenderer();
+      resumeRendering(frame);
+      if (stretcher_replaced)
+	reportLatency();
+      locker.relock();
+      continue;
+    }
+    if (settings_changed) {
+      applySettings();
+      continue;
+    }
+    if (end_of_stream || (nb_queued_frames >= target_queued_frames) || ((queue_write_index - queue_read_index) >= nb_queue_blocks)) {
+      render_condition.wait(&queue_mutex);
+      continue;
+    }
+
+    if ((queueNextBlock() < block_frames) && !no_more_data) // Rendering has caught up with decoding
+      render_condition.wait(&queue_mutex, RENDER_AHEAD_POLL_INTERVAL);
+  }
+}
+
+
+// Renders stretched audio into given queue slot (read from the prerendered audio when possible), starting a new pass of the loop once its end is reached. Returns the number of rendered frames
+qint64 AudioRenderer::renderBlock(qint64 slot)
+{
+  float *block_samples = queue_samples.get() + (slot * nb_channels * block_frames);
+  bool pass_finished = false;
+  qint64 nb_frames = 0;
+  if (segment_source_frame < loop_end_frame) // Rendering started before the end of the loop
+    nb_frames = renderLoopBlock(block_samples, &pass_finished);
+  else if (usePrerenderedAudio())
+    nb_frames = readPrerenderedAudio(block_samples, block_frames);
+  else
+    nb_frames = retrieveStretchedAudio(block_samples, block_frames, block_frames);
+
+  if (crossfade_position < crossfade_length)
+    crossfadeBlock(block_samples, nb_frames);
+  segment_output_frames += nb_frames;
+  if (pass_finished)
+    restartLoop();
+  return nb_frames;
+}
+
+
+// Returns the decoded frame matching the next stretched frame to render
+qint64 AudioRenderer::renderingSourceFrame() const
+{
+  return segment_source_frame + qRound64(static_cast<double>(segment_output_frames) / stretcherTimeRatio());
+}
+
+
+// Renders the next block of the loop's current pass (shorter at its end): from the loop cache while it is played, otherwise from the stretcher, caching the pass if possible. Returns the number of rendered frames
+qint64 AudioRenderer::renderLoopBlock(float *block_samples, bool *pass_finished)
+{
+  if (playing_loop_cache) {
+    const qint64 nb_frames = qMin(block_frames, loop_cache.nb_pass_frames - segment_output_frames);
+    for (unsigned int i = 0; i < nb_channels; i++)
+      std::memcpy(block_samples + (i * block_frames), loop_cache.samples.get() + (i * loop_cache.capacity) + segment_output_frames, sizeof(float) * nb_frames);
+    *pass_finished = (segment_output_frames + nb_frames >= loop_cache.nb_pass_frames);
+    return nb_frames;
+  }
+
+  const qint64 pass_end = qRound64(static_cast<double>(loop_end_frame - segment_source_frame) * stretcherTimeRatio());
+  const qint64 nb_frames = retrieveStretchedAudio(block_samples, block_frames, qBound(static_cast<qint64>(0), pass_end - segment_output_frames, block_frames));
+  if (isCachingLoopPass()) {
+    for (unsigned int i = 0; i < nb_channels; i++)
+      std::memcpy(loop_cache.samples.get() + (i * loop_cache.capacity) + loop_cache.nb_cached_frames, block_samples + (i * block_frames), sizeof(float) * nb_frames);
+    loop_cache.nb_cached_frames += nb_frames;
+  }
+  *pass_finished = (segment_output_frames + nb_frames >= pass_end) || no_more_data; // The file may end before the loop
+  return nb_frames;
+}
+
+
+// Emits the end-to-end latency with the current stretcher
+void AudioRenderer::reportLatency()
+{
+  const qint64 delay = static_cast<qint64>(stretcher->getStartDelay()) * 1000000 / output_format.sampleRate();
+  QMutexLocker locker(&queue_mutex);
+  stretcher_delay = delay;
+  updateLatency();
+}
+
+
+// Emits the position of the frame being played, if it changed: the audio processed by the sink is mapped back to decoded frames through the segments handed to it
+void AudioRenderer::reportReadingPosition()
+{
+  const qint64 processed_frame = qMin(static_cast<qint64>(output_format.framesForDuration(audio_output->processedUSecs())), sink_frames);
+  while ((nb_played_segments > 1) && (played_segments[(first_played_segment + 1) % max_played_segments].sink_frame <= processed_frame)) {
+    first_played_segment++;
+    nb_played_segments--;
+  }
+
+  qint64 frame = handed_frame;
+  if (nb_played_segments > 0) {
+    const PlayedSegment &segment = played_segments[first_played_segment % max_played_segments];
+    frame = qMin(segment.source_frame + qRound64(static_cast<double>(qMax(processed_frame - segment.sink_frame, static_cast<qint64>(0))) * segment.source_step), handed_frame);
+  }
+
+  const int position = static_cast<int>(decoded_samples->positionForFrame(frame) / 1000);
+  if (position != reported_position) {
+    reported_position = position;
+    emit readingPositionChanged(position);
+  }
+}
+
+
+// Returns true if given options cannot be applied to the current stretcher, which must then be replaced (anything else than formant preservation changes)
+bool AudioRenderer::requiresNewStretcher(RubberBand::RubberBandStretcher::Options new_options, bool new_parallel_channels) const
+{
+  return ((new_options & ~RubberBand::RubberBandStretcher::OptionFormantPreserved) != (stretcher_options & ~RubberBand::RubberBandStretcher::OptionFormantPreserved)) || (new_parallel_channels != parallel_channels);
+}
+
+
+// Starts a new pass of the loop: from the cache if it is valid, otherwise by restarting the stretcher at the loop start and fading in over what it renders past the end of the previous pass
+void AudioRenderer::restartLoop()
+{
+  if (!playing_loop_cache && isCachingLoopPass())
+    finishLoopCache();
+  if (isLoopCacheValid()) {
+    resumeRendering(loop_start_frame);
+    return;
+  }
+
+  crossfade_length = qMin(block_frames, loopPassFrames() / 2);
+  crossfade_position = 0;
+  const qint64 nb_tail_frames = retrieveStretchedAudio(crossfade_samples.get(), block_frames, crossfade_length);
+  for (unsigned int i = 0; i < nb_channels; i++) // The file may end before the loop
+    std::memset(crossfade_samples.get() + (i * block_frames) + nb_tail_frames, 0, sizeof(float) * (crossfade_length - nb_tail_frames));
+  restartRendering(loop_start_frame);
+}
+
+
+// Resets the stretcher with current settings and primes it at given decoded frame (preparing the loop cache if this is the loop start)
+void AudioRenderer::restartRendering(qint64 frame)
+{
+  stretcher->reset();
+  stretcher->setTimeRatio(stretcherTimeRatio());
+  stretcher->setPitchScale(stretcherPitchScale());
+  stretcher->setFormantOption(stretcher_options);
+  reading_frame = frame;
+  no_more_data = false;
+  final_processed = false;
+  playing_loop_cache = false;
+  playing_prerendered_audio = false;
+  primeStretcher();
+  if ((loop_end_frame > 0) && (frame == loop_start_frame))
+    prepareLoopCache();
+}
+
+
+// Resumes rendering at given decoded frame: from the loop cache if it is valid and holds this frame, otherwise by restarting the stretcher there
+void AudioRenderer::resumeRendering(qint64 frame)
+{
+  if (!isLoopCacheValid() || (frame < loop_start_frame) || (frame >= loop_end_frame)) {
+    restartRendering(frame);
+    return;
+  }
+
+  segment_source_frame = loop_start_frame;
+  segment_output_frames = qMin(qRound64(static_cast<double>(frame - loop_start_frame) * stretcherTimeRatio()), loop_cache.nb_pass_frames - 1);
+  no_more_data = false;
+  playing_loop_cache = true;
+  playing_prerendered_audio = false;
+}
+
+
+// Retrieves up to max_frames stretched frames into planar samples (channels channel_size frames apart), feeding the stretcher as needed. Returns the number of retrieved frames (fewer if decoded audio runs out)
+qint64 AudioRenderer::retrieveStretchedAudio(float *samples, qint64 channel_size, qint64 max_frames)
+{
+  qint64 nb_frames = 0;
+
+  while (nb_frames < max_frames) {
+    if (nb_frames_to_discard > 0)
+      discardStretcherOutput();
+
+    int nb_available_frames = stretcher->available();
+    if ((nb_available_frames <= 0) || (nb_frames_to_discard > 0)) {
+      if (processNextAudioBuffer())
+	continue;
+      break;
+    }
+
+    for (unsigned int i = 0; i < nb_channels; i++)
+      block_output[i] = samples + (i * channel_size) + nb_frames;
+    nb_frames += static_cast<qint64>(stretcher->retrieve(block_output.get(), static_cast<size_t>(qMin(static_cast<qint64>(nb_available_frames), max_frames - nb_frames))));
+  }
+
+  return nb_frames;
+}
+
+
+// Starts rendering the rest of the file with current settings in a job of the global thread pool, from the decoded frame rendered next
+void AudioRenderer::startPrerendering()
+{
+  prerenderer = std::make_shared<AudioPrerenderer>(decoded_samples, output_format.sampleRate(), stretcher_options, stretcherTimeRatio(), stretcherPitchScale(), parallel_channels, renderingSourceFrame(), static_cast<qint64>(PRERENDER_MAX_DURATION) * output_format.sampleRate());
+  QThreadPool::globalInstance()->start([job = prerenderer](){ job->render(); });
+}
+
+
+// Stops and releases the render-ahead thread (and the prerendering job)
+void AudioRenderer::stopRenderAhead()
+{
+  if (render_ahead_thread == nullptr)
+    return;
+
+  {
+    QMutexLocker locker(&queue_mutex);
+    stopping = true;
+    render_condition.wakeOne();
+  }
+  render_ahead_thread->wait();
+  delete render_ahead_thread;
+  render_ahead_thread = nullptr;
+  releasePrerenderer();
+}
+
+
+// Returns the pitch scale given to the stretcher: the current pitch scale, compensated for the sample rate conversion
+double AudioRenderer::stretcherPitchScale() const
+{
+  return pitch_scale / rate_ratio;
+}
+
+
+// Returns the time ratio given to the stretcher, in output frames per decoded frame: the current time ratio, including the sample rate conversion
+double AudioRenderer::stretcherTimeRatio() const
+{
+  return time_ratio * rate_ratio;
+}
+
+
+// Emits the end-to-end latency: the sink's buffer, the queued blocks kept when settings change (the one being played included) and the stretcher's delay (queue_mutex held)
+void AudioRenderer::updateLatency()
+{
+  const qint64 kept_queue_duration = (nb_kept_blocks + 1) * block_frames * 1000000 / output_format.sampleRate();
+  output_latency = static_cast<int>((output_buffer_duration + kept_queue_duration + stretcher_delay) / 1000);
+  emit latencyChanged(output_latency); // Emitted with the lock held, so that latencies reported by both threads arrive in order
+}
+
+
+// Returns true if the next block is read from the prerendered audio: playback switches to it, fading it in over the stretcher's output, once it is far enough ahead, and goes back to the stretcher when it runs out
+bool AudioRenderer::usePrerenderedAudio()
+{
+  if (!prerenderer)
+    return false;
+
+  const bool complete = prerenderer->isComplete(); // Must be checked before the number of frames
+  const qint64 nb_rendered_frames = prerenderer->renderedFrames();
+  if (playing_prerendered_audio) {
+    // Two blocks are left when leaving: one to play, and one to fade the stretcher in over
+    if ((nb_rendered_frames - segment_output_frames >= 2 * block_frames) || (complete && prerenderer->reachedFileEnd()))
+      return true;
+    leavePrerenderedAudio();
+    return false;
+  }
+
+  const qint64 source_frame = renderingSourceFrame();
+  const qint64 prerendered_frame = qRound64(static_cast<double>(source_frame - prerenderer->startFrame()) * stretcherTimeRatio());
+  const qint64 nb_ahead_frames = nb_rendered_frames - prerendered_frame;
+  if ((source_frame < prerenderer->startFrame()) || (crossfade_position < crossfade_length) || (nb_ahead_frames < 2 * block_frames) || (!complete && (nb_ahead_frames < static_cast<qint64>(output_format.framesForDuration(PRERENDER_MIN_LEAD * 1000)))))
+    return false;
+
+  // The stretcher renders one more block, over which the prerendered audio is faded in
+  crossfade_length = retrieveStretchedAudio(crossfade_samples.get(), block_frames, block_frames);
+  crossfade_position = 0;
+  segment_source_frame = prerenderer->startFrame();
+  segment_output_frames = prerendered_frame;
+  playing_prerendered_audio = true;
+  return true;
+}
+
+
+// Waits until the queue holds enough audio to fill the sink's buffer (or the end of the file is queued)
+void AudioRenderer::waitForQueuedAudio()
+{
+  const qint64 nb_frames = qMin(static_cast<qint64>(output_format.framesForDuration(sink_buffer_duration)), min_queued_frames);
+  QDeadlineTimer deadline(PREFILL_TIMEOUT);
+  QMutexLocker locker(&queue_mutex);
+  while ((nb_queued_frames < nb_frames) && !end_of_stream)
+    if (!queue_condition.wait(&queue_mutex, deadline)) // Decoding may be too slow to fill the queue: the sink plays silence meanwhile
+      break;
+}
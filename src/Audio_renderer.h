@@ -0,0 +1,231 @@
+// Copyright 2026 François CROLLET
+
+// This file is part of VPS Player.
+// VPS Player is free software; you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation; either version 3 of the License, or (at your option) any later version.
+// VPS Player is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License along with VPS Player. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef AUDIO_RENDERER_H
+#define AUDIO_RENDERER_H
+
+#include <rubberband/RubberBandStretcher.h>
+#include <memory>
+#include <QAudio>
+#include <QAudioDevice>
+#include <QAudioFormat>
+#include <QAudioSink>
+#include <QElapsedTimer>
+#include <QIODevice>
+#include <QMutex>
+#include <QThread>
+#include <QTimer>
+#include <QWaitCondition>
+
+#include "Audio_prerenderer.h"
+#include "Parallel_stretcher.h"
+#include "Playback_statistics.h"
+#include "Sample_store.h"
+
+
+// Pull-mode audio source living in the render thread: a render-ahead thread owns the stretcher and keeps a queue of stretched audio filled, from which the audio sink is served
+class AudioRenderer : public QIODevice
+{
+  Q_OBJECT
+  friend class PipelineBenchmark; // Drives the render-ahead and sink paths step by step, without any thread nor audio device
+
+private:
+  struct QueuedBlock
+  {
+    quint64 generation; // Blocks rendered before the last move of the reading position are dropped
+    qint64 source_frame; // Decoded frame matching the first frame of the block
+    double source_step; // Decoded frames per output frame
+    qint64 nb_frames;
+  };
+
+  struct PlayedSegment // Audio handed to the sink: from sink_frame on, output frames map to decoded frames from source_frame on
+  {
+    qint64 sink_frame; // Output frame since the sink was last started
+    qint64 source_frame;
+    double source_step; // Decoded frames per output frame (0 for silence)
+  };
+
+  struct LoopCache // Stretched audio of a whole pass of the A–B loop, rendered with given loop bounds and stretcher settings
+  {
+    qint64 start_frame;
+    qint64 end_frame;
+    double time_ratio;
+    double pitch_scale;
+    RubberBand::RubberBandStretcher::Options options;
+    bool parallel_channels;
+    qint64 nb_pass_frames; // Stretched frames in a pass
+    qint64 nb_cached_frames; // Frames of the pass rendered so far
+    qint64 crossfade_length; // The start of the pass is faded in over this many frames of what follows its end
+    bool complete; // The whole pass is cached and its start faded in: it can be played again and again seamlessly
+    qint64 capacity; // Frames per channel
+    std::unique_ptr<float[]> samples; // Planar
+  };
+
+  std::shared_ptr<const SampleStore> decoded_samples;
+  QAudioFormat output_format;
+  unsigned int nb_channels;
+  double rate_ratio; // Output sample rate over decoded sample rate: the stretcher converts the rate by scaling time by this ratio and pitch by its inverse
+  qint64 sink_buffer_duration; // In microseconds
+  qint64 block_frames; // Maximum size of queued blocks
+  qint64 max_process_size; // Maximum size of slices fed to the stretcher
+
+  // Owned by the render-ahead thread
+  std::unique_ptr<const float*[]> stretcher_input;
+  std::unique_ptr<float[]> input_samples;
+  std::unique_ptr<float*[]> input_conversion_buffer;
+  std::unique_ptr<float[]> output_samples;
+  std::unique_ptr<float*[]> stretcher_output;
+  std::unique_ptr<float*[]> block_output;
+  std::unique_ptr<float[]> silent_samples;
+  std::unique_ptr<const float*[]> silent_input;
+  std::unique_ptr<float[]> crossfade_samples;
+  qint64 reading_frame;
+  qint64 nb_frames_to_discard;
+  bool no_more_data;
+  bool final_processed;
+  double time_ratio;
+  double pitch_scale;
+  RubberBand::RubberBandStretcher::Options stretcher_options;
+  bool parallel_channels;
+  qint64 segment_source_frame; // Decoded frame the stretcher was primed at
+  qint64 segment_output_frames; // Stretched frames rendered since then
+  qint64 crossfade_length;
+  qint64 crossfade_position;
+  qint64 loop_start_frame; // Bounds of the A–B loop (both 0 while not looping)
+  qint64 loop_end_frame;
+  AudioRenderer::LoopCache loop_cache;
+  bool playing_loop_cache; // The loop is played from its cache: the stretcher is left behind, and restarted when the loop is left
+  std::shared_ptr<AudioPrerenderer> prerenderer; // Renders the rest of the file with current settings in the background (shared with its job, which may outlive the renderer)
+  bool playing_prerendered_audio; // Blocks are read from the prerenderer: the stretcher is left behind, and restarted when prerendered audio runs out
+  QElapsedTimer settings_timer; // Time since settings last changed
+  std::unique_ptr<const float*[]> prerendered_input;
+  quint64 render_generation;
+  double peak_processing_cost; // Processing time over duration of the rendered audio, decaying over time
+  qint64 min_queued_frames;
+  qint64 max_queued_frames;
+  qint64 target_queued_frames;
+  qint64 nb_kept_blocks; // Queued blocks still played once settings change
+  std::unique_ptr<ParallelStretcher> stretcher;
+  QThread *render_ahead_thread;
+
+  // Shared between both threads (protected by queue_mutex)
+  std::unique_ptr<float[]> queue_samples;
+  std::unique_ptr<QueuedBlock[]> queue_blocks;
+  qint64 nb_queue_blocks;
+  qint64 queue_read_index;
+  qint64 queue_write_index;
+  qint64 block_read_offset;
+  qint64 nb_queued_frames;
+  quint64 playback_generation;
+  bool end_of_stream;
+  bool stopping;
+  bool settings_changed;
+  double pending_time_ratio;
+  double pending_pitch_scale;
+  RubberBand::RubberBandStretcher::Options pending_options;
+  bool pending_parallel_channels;
+  qint64 pending_loop_start_frame;
+  qint64 pending_loop_end_frame;
+  qint64 pending_seek_frame;
+  int nb_underruns;
+  qint64 processing_time; // Time spent stretching slices since statistics were last taken, in nanoseconds
+  qint64 peak_processing_time; // In nanoseconds
+  qint64 nb_processed_slices;
+  double processed_duration; // Duration of the audio stretched since statistics were last taken, in nanoseconds
+  qint64 max_sink_request; // Largest amount of audio requested at once by the audio sink since statistics were last taken, in bytes
+  qint64 output_buffer_duration; // Duration of the sink's buffer once it is started, in microseconds
+  qint64 stretcher_delay; // In microseconds
+  int output_latency; // In milliseconds
+  QMutex queue_mutex;
+  QWaitCondition render_condition; // Woken when the render-ahead thread may have something to do
+  QWaitCondition queue_condition; // Woken when a block is queued
+
+  // Owned by the render thread
+  std::unique_ptr<const float*[]> queued_input;
+  bool noise_shaping;
+  quint32 dither_position;
+  std::unique_ptr<float[]> shaping_errors; // Last 2 quantization errors of each channel
+  bool output_suspended;
+  std::unique_ptr<PlayedSegment[]> played_segments; // Ring of the segments handed to the sink, from the one being played
+  qint64 max_played_segments;
+  qint64 first_played_segment;
+  qint64 nb_played_segments;
+  qint64 sink_frames; // Frames handed to the sink since it was last started
+  qint64 handed_frame; // Decoded frame following the audio last handed to the sink
+  int reported_position; // In milliseconds
+  QTimer *position_timer;
+  QAudioSink *audio_output;
+
+public:
+  AudioRenderer(std::shared_ptr<const SampleStore> samples, const QAudioFormat &format, RubberBand::RubberBandStretcher::Options options, double time_ratio, double pitch_scale, bool parallel_channels, int render_ahead, int latency, bool noise_shaping); // Constructor. format: output format (its sample rate may differ from the decoded one), render_ahead: maximum duration of audio rendered ahead of playback, latency: duration of the sink's buffer (both in milliseconds), noise_shaping: the dither of 16-bit output is noise-shaped
+  ~AudioRenderer(); // Destructor
+  bool isSequential() const override; // Reimplementation of QIODevice's isSequential()
+  void moveReadingPosition(int position); // Move reading position. Parameter: position in milliseconds
+  void pauseOutput(); // Suspend the audio output
+  void resumeOutput(); // Resume the audio output
+  void startOutput(const QAudioDevice &device, qreal volume); // Create the audio output and start pulling audio from this device
+  void stopOutput(); // Stop and release the audio output
+  PlaybackStatistics takeStatistics(); // Returns the performance counters, those measured over an interval covering the time since the previous call (may be called from any thread)
+  void updateLoop(int start, int end); // Loop playback between given positions in milliseconds (no loop if end is not after start). A new loop is entered at its start, unless the audio heard next is already in it
+  void updateNoiseShaping(bool enabled); // Enable or disable noise shaping of the dither of 16-bit output
+  void updateStretcherOptions(RubberBand::RubberBandStretcher::Options options, bool parallel_channels); // Update stretcher's options (the stretcher is replaced if anything else than formant preservation changes)
+  void updatePitchScale(double pitch_scale); // Update stretcher's pitch scale
+  void updateTimeRatio(double time_ratio); // Update stretcher's time ratio
+  void updateVolume(qreal volume); // Update output volume
+
+protected:
+  qint64 readData(char *data, qint64 max_size) override; // Reimplementation of QIODevice's readData(): called by the audio sink when it needs more audio
+  qint64 writeData(const char *data, qint64 max_size) override; // Reimplementation of QIODevice's writeData() (read-only device)
+
+private:
+  void addPlayedSegment(qint64 source_frame, double source_step); // Records that the audio handed to the sink from now on maps to decoded frames from source_frame on, source_step apart
+  void applySettings(); // Applies pending stretcher settings, dropping the queued audio beyond the kept blocks so that they are heard shortly (render-ahead thread, queue_mutex held)
+  std::unique_ptr<ParallelStretcher> createStretcher(RubberBand::RubberBandStretcher::Options options, double time_ratio, double pitch_scale, bool parallel_channels) const; // Creates a stretcher converting decoded audio to the output format with given settings
+  void crossfadeBlock(float *block_samples, qint64 nb_frames); // Fades a freshly rendered block in over the dropped audio it replaces
+  void discardStretcherOutput(); // Retrieves and drops the stretcher's start delay
+  void finishLoopCache(); // Completes the loop cache once a whole pass is cached: the stretcher renders on past the end of the pass, and the start of the pass is faded in over this continuation, so that passes follow each other seamlessly
+  bool isCachingLoopPass() const; // Returns true if the pass of the loop rendered by the stretcher is being cached: it started at the loop start, with the settings the cache was prepared for
+  bool isLoopCacheValid() const; // Returns true if the loop cache holds a whole pass rendered with current loop bounds and stretcher settings
+  void leavePrerenderedAudio(); // Goes back to the stretcher where playback of the prerendered audio stands, fading in over the prerendered audio that follows (the prerenderer is released if it is complete)
+  bool loopCacheMatches() const; // Returns true if the loop cache was prepared for current loop bounds and stretcher settings
+  qint64 loopPassFrames() const; // Returns the number of stretched frames in a pass of the loop with current settings
+  void manageAudioOutputState(QAudio::State state); // Handle changes of audio output's state
+  void managePrerendering(); // Starts prerendering the rest of the file once settings have been stable for a while, and releases prerendered audio that playback went past
+  void moveQueuedAudioToData(char *data, qint64 slot, qint64 nb_frames); // Writes nb_frames frames of the block queued in given slot, from the current read offset, interleaved into data
+  void prepareLoopCache(); // Prepares the loop cache to store the pass rendered from the loop start with current settings (the cache is dropped if the loop is too long)
+  void primeStretcher(); // Feeds the stretcher with the audio preceding the reading position, so that the first output frame corresponds to the reading frame
+  bool processNextAudioBuffer(); // Feed the next slice of decoded audio to the stretcher. Returns false if there is no more data
+  qint64 queueNextBlock(); // Renders the next block and queues it, flagging the end of the stream once the last one is queued. Returns the number of rendered frames (render-ahead thread, queue_mutex held, released while rendering)
+  qint64 readPrerenderedAudio(float *samples, qint64 max_frames); // Copies up to max_frames prerendered frames from the playback position into planar samples (channels block_frames apart), flagging the end of the file once it is read. Returns the number of copied frames
+  void releasePrerenderer(); // Cancels the prerendering job, if any, and drops its audio
+  void renderAhead(); // Keeps the queue filled until the output is stopped (body of the render-ahead thread)
+  qint64 renderBlock(qint64 slot); // Renders stretched audio into given queue slot (read from the prerendered audio when possible), starting a new pass of the loop once its end is reached. Returns the number of rendered frames
+  qint64 renderingSourceFrame() const; // Returns the decoded frame matching the next stretched frame to render
+  qint64 renderLoopBlock(float *block_samples, bool *pass_finished); // Renders the next block of the loop's current pass (shorter at its end): from the loop cache while it is played, otherwise from the stretcher, caching the pass if possible. Returns the number of rendered frames
+  void reportLatency(); // Emits the end-to-end latency with the current stretcher
+  void reportReadingPosition(); // Emits the position of the frame being played, if it changed: the audio processed by the sink is mapped back to decoded frames through the segments handed to it
+  bool requiresNewStretcher(RubberBand::RubberBandStretcher::Options new_options, bool new_parallel_channels) const; // Returns true if given options cannot be applied to the current stretcher, which must then be replaced (anything else than formant preservation changes)
+  void restartLoop(); // Starts a new pass of the loop: from the cache if it is valid, otherwise by restarting the stretcher at the loop start and fading in over what it renders past the end of the previous pass
+  void restartRendering(qint64 frame); // Resets the stretcher with current settings and primes it at given decoded frame (preparing the loop cache if this is the loop start)
+  void resumeRendering(qint64 frame); // Resumes rendering at given decoded frame: from the loop cache if it is valid and holds this frame, otherwise by restarting the stretcher there
+  qint64 retrieveStretchedAudio(float *samples, qint64 channel_size, qint64 max_frames); // Retrieves up to max_frames stretched frames into planar samples (channels channel_size frames apart), feeding the stretcher as needed. Returns the number of retrieved frames (fewer if decoded audio runs out)
+  void startPrerendering(); // Starts rendering the rest of the file with current settings in a job of the global thread pool, from the decoded frame rendered next
+  void stopRenderAhead(); // Stops and releases the render-ahead thread (and the prerendering job)
+  double stretcherPitchScale() const; // Returns the pitch scale given to the stretcher: the current pitch scale, compensated for the sample rate conversion
+  double stretcherTimeRatio() const; // Returns the time ratio given to the stretcher, in output frames per decoded frame: the current time ratio, including the sample rate conversion
+  void updateLatency(); // Emits the end-to-end latency: the sink's buffer, the queued blocks kept when settings change (the one being played included) and the stretcher's delay (queue_mutex held)
+  bool usePrerenderedAudio(); // Returns true if the next block is read from the prerendered audio: playback switches to it, fading it in over the stretcher's output, once it is far enough ahead, and goes back to the stretcher when it runs out
+  void waitForQueuedAudio(); // Waits until the queue holds enough audio to fill the sink's buffer (or the end of the file is queued)
+
+signals:
+  void audioOutputError(QAudio::Error); // This signal is emitted if an error occurs while trying to access audio device
+  void latencyChanged(int); // This signal is emitted when playing starts, once the sink's buffer is known, and when the stretcher is replaced. Parameter: end-to-end latency (sink's buffer, queued audio kept when settings change and stretcher's delay) in milliseconds
+  void playingFinished(); // This signal is emitted when all decoded audio has been played
+  void readingPositionChanged(int); // This signal is emitted at a fixed rate while playing, when the position of the frame being played changes. Parameter: position in milliseconds
+};
+
+#endif
@@ -0,0 +1,203 @@
+// Copyright 2026 François CROLLET
+
+// This file is part of VPS Player.
+// VPS Player is free software; you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation; either version 3 of the License, or (at your option) any later version.
+// VPS Player is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License along with VPS Player. If not, see <http://www.gnu.org/licenses/>.
+
+#include <QAudioDecoder>
+#include <QDir>
+#include <QFileInfo>
+#include <QFileInfoList>
+#include <QMetaObject>
+#include <QTextStream>
+#include <QThread>
+
+#include "Audio_exporter.h"
+#include "Audio_loader.h"
+#include "Batch_processor.h"
+
+#define BATCH_MAX_LOADING_FILES 2 // Maximum number of files decoded at the same time
+
+
+// Constructor. Output files are written to given directory (next to input files if empty), with given suffix ("wav" or "flac")
+BatchProcessor::BatchProcessor(const QStringList &filenames, const QList<BatchProcessor::Preset> &preset_list, const StretcherSettings &settings, const QString &directory, const QString &suffix, QObject *parent) : QObject(parent),
+  input_filenames(filenames),
+  presets(preset_list),
+  base_settings(settings),
+  output_directory(directory),
+  output_suffix(suffix),
+  storage_format(SampleStore::Float32),
+  decode_cache_enabled(false),
+  next_file_index(0),
+  nb_loading_files(0),
+  nb_running_jobs(0),
+  nb_finished_jobs(0),
+  nb_failed_jobs(0),
+  rendered_duration(0)
+{
+  base_settings.parallel_channels = false; // Jobs already keep every core busy: stretchers must not start threads of their own
+  thread_pool.setMaxThreadCount(QThread::idealThreadCount()); // One job per core
+}
+
+
+// Destructor
+BatchProcessor::~BatchProcessor()
+{
+  thread_pool.waitForDone();
+}
+
+
+// Enable or disable the on-disk cache of decoded files
+void BatchProcessor::setDecodeCacheEnabled(bool enabled)
+{
+  decode_cache_enabled = enabled;
+}
+
+
+// Keep decoded samples as 16-bit integers (instead of float)
+void BatchProcessor::setReducedMemoryUsage(bool enabled)
+{
+  storage_format = enabled ? SampleStore::Int16 : SampleStore::Float32;
+}
+
+
+// Start processing files
+void BatchProcessor::start()
+{
+  batch_timer.start();
+  if (!output_directory.isEmpty())
+    QDir().mkpath(output_directory);
+  QTextStream(stdout) << QStringLiteral("Rendering %1 file(s) at %2 preset(s) with %3 job(s) at a time").arg(input_filenames.size()).arg(presets.size()).arg(thread_pool.maxThreadCount()) << Qt::endl;
+
+  loadNextFiles();
+  finishIfDone();
+}
+
+
+// Returns given files, with directories replaced by the audio files they contain
+QStringList BatchProcessor::listAudioFiles(const QStringList &paths)
+{
+  const QStringList audio_file_filters = {QStringLiteral("*.aac"), QStringLiteral("*.aif"), QStringLiteral("*.aiff"), QStringLiteral("*.flac"), QStringLiteral("*.m4a"), QStringLiteral("*.mp3"), QStringLiteral("*.ogg"), QStringLiteral("*.wav"), QStringLiteral("*.wma")};
+  QStringList filenames;
+
+  for (const QString &path : paths) {
+    const QFileInfo path_info(path);
+    if (path_info.isDir()) {
+      const QFileInfoList directory_files = QDir(path).entryInfoList(audio_file_filters, QDir::Files, QDir::Name | QDir::IgnoreCase);
+      for (const QFileInfo &file_info : directory_files)
+	filenames.append(file_info.absoluteFilePath());
+    }
+    else
+      filenames.append(path);
+  }
+  return filenames;
+}
+
+
+// Adds the jobs of a decoded file to the queue
+void BatchProcessor::enqueueJobs(const QString &filename, std::shared_ptr<const SampleStore> samples)
+{
+  for (const BatchProcessor::Preset &preset : presets) {
+    BatchProcessor::Job job{samples, filename, outputFilename(filename, preset), base_settings};
+    job.settings.setPitch(preset.pitch);
+    job.settings.setSpeed(preset.speed_ratio);
+    pending_jobs.enqueue(job);
+  }
+}
+
+
+// Emits finished() once all jobs have ended
+void BatchProcessor::finishIfDone()
+{
+  if ((next_file_index < input_filenames.size()) || (nb_loading_files > 0) || !pending_jobs.isEmpty() || (nb_running_jobs > 0))
+    return;
+
+  const qint64 elapsed_time = qMax(batch_timer.elapsed(), Q_INT64_C(1));
+  QTextStream(stdout) << QStringLiteral("%1 job(s) done, %2 failed, in %3 s (%4x realtime overall)").arg(nb_finished_jobs).arg(nb_failed_jobs).arg(elapsed_time / 1000.0, 0, 'f', 1).arg(rendered_duration / (elapsed_time * 1000.0), 0, 'f', 1) << Qt::endl;
+  emit finished(nb_failed_jobs);
+}
+
+
+// Reports the result of a job, and starts the next ones. Parameters: rendered duration in microseconds, rendering time in milliseconds
+void BatchProcessor::finishJob(const QString &input_filename, const QString &output_filename, qint64 duration, qint64 elapsed_time, const QString &error_message)
+{
+  nb_running_jobs--;
+  if (error_message.isEmpty()) {
+    nb_finished_jobs++;
+    rendered_duration += duration;
+    QTextStream(stdout) << QStringLiteral("%1 -> %2: %3 s rendered in %4 s (%5x realtime)").arg(QFileInfo(input_filename).fileName(), QFileInfo(output_filename).fileName()).arg(duration / 1000000.0, 0, 'f', 1).arg(elapsed_time / 1000.0, 0, 'f', 1).arg(duration / (qMax(elapsed_time, Q_INT64_C(1)) * 1000.0), 0, 'f', 1) << Qt::endl;
+  }
+  else {
+    nb_failed_jobs++;
+    reportFailure(output_filename, error_message);
+  }
+
+  startPendingJobs();
+  loadNextFiles();
+  finishIfDone();
+}
+
+
+// Starts decoding files while the job queue runs short
+void BatchProcessor::loadNextFiles()
+{
+  while ((next_file_index < input_filenames.size()) && (nb_loading_files < BATCH_MAX_LOADING_FILES) && (pending_jobs.size() < thread_pool.maxThreadCount())) {
+    const QString filename = input_filenames.at(next_file_index++);
+    AudioLoader *loader = new AudioLoader(filename, storage_format, this);
+    loader->setDecodeCacheEnabled(decode_cache_enabled);
+    connect(loader, &AudioLoader::finished, [this, loader, filename](){
+      nb_loading_files--;
+      enqueueJobs(filename, loader->getSamples());
+      loader->deleteLater();
+      startPendingJobs();
+      loadNextFiles();
+    });
+    connect(loader, &AudioLoader::decodingError, [this, loader, filename](QAudioDecoder::Error error){
+      nb_loading_files--;
+      nb_failed_jobs += static_cast<int>(presets.size());
+      loader->deleteLater();
+      reportFailure(filename, QStringLiteral("unable to decode file (error %1)").arg(static_cast<int>(error)));
+      loadNextFiles();
+      finishIfDone();
+    });
+    nb_loading_files++;
+    loader->start();
+  }
+}
+
+
+// Returns the name of the file rendered from given file at given preset
+QString BatchProcessor::outputFilename(const QString &filename, const BatchProcessor::Preset &preset) const
+{
+  const QFileInfo file_info(filename);
+  const QString directory = output_directory.isEmpty() ? file_info.absolutePath() : output_directory;
+  const QString pitch = ((preset.pitch > 0.0) ? QStringLiteral("+") : QString()) + QString::number(preset.pitch, 'g', 4);
+  return QDir(directory).filePath(QStringLiteral("%1_pitch%2_speed%3.%4").arg(file_info.completeBaseName(), pitch, QString::number(preset.speed_ratio, 'g', 4), output_suffix));
+}
+
+
+// Reports a file or a job that could not be processed
+void BatchProcessor::reportFailure(const QString &filename, const QString &error_message)
+{
+  QTextStream(stderr) << QStringLiteral("%1: %2").arg(filename, error_message) << Qt::endl;
+}
+
+
+// Starts queued jobs while some cores are idle
+void BatchProcessor::startPendingJobs()
+{
+  while ((nb_running_jobs < thread_pool.maxThreadCount()) && !pending_jobs.isEmpty()) {
+    const BatchProcessor::Job job = pending_jobs.dequeue();
+    nb_running_jobs++;
+    thread_pool.start([this, job](){
+      QElapsedTimer render_timer;
+      render_timer.start();
+      AudioExporter exporter(job.samples, job.settings, job.output_filename);
+      const QString error_message = exporter.render() ? QString() : exporter.errorString();
+      const qint64 elapsed_time = render_timer.elapsed();
+      const qint64 duration = static_cast<qint64>(static_cast<double>(job.samples->decodedDuration()) * job.settings.time_ratio);
+      QMetaObject::invokeMethod(this, [this, job, duration, elapsed_time, error_message](){ finishJob(job.input_filename, job.output_filename, duration, elapsed_time, error_message); }, Qt::QueuedConnection);
+    });
+  }
+}
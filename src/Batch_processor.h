@@ -0,0 +1,83 @@
+// Copyright 2026 François CROLLET
+
+// This file is part of VPS Player.
+// VPS Player is free software; you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation; either version 3 of the License, or (at your option) any later version.
+// VPS Player is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License along with VPS Player. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef BATCH_PROCESSOR_H
+#define BATCH_PROCESSOR_H
+
+#include <memory>
+#include <QElapsedTimer>
+#include <QList>
+#include <QObject>
+#include <QQueue>
+#include <QString>
+#include <QStringList>
+#include <QThreadPool>
+
+#include "Sample_store.h"
+#include "Stretcher_settings.h"
+
+
+// Renders a list of files at several pitch and speed presets without any window: one job (a file at a preset) runs per core, and files are decoded only when the job queue runs short, so that memory usage stays bounded
+class BatchProcessor : public QObject
+{
+  Q_OBJECT
+
+public:
+  struct Preset
+  {
+    double pitch; // Pitch change in semitones
+    double speed_ratio;
+  };
+
+private:
+  struct Job
+  {
+    std::shared_ptr<const SampleStore> samples;
+    QString input_filename;
+    QString output_filename;
+    StretcherSettings settings;
+  };
+
+  QStringList input_filenames;
+  QList<BatchProcessor::Preset> presets;
+  StretcherSettings base_settings;
+  QString output_directory;
+  QString output_suffix;
+  SampleStore::StorageFormat storage_format;
+  bool decode_cache_enabled;
+  QThreadPool thread_pool;
+  QQueue<BatchProcessor::Job> pending_jobs;
+  qsizetype next_file_index;
+  int nb_loading_files;
+  int nb_running_jobs;
+  int nb_finished_jobs;
+  int nb_failed_jobs;
+  qint64 rendered_duration;
+  QElapsedTimer batch_timer;
+
+public:
+  BatchProcessor(const QStringList &filenames, const QList<BatchProcessor::Preset> &preset_list, const StretcherSettings &settings, const QString &directory, const QString &suffix, QObject *parent = nullptr); // Constructor. Output files are written to given directory (next to input files if empty), with given suffix ("wav" or "flac")
+  ~BatchProcessor(); // Destructor
+  void setDecodeCacheEnabled(bool enabled); // Enable or disable the on-disk cache of decoded files
+  void setReducedMemoryUsage(bool enabled); // Keep decoded samples as 16-bit integers (instead of float)
+  void start(); // Start processing files
+  static QStringList listAudioFiles(const QStringList &paths); // Returns given files, with directories replaced by the audio files they contain
+
+private:
+  void enqueueJobs(const QString &filename, std::shared_ptr<const SampleStore> samples); // Adds the jobs of a decoded file to the queue
+  void finishIfDone(); // Emits finished() once all jobs have ended
+  void finishJob(const QString &input_filename, const QString &output_filename, qint64 duration, qint64 elapsed_time, const QString &error_message); // Reports the result of a job, and starts the next ones. Parameters: rendered duration in microseconds, rendering time in milliseconds
+  void loadNextFiles(); // Starts decoding files while the job queue runs short
+  QString outputFilename(const QString &filename, const BatchProcessor::Preset &preset) const; // Returns the name of the file rendered from given file at given preset
+  void reportFailure(const QString &filename, const QString &error_message); // Reports a file or a job that could not be processed
+  void startPendingJobs(); // Starts queued jobs while some cores are idle
+
+signals:
+  void finished(int); // This signal is emitted once all files have been processed. Parameter: number of jobs that failed
+};
+
+#endif
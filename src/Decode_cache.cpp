@@ -0,0 +1,117 @@
+// Copyright 2026 François CROLLET
+
+// This file is part of VPS Player.
+// VPS Player is free software; you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation; either version 3 of the License, or (at your option) any later version.
+// VPS Player is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License along with VPS Player. If not, see <http://www.gnu.org/licenses/>.
+
+#include <QtDebug>
+#include <QByteArray>
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QFileInfoList>
+#include <QSaveFile>
+#include <QStandardPaths>
+
+#include "Decode_cache.h"
+
+#define DECODE_CACHE_MAGIC 0x56505343 // "VPSC"
+#define DECODE_CACHE_VERSION 3
+#define DECODE_CACHE_HEADER_SIZE 4096 // Keeps the samples page-aligned in the file
+#define DECODE_CACHE_MAX_SIZE (Q_INT64_C(8) << 30) // Least recently used cache files are removed above this total size (in bytes)
+
+
+namespace DecodeCache
+{
+  QString cacheDirectory(); // Returns the directory containing cache files
+  QString cacheFilePath(const QFileInfo &file_info); // Returns the path of the cache file of given audio file
+  void pruneCache(); // Removes least recently used cache files until the cache fits its maximum size
+}
+
+
+// Returns a sample store mapped from the cache file of given audio file (nullptr if there is no valid cache file)
+std::shared_ptr<SampleStore> DecodeCache::load(const QString &filename)
+{
+  const QFileInfo file_info(filename);
+  auto cache_file = std::make_unique<QFile>(cacheFilePath(file_info));
+  if (!cache_file->open(QIODevice::ReadOnly))
+    return nullptr;
+
+  QDataStream header(cache_file->read(DECODE_CACHE_HEADER_SIZE));
+  quint32 magic, version, nb_channels, storage_format;
+  qint32 sample_rate;
+  qint64 nb_frames, source_size, source_modification_time;
+  header >> magic >> version >> nb_channels >> sample_rate >> storage_format >> nb_frames >> source_size >> source_modification_time;
+  if ((header.status() != QDataStream::Ok) || (magic != DECODE_CACHE_MAGIC) || (version != DECODE_CACHE_VERSION) || (nb_channels == 0) || (sample_rate <= 0) || (storage_format > static_cast<quint32>(SampleStore::Int16)) || (nb_frames <= 0)
+      || (source_size != file_info.size()) || (source_modification_time != file_info.lastModified().toMSecsSinceEpoch())) {
+    qDebug() << "Cache file is not valid for" << filename;
+    return nullptr;
+  }
+
+  auto samples = std::make_shared<SampleStore>(nb_channels, sample_rate, static_cast<SampleStore::StorageFormat>(storage_format));
+  if (!samples->mapFile(std::move(cache_file), DECODE_CACHE_HEADER_SIZE, nb_frames))
+    return nullptr;
+
+  cache_file = std::make_unique<QFile>(cacheFilePath(file_info)); // Touch the cache file so that it is considered recently used
+  if (cache_file->open(QIODevice::ReadWrite))
+    cache_file->setFileTime(QDateTime::currentDateTime(), QFileDevice::FileModificationTime);
+  return samples;
+}
+
+
+// Writes a complete sample store to the cache file of given audio file
+bool DecodeCache::save(const SampleStore &samples, const QString &filename)
+{
+  const QFileInfo file_info(filename);
+  if (!QDir().mkpath(cacheDirectory()))
+    return false;
+
+  QByteArray header_data;
+  {
+    QDataStream header(&header_data, QIODevice::WriteOnly);
+    header << static_cast<quint32>(DECODE_CACHE_MAGIC) << static_cast<quint32>(DECODE_CACHE_VERSION) << static_cast<quint32>(samples.channelCount()) << static_cast<qint32>(samples.sampleRate()) << static_cast<quint32>(samples.getStorageFormat())
+	   << samples.frameCount() << file_info.size() << file_info.lastModified().toMSecsSinceEpoch();
+  }
+  header_data.resize(DECODE_CACHE_HEADER_SIZE, '\0');
+
+  QSaveFile cache_file(cacheFilePath(file_info));
+  if (!cache_file.open(QIODevice::WriteOnly) || (cache_file.write(header_data) != header_data.size()) || !samples.writeChunks(cache_file) || !cache_file.commit()) {
+    qDebug() << "Unable to write cache file for" << filename;
+    return false;
+  }
+
+  pruneCache();
+  return true;
+}
+
+
+// Returns the directory containing cache files
+QString DecodeCache::cacheDirectory()
+{
+  return QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + QStringLiteral("/decoded");
+}
+
+
+// Returns the path of the cache file of given audio file
+QString DecodeCache::cacheFilePath(const QFileInfo &file_info)
+{
+  const QByteArray path_hash = QCryptographicHash::hash(file_info.absoluteFilePath().toUtf8(), QCryptographicHash::Sha1).toHex();
+  return cacheDirectory() + QLatin1Char('/') + QString::fromLatin1(path_hash) + QStringLiteral(".pcm");
+}
+
+
+// Removes least recently used cache files until the cache fits its maximum size
+void DecodeCache::pruneCache()
+{
+  const QFileInfoList cache_files = QDir(cacheDirectory()).entryInfoList({QStringLiteral("*.pcm")}, QDir::Files, QDir::Time); // Most recently modified first
+  qint64 total_size = 0;
+  for (const QFileInfo &cache_file : cache_files) {
+    total_size += cache_file.size();
+    if (total_size > DECODE_CACHE_MAX_SIZE)
+      QFile::remove(cache_file.absoluteFilePath());
+  }
+}
@@ -0,0 +1,24 @@
+// Copyright 2026 François CROLLET
+
+// This file is part of VPS Player.
+// VPS Player is free software; you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation; either version 3 of the License, or (at your option) any later version.
+// VPS Player is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License along with VPS Player. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef DECODE_CACHE_H
+#define DECODE_CACHE_H
+
+#include <memory>
+#include <QString>
+
+#include "Sample_store.h"
+
+
+// On-disk cache of decoded files: a cache file holds a small header followed by the sample store's chunks, so that it can be memory-mapped as is, and by the store's waveform overview
+namespace DecodeCache
+{
+  std::shared_ptr<SampleStore> load(const QString &filename); // Returns a sample store mapped from the cache file of given audio file (nullptr if there is no valid cache file)
+  bool save(const SampleStore &samples, const QString &filename); // Writes a complete sample store to the cache file of given audio file
+}
+
+#endif
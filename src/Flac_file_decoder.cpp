@@ -0,0 +1,544 @@
+// Copyright 2026 François CROLLET
+
+// This file is part of VPS Player.
+// VPS Player is free software; you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation; either version 3 of the License, or (at your option) any later version.
+// VPS Player is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License along with VPS Player. If not, see <http://www.gnu.org/licenses/>.
+
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <utility>
+#include <QtEndian>
+
+#include "Flac_file_decoder.h"
+
+#define FLAC_MAX_CHANNELS 8
+
+
+// Constructor
+FlacFileDecoder::FlacFileDecoder() : NativeDecoder(),
+				     file_data(nullptr),
+				     file_size(0),
+				     first_frame_offset(0),
+				     frame_offset(0),
+				     nb_channels(0),
+				     sample_rate(0),
+				     bits_per_sample(0),
+				     nb_frames(0),
+				     decoding_frame(0),
+				     min_block_size(0),
+				     max_block_size(0),
+				     byte_position(0),
+				     bit_buffer(0),
+				     nb_buffered_bits(0)
+{
+
+}
+
+
+// Destructor
+FlacFileDecoder::~FlacFileDecoder()
+{
+
+}
+
+
+// Returns the number of channels
+unsigned int FlacFileDecoder::channelCount() const
+{
+  return nb_channels;
+}
+
+
+// Decodes the next block of the file: points samples to its interleaved samples (valid until the next call) and sets their format. Returns the number of decoded frames (0 at the end of the file, -1 if the file is corrupt)
+qint64 FlacFileDecoder::decodeNextBlock(const void **samples, QAudioFormat::SampleFormat *sample_format)
+{
+  if ((nb_frames > 0) && (decoding_frame >= nb_frames))
+    return 0;
+  qint64 start_frame;
+  const int block_size = decodeFrame(frame_offset, &start_frame);
+  if (block_size <= 0) // Without any complete FLAC frame left, data following the last one (such as a tag, or a truncated FLAC frame) ends the file
+    return block_size;
+  frame_offset = currentByte();
+
+  const int shift = 32 - bits_per_sample;
+  for (unsigned int i = 0; i < nb_channels; i++) {
+    const qint32 *channel = channel_samples.get() + (i * max_block_size);
+    qint32 *output = interleaved_samples.get() + i;
+    for (int j = 0; j < block_size; j++)
+      output[j * nb_channels] = static_cast<qint32>(static_cast<quint32>(channel[j]) << shift);
+  }
+  *samples = interleaved_samples.get();
+  *sample_format = QAudioFormat::Int32;
+  decoding_frame += block_size;
+  return block_size;
+}
+
+
+// Returns the number of frames of the file (0 if unknown)
+qint64 FlacFileDecoder::frameCount() const
+{
+  return nb_frames;
+}
+
+
+// Opens given file and reads its headers. Returns false if it is not a FLAC file
+bool FlacFileDecoder::openFile(const QString &filename)
+{
+  file.setFileName(filename);
+  if (!file.open(QIODevice::ReadOnly))
+    return false;
+  file_size = file.size();
+  if (file_size < 42)
+    return false;
+  file_data = file.map(0, file_size);
+  if (file_data == nullptr)
+    return false;
+
+  qint64 offset = 0;
+  if (std::memcmp(file_data, "ID3", 3) == 0) { // ID3v2 tag preceding the stream: its size is coded on 4 bytes of 7 bits
+    offset = 10 + ((static_cast<qint64>(file_data[6] & 0x7F) << 21) | ((file_data[7] & 0x7F) << 14) | ((file_data[8] & 0x7F) << 7) | (file_data[9] & 0x7F));
+    if (file_data[5] & 0x10) // Footer
+      offset += 10;
+  }
+  if (((offset + 42) > file_size) || (std::memcmp(file_data + offset, "fLaC", 4) != 0))
+    return false;
+  offset += 4;
+
+  // Metadata blocks: only STREAMINFO and SEEKTABLE are needed
+  bool stream_info_read = false;
+  bool last_block = false;
+  while (!last_block) {
+    if ((offset + 4) > file_size)
+      return false;
+    const int block_type = file_data[offset] & 0x7F;
+    last_block = (file_data[offset] & 0x80) != 0;
+    const qint64 block_length = (static_cast<qint64>(file_data[offset + 1]) << 16) | (file_data[offset + 2] << 8) | file_data[offset + 3];
+    offset += 4;
+    if ((block_type == 0) && (block_length >= 34) && ((offset + 34) <= file_size)) {
+      seekBits(offset);
+      min_block_size = static_cast<int>(readBits(16));
+      max_block_size = static_cast<int>(readBits(16));
+      readBits(24); // Minimum frame size
+      readBits(24); // Maximum frame size
+      sample_rate = static_cast<int>(readBits(20));
+      nb_channels = readBits(3) + 1;
+      bits_per_sample = static_cast<int>(readBits(5)) + 1;
+      nb_frames = (static_cast<qint64>(readBits(4)) << 32) | readBits(32);
+      stream_info_read = true;
+    }
+    else if ((block_type == 3) && ((offset + block_length) <= file_size)) {
+      for (qint64 point_offset = offset; (point_offset + 18) <= (offset + block_length); point_offset += 18) {
+	const quint64 point_frame = qFromBigEndian<quint64>(file_data + point_offset);
+	if (point_frame != 0xFFFFFFFFFFFFFFFF) // Placeholder
+	  seek_points.append({static_cast<qint64>(point_frame), static_cast<qint64>(qFromBigEndian<quint64>(file_data + point_offset + 8))});
+      }
+    }
+    offset += block_length;
+  }
+  first_frame_offset = offset;
+  frame_offset = offset;
+
+  // 32-bit streams are left to QAudioDecoder
+  if (!stream_info_read || (sample_rate <= 0) || (nb_channels > FLAC_MAX_CHANNELS) || (bits_per_sample < 4) || (bits_per_sample > 24) || (max_block_size < 16))
+    return false;
+  channel_samples = std::make_unique<qint32[]>(max_block_size * nb_channels);
+  interleaved_samples = std::make_unique<qint32[]>(max_block_size * nb_channels);
+  return true;
+}
+
+
+// Returns the sample rate
+int FlacFileDecoder::sampleRate() const
+{
+  return sample_rate;
+}
+
+
+// Moves decoding to the FLAC frame given by the seek table, or to the first one found from the offset estimated from the mean bit rate. Returns the frame it starts at, or -1 if the file is not seekable
+qint64 FlacFileDecoder::seek(qint64 frame)
+{
+  if (frame <= 0) {
+    frame_offset = first_frame_offset;
+    decoding_frame = 0;
+    return 0;
+  }
+  if (nb_frames == 0)
+    return -1;
+
+  qint64 offset = first_frame_offset + static_cast<qint64>((static_cast<double>(file_size - first_frame_offset) * static_cast<double>(frame)) / static_cast<double>(nb_frames));
+  for (const FlacFileDecoder::SeekPoint &seek_point : std::as_const(seek_points)) {
+    if (seek_point.frame >= frame) {
+      offset = first_frame_offset + seek_point.offset;
+      break;
+    }
+  }
+  return findFrame(offset);
+}
+
+
+// Loads bytes into the bit buffer until it holds at least 57 bits (bytes past the end of the file read as zeros)
+inline void FlacFileDecoder::fillBitBuffer()
+{
+  if ((byte_position + 8) <= file_size) [[likely]] {
+    const int nb_new_bits = ((64 - nb_buffered_bits) / 8) * 8;
+    bit_buffer |= (qFromBigEndian<quint64>(file_data + byte_position) >> nb_buffered_bits) & (~static_cast<quint64>(0) << (64 - nb_buffered_bits - nb_new_bits));
+    byte_position += nb_new_bits / 8;
+    nb_buffered_bits += nb_new_bits;
+  }
+  else {
+    while (nb_buffered_bits <= 56) {
+      if (byte_position < file_size)
+	bit_buffer |= static_cast<quint64>(file_data[byte_position]) << (56 - nb_buffered_bits);
+      byte_position++;
+      nb_buffered_bits += 8;
+    }
+  }
+}
+
+
+// Reads an unsigned number of up to 32 bits
+inline quint32 FlacFileDecoder::readBits(int nb_bits)
+{
+  if (nb_bits == 0)
+    return 0;
+  if (nb_buffered_bits < nb_bits)
+    fillBitBuffer();
+
+  const quint32 value = static_cast<quint32>(bit_buffer >> (64 - nb_bits));
+  bit_buffer <<= nb_bits;
+  nb_buffered_bits -= nb_bits;
+  return value;
+}
+
+
+// Reads a two's complement number of up to 32 bits
+inline qint32 FlacFileDecoder::readSignedBits(int nb_bits)
+{
+  if (nb_bits == 0)
+    return 0;
+  return static_cast<qint32>(readBits(nb_bits) << (32 - nb_bits)) >> (32 - nb_bits);
+}
+
+
+// Reads a unary number: the count of zeros preceding the next one
+inline quint32 FlacFileDecoder::readUnary()
+{
+  quint32 value = 0;
+
+  while (true) {
+    if (nb_buffered_bits == 0) {
+      if (byte_position > file_size) [[unlikely]] // Only zeros are left
+	return value;
+      fillBitBuffer();
+    }
+    if (bit_buffer != 0) {
+      const int nb_zeros = std::countl_zero(bit_buffer);
+      bit_buffer <<= nb_zeros;
+      bit_buffer <<= 1;
+      nb_buffered_bits -= nb_zeros + 1;
+      return value + static_cast<quint32>(nb_zeros);
+    }
+    value += static_cast<quint32>(nb_buffered_bits);
+    nb_buffered_bits = 0;
+  }
+}
+
+
+// Skips the bits remaining in the current byte
+void FlacFileDecoder::alignToByte()
+{
+  const int nb_skipped_bits = nb_buffered_bits % 8;
+  bit_buffer <<= nb_skipped_bits;
+  nb_buffered_bits -= nb_skipped_bits;
+}
+
+
+// Returns the CRC-8 of given bytes of the file (that of FLAC frame headers)
+quint8 FlacFileDecoder::computeCrc8(qint64 begin, qint64 end) const
+{
+  quint32 crc = 0;
+  for (qint64 i = begin; i < end; i++) {
+    crc ^= file_data[i];
+    for (int j = 0; j < 8; j++)
+      crc = ((crc & 0x80) ? ((crc << 1) ^ 0x07) : (crc << 1)) & 0xFF;
+  }
+  return static_cast<quint8>(crc);
+}
+
+
+// Returns the CRC-16 of given bytes of the file (that of FLAC frames)
+quint16 FlacFileDecoder::computeCrc16(qint64 begin, qint64 end) const
+{
+  quint32 crc = 0;
+  for (qint64 i = begin; i < end; i++) {
+    crc ^= static_cast<quint32>(file_data[i]) << 8;
+    for (int j = 0; j < 8; j++)
+      crc = ((crc & 0x8000) ? ((crc << 1) ^ 0x8005) : (crc << 1)) & 0xFFFF;
+  }
+  return static_cast<quint16>(crc);
+}
+
+
+// Returns the offset of the byte being read
+qint64 FlacFileDecoder::currentByte() const
+{
+  return byte_position - (nb_buffered_bits / 8);
+}
+
+
+// Decodes the FLAC frame at given offset into channel_samples and sets the frame it starts at. Returns its block size (0 if there is no complete FLAC frame at this offset, -1 if it is corrupt)
+int FlacFileDecoder::decodeFrame(qint64 offset, qint64 *start_frame)
+{
+  if ((offset + 2) > file_size)
+    return 0;
+  seekBits(offset);
+
+  // Frame header
+  if (readBits(15) != 0x7FFC) // Sync code, then a reserved bit
+    return 0;
+  const bool variable_block_size = (readBits(1) == 1);
+  const int block_size_code = static_cast<int>(readBits(4));
+  const int sample_rate_code = static_cast<int>(readBits(4));
+  const int channel_assignment = static_cast<int>(readBits(4));
+  const int sample_size_code = static_cast<int>(readBits(3));
+  if (readBits(1) != 0)
+    return -1;
+  const quint8 first_number_byte = static_cast<quint8>(readBits(8)); // Number of the FLAC frame (or of its first frame if the block size is variable), UTF-8 coded
+  const int nb_number_bytes = std::countl_one(first_number_byte);
+  if ((nb_number_bytes == 1) || (nb_number_bytes > 7))
+    return -1;
+  qint64 number = first_number_byte & (0x7F >> nb_number_bytes);
+  for (int i = 1; i < nb_number_bytes; i++) {
+    const quint32 number_byte = readBits(8);
+    if ((number_byte & 0xC0) != 0x80)
+      return -1;
+    number = (number << 6) | (number_byte & 0x3F);
+  }
+  *start_frame = variable_block_size ? number : (number * max_block_size);
+
+  int block_size;
+  switch(block_size_code) {
+  case 0 :
+    return -1;
+  case 1 :
+    block_size = 192;
+    break;
+  case 6 :
+    block_size = static_cast<int>(readBits(8)) + 1;
+    break;
+  case 7 :
+    block_size = static_cast<int>(readBits(16)) + 1;
+    break;
+  default :
+    block_size = (block_size_code < 6) ? (576 << (block_size_code - 2)) : (256 << (block_size_code - 8));
+  }
+  if (sample_rate_code == 12)
+    readBits(8);
+  else if ((sample_rate_code == 13) || (sample_rate_code == 14))
+    readBits(16);
+  else if (sample_rate_code == 15)
+    return -1;
+
+  if (isExhausted())
+    return 0;
+  const quint8 crc = computeCrc8(offset, currentByte());
+  const int sample_sizes[8] = {0, 8, 12, 0, 16, 20, 24, 32};
+  const unsigned int nb_frame_channels = (channel_assignment < 8) ? static_cast<unsigned int>(channel_assignment + 1) : 2;
+  if ((readBits(8) != crc) || (channel_assignment > 10) || (nb_frame_channels != nb_channels) || ((sample_size_code != 0) && (sample_sizes[sample_size_code] != bits_per_sample)) || (block_size > max_block_size))
+    return -1;
+
+  // Subframes: the side channel of a stereo decorrelation has one more bit
+  for (unsigned int i = 0; i < nb_channels; i++) {
+    const bool side_channel = (channel_assignment == 9) ? (i == 0) : ((channel_assignment >= 8) && (i == 1));
+    if (!decodeSubframe(channel_samples.get() + (i * max_block_size), block_size, bits_per_sample + (side_channel ? 1 : 0)))
+      return isExhausted() ? 0 : -1;
+  }
+  alignToByte();
+  readBits(16); // CRC-16 of the frame
+  if (isExhausted()) // Truncated FLAC frame
+    return 0;
+  if (channel_assignment >= 8)
+    decorrelateChannels(channel_assignment, block_size);
+  return block_size;
+}
+
+
+// Reads the residual of a subframe into samples, after the warm-up samples. Returns false if it is corrupt
+bool FlacFileDecoder::decodeResidual(qint32 *samples, int block_size, int predictor_order)
+{
+  const quint32 coding_method = readBits(2);
+  if (coding_method > 1)
+    return false;
+  const int parameter_size = (coding_method == 0) ? 4 : 5;
+  const quint32 escape_code = (1u << parameter_size) - 1;
+  const int partition_order = static_cast<int>(readBits(4));
+  const int partition_size = block_size >> partition_order;
+  if (((partition_size << partition_order) != block_size) || (partition_size < predictor_order))
+    return false;
+
+  int sample = predictor_order;
+  for (int i = 0; i < (1 << partition_order); i++) {
+    const int partition_end = (i + 1) * partition_size;
+    const quint32 parameter = readBits(parameter_size);
+    if (parameter == escape_code) { // Unencoded partition
+      const int sample_size = static_cast<int>(readBits(5));
+      for (; sample < partition_end; sample++)
+	samples[sample] = readSignedBits(sample_size);
+    }
+    else {
+      for (; sample < partition_end; sample++) { // Rice coding of the zigzag-mapped residual
+	const quint32 value = (readUnary() << parameter) | readBits(static_cast<int>(parameter));
+	samples[sample] = static_cast<qint32>(value >> 1) ^ -static_cast<qint32>(value & 1);
+      }
+    }
+    if (isExhausted())
+      return false;
+  }
+  return true;
+}
+
+
+// Decodes a subframe into samples. Returns false if it is corrupt
+bool FlacFileDecoder::decodeSubframe(qint32 *samples, int block_size, int sample_size)
+{
+  if (readBits(1) != 0)
+    return false;
+  const int type = static_cast<int>(readBits(6));
+  int nb_wasted_bits = 0;
+  if (readBits(1) == 1)
+    nb_wasted_bits = static_cast<int>(readUnary()) + 1;
+  if (nb_wasted_bits >= sample_size)
+    return false;
+  sample_size -= nb_wasted_bits;
+
+  if (type == 0) // Constant
+    std::fill(samples, samples + block_size, readSignedBits(sample_size));
+  else if (type == 1) { // Verbatim
+    for (int i = 0; i < block_size; i++)
+      samples[i] = readSignedBits(sample_size);
+  }
+  else if ((type >= 8) && (type <= 12)) { // Fixed predictor
+    const int order = type - 8;
+    if (order > block_size)
+      return false;
+    for (int i = 0; i < order; i++)
+      samples[i] = readSignedBits(sample_size);
+    if (!decodeResidual(samples, block_size, order))
+      return false;
+    switch(order) {
+    case 1 :
+      for (int i = 1; i < block_size; i++)
+	samples[i] = static_cast<qint32>(static_cast<qint64>(samples[i]) + samples[i - 1]);
+      break;
+    case 2 :
+      for (int i = 2; i < block_size; i++)
+	samples[i] = static_cast<qint32>(samples[i] + (2 * static_cast<qint64>(samples[i - 1])) - samples[i - 2]);
+      break;
+    case 3 :
+      for (int i = 3; i < block_size; i++)
+	samples[i] = static_cast<qint32>(samples[i] + (3 * (static_cast<qint64>(samples[i - 1]) - samples[i - 2])) + samples[i - 3]);
+      break;
+    case 4 :
+      for (int i = 4; i < block_size; i++)
+	samples[i] = static_cast<qint32>(samples[i] + (4 * (static_cast<qint64>(samples[i - 1]) + samples[i - 3])) - (6 * static_cast<qint64>(samples[i - 2])) - samples[i - 4]);
+      break;
+    default :
+      break;
+    }
+  }
+  else if (type >= 32) { // Linear predictor
+    const int order = (type & 31) + 1;
+    if (order > block_size)
+      return false;
+    for (int i = 0; i < order; i++)
+      samples[i] = readSignedBits(sample_size);
+    const int precision = static_cast<int>(readBits(4)) + 1;
+    const int shift = readSignedBits(5);
+    if ((precision == 16) || (shift < 0))
+      return false;
+    qint32 coefficients[32];
+    for (int i = 0; i < order; i++)
+      coefficients[i] = readSignedBits(precision);
+    if (!decodeResidual(samples, block_size, order))
+      return false;
+    for (int i = order; i < block_size; i++) {
+      qint64 prediction = 0;
+      for (int j = 0; j < order; j++)
+	prediction += static_cast<qint64>(coefficients[j]) * samples[i - j - 1];
+      samples[i] = static_cast<qint32>(samples[i] + (prediction >> shift));
+    }
+  }
+  else
+    return false;
+
+  if (nb_wasted_bits > 0)
+    for (int i = 0; i < block_size; i++)
+      samples[i] = static_cast<qint32>(static_cast<quint32>(samples[i]) << nb_wasted_bits);
+  return true;
+}
+
+
+// Rebuilds left and right channels from the stereo decorrelation of the frame
+void FlacFileDecoder::decorrelateChannels(int channel_assignment, int block_size)
+{
+  qint32 *first_channel = channel_samples.get();
+  qint32 *second_channel = first_channel + max_block_size;
+
+  switch(channel_assignment) {
+  case 8 : // Left and side
+    for (int i = 0; i < block_size; i++)
+      second_channel[i] = static_cast<qint32>(static_cast<qint64>(first_channel[i]) - second_channel[i]);
+    break;
+  case 9 : // Side and right
+    for (int i = 0; i < block_size; i++)
+      first_channel[i] = static_cast<qint32>(static_cast<qint64>(first_channel[i]) + second_channel[i]);
+    break;
+  default : // Mid and side
+    for (int i = 0; i < block_size; i++) {
+      const qint64 side = second_channel[i];
+      const qint64 mid = (static_cast<qint64>(first_channel[i]) * 2) | (side & 1);
+      first_channel[i] = static_cast<qint32>((mid + side) >> 1);
+      second_channel[i] = static_cast<qint32>((mid - side) >> 1);
+    }
+  }
+}
+
+
+// Moves decoding to the first valid FLAC frame from given offset. Returns the frame it starts at, or -1 if there is none
+qint64 FlacFileDecoder::findFrame(qint64 offset)
+{
+  for (qint64 candidate = qMax(offset, first_frame_offset); (candidate + 2) <= file_size; candidate++) {
+    if ((file_data[candidate] != 0xFF) || ((file_data[candidate + 1] & 0xFE) != 0xF8))
+      continue;
+
+    // Sync codes may also appear within audio data: a FLAC frame is only trusted if its whole content matches its CRC-16
+    qint64 start_frame;
+    if ((decodeFrame(candidate, &start_frame) > 0) && (computeCrc16(candidate, currentByte()) == 0)) {
+      if (((file_data[candidate + 1] & 0x01) == 0) && (min_block_size != max_block_size)) // FLAC frames of fixed size are numbered: their position is only known if they all have the same size
+	return -1;
+      frame_offset = candidate;
+      decoding_frame = start_frame;
+      return start_frame;
+    }
+  }
+  return -1;
+}
+
+
+// Returns true if bits past the end of the file have been read
+bool FlacFileDecoder::isExhausted() const
+{
+  return ((byte_position - file_size) * 8) > nb_buffered_bits;
+}
+
+
+// Moves the bit reader to given byte of the file
+void FlacFileDecoder::seekBits(qint64 offset)
+{
+  byte_position = offset;
+  bit_buffer = 0;
+  nb_buffered_bits = 0;
+}
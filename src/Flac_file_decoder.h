@@ -0,0 +1,81 @@
+// Copyright 2026 François CROLLET
+
+// This file is part of VPS Player.
+// VPS Player is free software; you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation; either version 3 of the License, or (at your option) any later version.
+// VPS Player is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License along with VPS Player. If not, see <http://www.gnu.org/licenses/>.
+
+
+#ifndef FLAC_FILE_DECODER_H
+#define FLAC_FILE_DECODER_H
+
+#include <memory>
+#include <QAudioFormat>
+#include <QFile>
+#include <QList>
+#include <QString>
+
+#include "Native_decoder.h"
+
+
+// Decodes FLAC files (up to 24 bits per sample) from the memory-mapped file, one FLAC frame per block
+class FlacFileDecoder : public NativeDecoder
+{
+private:
+  struct SeekPoint
+  {
+    qint64 frame; // First frame of a FLAC frame
+    qint64 offset; // Offset of this FLAC frame from the first one
+  };
+
+  QFile file;
+  const uchar *file_data; // Mapped file
+  qint64 file_size;
+  qint64 first_frame_offset; // Offset of the first FLAC frame
+  qint64 frame_offset; // Offset of the next FLAC frame
+  unsigned int nb_channels;
+  int sample_rate;
+  int bits_per_sample;
+  qint64 nb_frames;
+  qint64 decoding_frame; // Frame the next FLAC frame starts at
+  int min_block_size;
+  int max_block_size;
+  QList<FlacFileDecoder::SeekPoint> seek_points;
+  std::unique_ptr<qint32[]> channel_samples; // Samples of the frame being decoded, channel after channel (max_block_size per channel)
+  std::unique_ptr<qint32[]> interleaved_samples; // Samples of the decoded frame, interleaved and left-justified
+
+  // Bit reader
+  qint64 byte_position; // Offset of the next byte loaded into bit_buffer
+  quint64 bit_buffer; // Bits not read yet, left-aligned (the following bits are zeros)
+  int nb_buffered_bits;
+
+public:
+  FlacFileDecoder(); // Constructor
+  ~FlacFileDecoder(); // Destructor
+  unsigned int channelCount() const override; // Returns the number of channels
+  qint64 decodeNextBlock(const void **samples, QAudioFormat::SampleFormat *sample_format) override; // Decodes the next block of the file: points samples to its interleaved samples (valid until the next call) and sets their format. Returns the number of decoded frames (0 at the end of the file, -1 if the file is corrupt)
+  qint64 frameCount() const override; // Returns the number of frames of the file (0 if unknown)
+  bool openFile(const QString &filename) override; // Opens given file and reads its headers. Returns false if it is not a FLAC file
+  int sampleRate() const override; // Returns the sample rate
+  qint64 seek(qint64 frame) override; // Moves decoding to the FLAC frame given by the seek table, or to the first one found from the offset estimated from the mean bit rate. Returns the frame it starts at, or -1 if the file is not seekable
+
+private:
+  inline void fillBitBuffer(); // Loads bytes into the bit buffer until it holds at least 57 bits (bytes past the end of the file read as zeros)
+  inline quint32 readBits(int nb_bits); // Reads an unsigned number of up to 32 bits
+  inline qint32 readSignedBits(int nb_bits); // Reads a two's complement number of up to 32 bits
+  inline quint32 readUnary(); // Reads a unary number: the count of zeros preceding the next one
+
+  void alignToByte(); // Skips the bits remaining in the current byte
+  quint8 computeCrc8(qint64 begin, qint64 end) const; // Returns the CRC-8 of given bytes of the file (that of FLAC frame headers)
+  quint16 computeCrc16(qint64 begin, qint64 end) const; // Returns the CRC-16 of given bytes of the file (that of FLAC frames)
+  qint64 currentByte() const; // Returns the offset of the byte being read
+  int decodeFrame(qint64 offset, qint64 *start_frame); // Decodes the FLAC frame at given offset into channel_samples and sets the frame it starts at. Returns its block size (0 if there is no complete FLAC frame at this offset, -1 if it is corrupt)
+  bool decodeResidual(qint32 *samples, int block_size, int predictor_order); // Reads the residual of a subframe into samples, after the warm-up samples. Returns false if it is corrupt
+  bool decodeSubframe(qint32 *samples, int block_size, int sample_size); // Decodes a subframe into samples. Returns false if it is corrupt
+  void decorrelateChannels(int channel_assignment, int block_size); // Rebuilds left and right channels from the stereo decorrelation of the frame
+  qint64 findFrame(qint64 offset); // Moves decoding to the first valid FLAC frame from given offset. Returns the frame it starts at, or -1 if there is none
+  bool isExhausted() const; // Returns true if bits past the end of the file have been read
+  void seekBits(qint64 offset); // Moves the bit reader to given byte of the file
+};
+
+#endif
@@ -0,0 +1,30 @@
+// Copyright 2026 François CROLLET
+
+// This file is part of VPS Player.
+// VPS Player is free software; you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation; either version 3 of the License, or (at your option) any later version.
+// VPS Player is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License along with VPS Player. If not, see <http://www.gnu.org/licenses/>.
+
+
+#include "Flac_file_decoder.h"
+#include "Native_decoder.h"
+#include "Pcm_file_decoder.h"
+
+
+// Destructor
+NativeDecoder::~NativeDecoder()
+{
+
+}
+
+
+// Returns a decoder having opened given file, or nullptr if its format is not natively supported (it is then left to QAudioDecoder)
+std::unique_ptr<NativeDecoder> NativeDecoder::create(const QString &filename)
+{
+  // Each decoder recognizes its format from the file's signature, whatever the name of the file
+  std::unique_ptr<NativeDecoder> decoders[] = {std::make_unique<PcmFileDecoder>(), std::make_unique<FlacFileDecoder>()};
+  for (std::unique_ptr<NativeDecoder> &decoder : decoders)
+    if (decoder->openFile(filename))
+      return std::move(decoder);
+  return nullptr;
+}
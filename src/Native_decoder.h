@@ -0,0 +1,31 @@
+// Copyright 2026 François CROLLET
+
+// This file is part of VPS Player.
+// VPS Player is free software; you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation; either version 3 of the License, or (at your option) any later version.
+// VPS Player is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License along with VPS Player. If not, see <http://www.gnu.org/licenses/>.
+
+
+#ifndef NATIVE_DECODER_H
+#define NATIVE_DECODER_H
+
+#include <memory>
+#include <QAudioFormat>
+#include <QString>
+
+
+// Decoder of an audio file format read directly, without any multimedia backend. Decoding is synchronous: it is meant to run in a worker thread, and several decoders of the same file can decode separate segments of it concurrently
+class NativeDecoder
+{
+public:
+  virtual ~NativeDecoder(); // Destructor
+  static std::unique_ptr<NativeDecoder> create(const QString &filename); // Returns a decoder having opened given file, or nullptr if its format is not natively supported (it is then left to QAudioDecoder)
+  virtual unsigned int channelCount() const = 0; // Returns the number of channels
+  virtual qint64 decodeNextBlock(const void **samples, QAudioFormat::SampleFormat *sample_format) = 0; // Decodes the next block of the file: points samples to its interleaved samples (valid until the next call) and sets their format. Returns the number of decoded frames (0 at the end of the file, -1 if the file is corrupt)
+  virtual qint64 frameCount() const = 0; // Returns the number of frames of the file (0 if unknown)
+  virtual bool openFile(const QString &filename) = 0; // Opens given file and reads its headers. Returns false if it is not a file this decoder supports
+  virtual int sampleRate() const = 0; // Returns the sample rate
+  virtual qint64 seek(qint64 frame) = 0; // Moves decoding to the start of a block near given frame. Returns the frame this block starts at (always the same for a given frame), or -1 if decoding cannot be moved there
+};
+
+#endif
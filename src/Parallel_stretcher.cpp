@@ -0,0 +1,197 @@
+// Copyright 2026 François CROLLET
+
+// This file is part of VPS Player.
+// VPS Player is free software; you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation; either version 3 of the License, or (at your option) any later version.
+// VPS Player is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License along with VPS Player. If not, see <http://www.gnu.org/licenses/>.
+
+#include <utility>
+
+#include "Parallel_stretcher.h"
+
+
+// Constructor. Channels are split across groups only if parallel_channels is true, worker_priority: priority of the threads processing the other groups than the first one
+ParallelStretcher::ParallelStretcher(size_t sample_rate, unsigned int channel_count, RubberBand::RubberBandStretcher::Options options, double time_ratio, double pitch_scale, bool parallel_channels, QThread::Priority worker_priority) :
+  nb_threads(1),
+  stopping(false),
+  block_input(nullptr),
+  block_size(0),
+  block_final(false),
+  block_studied(false)
+{
+  // Channels processed together stay in pairs, so that the stereo image of each pair is kept
+  const unsigned int group_size = parallel_channels ? (((options & RubberBand::RubberBandStretcher::OptionChannelsTogether) != 0) ? 2 : 1) : channel_count;
+  for (unsigned int first_channel = 0; first_channel < channel_count; first_channel += group_size) {
+    const unsigned int nb_group_channels = qMin(group_size, channel_count - first_channel);
+    groups.push_back({std::make_unique<RubberBand::RubberBandStretcher>(sample_rate, static_cast<size_t>(nb_group_channels), options, time_ratio, pitch_scale), first_channel});
+  }
+
+  nb_threads = static_cast<unsigned int>(qMin(static_cast<int>(groups.size()), QThread::idealThreadCount()));
+  if (nb_threads > 1) {
+    start_semaphores = std::make_unique<QSemaphore[]>(nb_threads - 1);
+    for (unsigned int i = 1; i < nb_threads; i++) { // The calling thread processes the groups of thread 0
+      QThread *worker = QThread::create(&ParallelStretcher::runWorker, this, i);
+      worker->setObjectName(QStringLiteral("Stretcher worker %1").arg(i));
+      worker->start(worker_priority);
+      workers.append(worker);
+    }
+  }
+}
+
+
+// Destructor
+ParallelStretcher::~ParallelStretcher()
+{
+  stopping.store(true, std::memory_order_relaxed);
+  for (unsigned int i = 1; i < nb_threads; i++)
+    start_semaphores[i - 1].release();
+  for (QThread *worker : std::as_const(workers)) {
+    worker->wait();
+    delete worker;
+  }
+}
+
+
+// Returns the number of frames that can be retrieved from all groups
+int ParallelStretcher::available() const
+{
+  int nb_available_frames = groups.front().stretcher->available();
+  for (size_t i = 1; i < groups.size(); i++)
+    nb_available_frames = qMin(nb_available_frames, groups[i].stretcher->available());
+  return nb_available_frames;
+}
+
+
+// Returns the number of frames to feed before the first real input frame
+size_t ParallelStretcher::getPreferredStartPad() const
+{
+  return groups.front().stretcher->getPreferredStartPad();
+}
+
+
+// Returns the number of output frames to drop after the start pad
+size_t ParallelStretcher::getStartDelay() const
+{
+  return groups.front().stretcher->getStartDelay();
+}
+
+
+// Returns the number of channel groups
+int ParallelStretcher::groupCount() const
+{
+  return static_cast<int>(groups.size());
+}
+
+
+// Processes an input block, each group in its worker thread
+void ParallelStretcher::process(const float *const *input, size_t nb_frames, bool final)
+{
+  dispatchBlock(input, nb_frames, final, false);
+}
+
+
+// Resets all groups
+void ParallelStretcher::reset()
+{
+  for (ParallelStretcher::ChannelGroup &group : groups)
+    group.stretcher->reset();
+}
+
+
+// Retrieves at most nb_frames frames from all groups. Returns the number of retrieved frames
+size_t ParallelStretcher::retrieve(float *const *output, size_t nb_frames)
+{
+  // Groups are retrieved in lockstep, so that channels stay aligned
+  nb_frames = qMin(nb_frames, static_cast<size_t>(qMax(available(), 0)));
+  for (ParallelStretcher::ChannelGroup &group : groups)
+    group.stretcher->retrieve(output + group.first_channel, nb_frames);
+  return nb_frames;
+}
+
+
+// Updates formant option of all groups
+void ParallelStretcher::setFormantOption(RubberBand::RubberBandStretcher::Options options)
+{
+  for (ParallelStretcher::ChannelGroup &group : groups)
+    group.stretcher->setFormantOption(options);
+}
+
+
+// Sets the maximum size of input blocks
+void ParallelStretcher::setMaxProcessSize(size_t nb_frames)
+{
+  for (ParallelStretcher::ChannelGroup &group : groups)
+    group.stretcher->setMaxProcessSize(nb_frames);
+}
+
+
+// Tells all groups how long the whole input is (offline mode)
+void ParallelStretcher::setExpectedInputDuration(size_t nb_frames)
+{
+  for (ParallelStretcher::ChannelGroup &group : groups)
+    group.stretcher->setExpectedInputDuration(nb_frames);
+}
+
+
+// Updates pitch scale of all groups
+void ParallelStretcher::setPitchScale(double pitch_scale)
+{
+  for (ParallelStretcher::ChannelGroup &group : groups)
+    group.stretcher->setPitchScale(pitch_scale);
+}
+
+
+// Updates time ratio of all groups
+void ParallelStretcher::setTimeRatio(double time_ratio)
+{
+  for (ParallelStretcher::ChannelGroup &group : groups)
+    group.stretcher->setTimeRatio(time_ratio);
+}
+
+
+// Studies an input block, each group in its worker thread (offline mode)
+void ParallelStretcher::study(const float *const *input, size_t nb_frames, bool final)
+{
+  dispatchBlock(input, nb_frames, final, true);
+}
+
+
+// Hands an input block over to the workers, processes the groups of the calling thread and waits for the workers
+void ParallelStretcher::dispatchBlock(const float *const *input, size_t nb_frames, bool final, bool studied)
+{
+  block_input = input;
+  block_size = nb_frames;
+  block_final = final;
+  block_studied = studied;
+
+  for (unsigned int i = 1; i < nb_threads; i++)
+    start_semaphores[i - 1].release();
+  processGroups(0);
+  if (nb_threads > 1)
+    done_semaphore.acquire(static_cast<int>(nb_threads - 1));
+}
+
+
+// Processes (or studies) the current input block for the groups handled by given thread
+void ParallelStretcher::processGroups(unsigned int thread_index)
+{
+  for (size_t i = thread_index; i < groups.size(); i += nb_threads) {
+    if (block_studied)
+      groups[i].stretcher->study(block_input + groups[i].first_channel, block_size, block_final);
+    else
+      groups[i].stretcher->process(block_input + groups[i].first_channel, block_size, block_final);
+  }
+}
+
+
+// Worker loop: processes a block each time one is ready
+void ParallelStretcher::runWorker(unsigned int thread_index)
+{
+  for (;;) {
+    start_semaphores[thread_index - 1].acquire();
+    if (stopping.load(std::memory_order_relaxed))
+      return;
+    processGroups(thread_index);
+    done_semaphore.release();
+  }
+}
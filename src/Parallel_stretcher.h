@@ -0,0 +1,64 @@
+// Copyright 2026 François CROLLET
+
+// This file is part of VPS Player.
+// VPS Player is free software; you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation; either version 3 of the License, or (at your option) any later version.
+// VPS Player is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License along with VPS Player. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef PARALLEL_STRETCHER_H
+#define PARALLEL_STRETCHER_H
+
+#include <rubberband/RubberBandStretcher.h>
+#include <atomic>
+#include <memory>
+#include <vector>
+#include <QList>
+#include <QSemaphore>
+#include <QThread>
+
+
+// Stretcher splitting channels (or channel pairs, if channels are processed together) across several stretchers fed from the same input block, each group being processed by its own worker thread. With a single group, it behaves as a plain stretcher
+class ParallelStretcher
+{
+private:
+  struct ChannelGroup
+  {
+    std::unique_ptr<RubberBand::RubberBandStretcher> stretcher;
+    unsigned int first_channel;
+  };
+
+  std::vector<ParallelStretcher::ChannelGroup> groups;
+  unsigned int nb_threads;
+  QList<QThread*> workers;
+  std::unique_ptr<QSemaphore[]> start_semaphores; // One per worker: released when a block is ready to be processed
+  QSemaphore done_semaphore; // Released by each worker once it has processed its groups
+  std::atomic<bool> stopping;
+  const float *const *block_input;
+  size_t block_size;
+  bool block_final;
+  bool block_studied; // The block is studied (offline mode) instead of being processed
+
+public:
+  ParallelStretcher(size_t sample_rate, unsigned int channel_count, RubberBand::RubberBandStretcher::Options options, double time_ratio, double pitch_scale, bool parallel_channels, QThread::Priority worker_priority = QThread::TimeCriticalPriority); // Constructor. Channels are split across groups only if parallel_channels is true, worker_priority: priority of the threads processing the other groups than the first one
+  ~ParallelStretcher(); // Destructor
+  int available() const; // Returns the number of frames that can be retrieved from all groups
+  size_t getPreferredStartPad() const; // Returns the number of frames to feed before the first real input frame
+  size_t getStartDelay() const; // Returns the number of output frames to drop after the start pad
+  int groupCount() const; // Returns the number of channel groups
+  void process(const float *const *input, size_t nb_frames, bool final); // Processes an input block, each group in its worker thread
+  void reset(); // Resets all groups
+  size_t retrieve(float *const *output, size_t nb_frames); // Retrieves at most nb_frames frames from all groups. Returns the number of retrieved frames
+  void setFormantOption(RubberBand::RubberBandStretcher::Options options); // Updates formant option of all groups
+  void setMaxProcessSize(size_t nb_frames); // Sets the maximum size of input blocks
+  void setExpectedInputDuration(size_t nb_frames); // Tells all groups how long the whole input is (offline mode)
+  void setPitchScale(double pitch_scale); // Updates pitch scale of all groups
+  void setTimeRatio(double time_ratio); // Updates time ratio of all groups
+  void study(const float *const *input, size_t nb_frames, bool final); // Studies an input block, each group in its worker thread (offline mode)
+
+private:
+  void dispatchBlock(const float *const *input, size_t nb_frames, bool final, bool studied); // Hands an input block over to the workers, processes the groups of the calling thread and waits for the workers
+  void processGroups(unsigned int thread_index); // Processes (or studies) the current input block for the groups handled by given thread
+  void runWorker(unsigned int thread_index); // Worker loop: processes a block each time one is ready
+};
+
+#endif
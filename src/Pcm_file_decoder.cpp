@@ -0,0 +1,372 @@
+// Copyright 2026 François CROLLET
+
+// This file is part of VPS Player.
+// VPS Player is free software; you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation; either version 3 of the License, or (at your option) any later version.
+// VPS Player is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License along with VPS Player. If not, see <http://www.gnu.org/licenses/>.
+
+
+#include <cmath>
+#include <cstring>
+#include <QByteArray>
+#include <QSysInfo>
+#include <QtEndian>
+
+#include "Pcm_file_decoder.h"
+
+#define PCM_DECODING_BLOCK_FRAMES 16384 // Frames appended to the store at once
+#define PCM_MAX_CHANNELS 64
+
+
+// Constructor
+PcmFileDecoder::PcmFileDecoder() : NativeDecoder(),
+				   audio_data(nullptr),
+				   audio_data_offset(0),
+				   nb_frames(0),
+				   decoding_frame(0),
+				   nb_channels(0),
+				   sample_rate(0),
+				   sample_encoding(PcmFileDecoder::Int16),
+				   big_endian(false),
+				   bytes_per_sample(2),
+				   direct_format(QAudioFormat::Unknown)
+{
+
+}
+
+
+// Destructor
+PcmFileDecoder::~PcmFileDecoder()
+{
+
+}
+
+
+// Returns the number of channels
+unsigned int PcmFileDecoder::channelCount() const
+{
+  return nb_channels;
+}
+
+
+// Decodes the next block of the file: points samples to its interleaved samples (valid until the next call) and sets their format. Returns the number of decoded frames (0 at the end of the file, -1 if the file is corrupt)
+qint64 PcmFileDecoder::decodeNextBlock(const void **samples, QAudioFormat::SampleFormat *sample_format)
+{
+  const qint64 nb_block_frames = qMin(static_cast<qint64>(PCM_DECODING_BLOCK_FRAMES), nb_frames - decoding_frame);
+  if (nb_block_frames <= 0)
+    return 0;
+
+  const uchar *block_data = audio_data + (decoding_frame * nb_channels * bytes_per_sample);
+  if (direct_format != QAudioFormat::Unknown) {
+    *samples = block_data;
+    *sample_format = direct_format;
+  }
+  else if ((sample_encoding == PcmFileDecoder::Float32) || (sample_encoding == PcmFileDecoder::Float64)) {
+    convertToFloat(block_data, nb_block_frames * nb_channels);
+    *samples = float_samples.get();
+    *sample_format = QAudioFormat::Float;
+  }
+  else {
+    convertToInt32(block_data, nb_block_frames * nb_channels);
+    *samples = integer_samples.get();
+    *sample_format = QAudioFormat::Int32;
+  }
+
+  decoding_frame += nb_block_frames;
+  return nb_block_frames;
+}
+
+
+// Returns the number of frames of the file (0 if unknown)
+qint64 PcmFileDecoder::frameCount() const
+{
+  return nb_frames;
+}
+
+
+// Opens given file and reads its headers. Returns false if it is not an uncompressed WAV or AIFF file
+bool PcmFileDecoder::openFile(const QString &filename)
+{
+  file.setFileName(filename);
+  if (!file.open(QIODevice::ReadOnly))
+    return false;
+
+  const QByteArray header = file.read(12);
+  if (header.size() < 12)
+    return false;
+  const QByteArray container_id = header.left(4);
+  const QByteArray form_type = header.mid(8, 4);
+  bool headers_valid = false;
+  if (((container_id == "RIFF") || (container_id == "RF64")) && (form_type == "WAVE"))
+    headers_valid = readWaveHeaders(container_id == "RF64");
+  else if ((container_id == "FORM") && ((form_type == "AIFF") || (form_type == "AIFC")))
+    headers_valid = readAiffHeaders(form_type == "AIFC");
+  if (!headers_valid || (nb_channels == 0) || (nb_channels > PCM_MAX_CHANNELS) || (sample_rate <= 0) || (nb_frames <= 0))
+    return false;
+
+  audio_data = file.map(audio_data_offset, nb_frames * nb_channels * bytes_per_sample);
+  if (audio_data == nullptr)
+    return false;
+
+  // Samples already in a format the store accepts are deinterleaved straight from the mapped file
+  const bool native_byte_order = (big_endian == (QSysInfo::ByteOrder == QSysInfo::BigEndian)) || (bytes_per_sample == 1);
+  const bool aligned = (reinterpret_cast<quintptr>(audio_data) % static_cast<quintptr>(bytes_per_sample)) == 0;
+  if (native_byte_order && aligned) {
+    switch(sample_encoding) {
+    case PcmFileDecoder::UInt8 :
+      direct_format = QAudioFormat::UInt8;
+      break;
+    case PcmFileDecoder::Int16 :
+      direct_format = QAudioFormat::Int16;
+      break;
+    case PcmFileDecoder::Int32 :
+      direct_format = QAudioFormat::Int32;
+      break;
+    case PcmFileDecoder::Float32 :
+      direct_format = QAudioFormat::Float;
+      break;
+    default :
+      break;
+    }
+  }
+  if (direct_format == QAudioFormat::Unknown) {
+    if ((sample_encoding == PcmFileDecoder::Float32) || (sample_encoding == PcmFileDecoder::Float64))
+      float_samples = std::make_unique<float[]>(PCM_DECODING_BLOCK_FRAMES * nb_channels);
+    else
+      integer_samples = std::make_unique<qint32[]>(PCM_DECODING_BLOCK_FRAMES * nb_channels);
+  }
+  return true;
+}
+
+
+// Returns the sample rate
+int PcmFileDecoder::sampleRate() const
+{
+  return sample_rate;
+}
+
+
+// Moves decoding to the start of the first block from given frame. Returns the frame this block starts at
+qint64 PcmFileDecoder::seek(qint64 frame)
+{
+  // Blocks start on a grid of PCM_DECODING_BLOCK_FRAMES frames, so that blocks decoded from different positions never overlap
+  decoding_frame = qMin(((qMax(frame, static_cast<qint64>(0)) + PCM_DECODING_BLOCK_FRAMES - 1) / PCM_DECODING_BLOCK_FRAMES) * PCM_DECODING_BLOCK_FRAMES, nb_frames);
+  return decoding_frame;
+}
+
+
+// Converts samples of the mapped data to float, into float_samples
+void PcmFileDecoder::convertToFloat(const uchar *data, qint64 nb_samples)
+{
+  float *output = float_samples.get();
+
+  if (sample_encoding == PcmFileDecoder::Float32) {
+    for (qint64 i = 0; i < nb_samples; i++) {
+      const quint32 bits = big_endian ? qFromBigEndian<quint32>(data + (i * 4)) : qFromLittleEndian<quint32>(data + (i * 4));
+      std::memcpy(output + i, &bits, sizeof(float));
+    }
+  }
+  else {
+    for (qint64 i = 0; i < nb_samples; i++) {
+      const quint64 bits = big_endian ? qFromBigEndian<quint64>(data + (i * 8)) : qFromLittleEndian<quint64>(data + (i * 8));
+      double sample;
+      std::memcpy(&sample, &bits, sizeof(double));
+      output[i] = static_cast<float>(sample);
+    }
+  }
+}
+
+
+// Converts samples of the mapped data to 32-bit integers, into integer_samples
+void PcmFileDecoder::convertToInt32(const uchar *data, qint64 nb_samples)
+{
+  qint32 *output = integer_samples.get();
+
+  // Samples are left-justified, so that they keep their full scale
+  switch(sample_encoding) {
+  case PcmFileDecoder::UInt8 :
+    for (qint64 i = 0; i < nb_samples; i++)
+      output[i] = static_cast<qint32>((static_cast<quint32>(data[i]) << 24) ^ 0x80000000u);
+    break;
+  case PcmFileDecoder::Int8 :
+    for (qint64 i = 0; i < nb_samples; i++)
+      output[i] = static_cast<qint32>(static_cast<quint32>(data[i]) << 24);
+    break;
+  case PcmFileDecoder::Int16 :
+    for (qint64 i = 0; i < nb_samples; i++)
+      output[i] = static_cast<qint32>(static_cast<quint32>(big_endian ? qFromBigEndian<quint16>(data + (i * 2)) : qFromLittleEndian<quint16>(data + (i * 2))) << 16);
+    break;
+  case PcmFileDecoder::Int24 :
+    for (qint64 i = 0; i < nb_samples; i++) {
+      const uchar *sample = data + (i * 3);
+      const quint32 bytes = big_endian ? ((static_cast<quint32>(sample[0]) << 16) | (static_cast<quint32>(sample[1]) << 8) | sample[2]) : ((static_cast<quint32>(sample[2]) << 16) | (static_cast<quint32>(sample[1]) << 8) | sample[0]);
+      output[i] = static_cast<qint32>(bytes << 8);
+    }
+    break;
+  default :
+    for (qint64 i = 0; i < nb_samples; i++)
+      output[i] = big_endian ? qFromBigEndian<qint32>(data + (i * 4)) : qFromLittleEndian<qint32>(data + (i * 4));
+  }
+}
+
+
+// Reads the chunks of an AIFF (or AIFF-C) file preceding its audio data. Returns false if the file is not supported
+bool PcmFileDecoder::readAiffHeaders(bool compressed_format)
+{
+  qint64 position = 12;
+  qint64 nb_common_frames = -1;
+
+  while (file.seek(position)) {
+    const QByteArray chunk_header = file.read(8);
+    if (chunk_header.size() < 8)
+      return false;
+    const QByteArray chunk_id = chunk_header.left(4);
+    const qint64 chunk_size = qFromBigEndian<quint32>(chunk_header.constData() + 4);
+
+    if (chunk_id == "COMM") {
+      const QByteArray common = file.read(qMin(chunk_size, static_cast<qint64>(22)));
+      if (common.size() < (compressed_format ? 22 : 18))
+	return false;
+      nb_channels = qFromBigEndian<quint16>(common.constData());
+      nb_common_frames = qFromBigEndian<quint32>(common.constData() + 2);
+      const int sample_size = qFromBigEndian<qint16>(common.constData() + 6);
+      // The sample rate is an 80-bit extended precision number: sign and 15-bit exponent, then a 64-bit mantissa with an explicit integer bit
+      const int exponent = qFromBigEndian<quint16>(common.constData() + 8) & 0x7FFF;
+      sample_rate = static_cast<int>(std::lround(std::ldexp(static_cast<double>(qFromBigEndian<quint64>(common.constData() + 10)), exponent - 16383 - 63)));
+
+      const QByteArray compression_type = compressed_format ? common.mid(18, 4) : QByteArray("NONE");
+      big_endian = (compression_type != "sowt");
+      if ((compression_type == "NONE") || (compression_type == "twos") || (compression_type == "sowt")) {
+	bytes_per_sample = (sample_size + 7) / 8;
+	switch(bytes_per_sample) {
+	case 1 :
+	  sample_encoding = PcmFileDecoder::Int8;
+	  break;
+	case 2 :
+	  sample_encoding = PcmFileDecoder::Int16;
+	  break;
+	case 3 :
+	  sample_encoding = PcmFileDecoder::Int24;
+	  break;
+	case 4 :
+	  sample_encoding = PcmFileDecoder::Int32;
+	  break;
+	default :
+	  return false;
+	}
+      }
+      else if ((compression_type == "fl32") || (compression_type == "FL32")) {
+	sample_encoding = PcmFileDecoder::Float32;
+	bytes_per_sample = 4;
+      }
+      else if ((compression_type == "fl64") || (compression_type == "FL64")) {
+	sample_encoding = PcmFileDecoder::Float64;
+	bytes_per_sample = 8;
+      }
+      else
+	return false;
+    }
+    else if (chunk_id == "SSND") {
+      const QByteArray sound_data_header = file.read(8);
+      if ((nb_common_frames < 0) || (nb_channels == 0) || (sound_data_header.size() < 8))
+	return false;
+      audio_data_offset = position + 16 + qFromBigEndian<quint32>(sound_data_header.constData());
+      const qint64 data_size = qMin(chunk_size - 8, file.size() - position - 16) - (audio_data_offset - position - 16);
+      nb_frames = qMin(nb_common_frames, data_size / (nb_channels * bytes_per_sample));
+      return true;
+    }
+
+    position += 8 + chunk_size + (chunk_size & 1);
+  }
+  return false;
+}
+
+
+// Reads the chunks of a WAV (or RF64) file preceding its audio data. Returns false if the file is not supported
+bool PcmFileDecoder::readWaveHeaders(bool rf64_format)
+{
+  qint64 position = 12;
+  qint64 rf64_data_size = -1;
+  bool format_read = false;
+
+  while (file.seek(position)) {
+    const QByteArray chunk_header = file.read(8);
+    if (chunk_header.size() < 8)
+      return false;
+    const QByteArray chunk_id = chunk_header.left(4);
+    qint64 chunk_size = qFromLittleEndian<quint32>(chunk_header.constData() + 4);
+
+    if ((chunk_id == "ds64") && rf64_format) { // Sizes of RF64 files, which may not fit in 32 bits
+      const QByteArray sizes = file.read(16);
+      if (sizes.size() < 16)
+	return false;
+      rf64_data_size = static_cast<qint64>(qFromLittleEndian<quint64>(sizes.constData() + 8));
+    }
+    else if (chunk_id == "fmt ") {
+      const QByteArray format = file.read(qMin(chunk_size, static_cast<qint64>(26)));
+      if (format.size() < 16)
+	return false;
+      int format_tag = qFromLittleEndian<quint16>(format.constData());
+      if ((format_tag == 0xFFFE) && (format.size() >= 26)) // WAVE_FORMAT_EXTENSIBLE: the actual format tag starts the subformat GUID
+	format_tag = qFromLittleEndian<quint16>(format.constData() + 24);
+      nb_channels = qFromLittleEndian<quint16>(format.constData() + 2);
+      sample_rate = static_cast<int>(qFromLittleEndian<quint32>(format.constData() + 4));
+      const int block_align = qFromLittleEndian<quint16>(format.constData() + 12);
+      if (!setWaveEncoding(format_tag, qFromLittleEndian<quint16>(format.constData() + 14)) || (block_align != static_cast<int>(nb_channels * bytes_per_sample)))
+	return false;
+      format_read = true;
+    }
+    else if (chunk_id == "data") {
+      if (!format_read || (nb_channels == 0))
+	return false;
+      if (rf64_format && (chunk_size == 0xFFFFFFFF) && (rf64_data_size >= 0))
+	chunk_size = rf64_data_size;
+      audio_data_offset = position + 8;
+      nb_frames = qMin(chunk_size, file.size() - audio_data_offset) / (nb_channels * bytes_per_sample); // Files being recorded may be shorter than announced
+      return true;
+    }
+
+    position += 8 + chunk_size + (chunk_size & 1);
+  }
+  return false;
+}
+
+
+// Sets the sample encoding from WAV format tag and sample size. Returns false if the encoding is not supported
+bool PcmFileDecoder::setWaveEncoding(int format_tag, int bits_per_sample)
+{
+  big_endian = false;
+  bytes_per_sample = bits_per_sample / 8;
+
+  if (format_tag == 1) { // PCM
+    switch(bits_per_sample) {
+    case 8 :
+      sample_encoding = PcmFileDecoder::UInt8;
+      return true;
+    case 16 :
+      sample_encoding = PcmFileDecoder::Int16;
+      return true;
+    case 24 :
+      sample_encoding = PcmFileDecoder::Int24;
+      return true;
+    case 32 :
+      sample_encoding = PcmFileDecoder::Int32;
+      return true;
+    default :
+      return false;
+    }
+  }
+  if (format_tag == 3) { // IEEE float
+    switch(bits_per_sample) {
+    case 32 :
+      sample_encoding = PcmFileDecoder::Float32;
+      return true;
+    case 64 :
+      sample_encoding = PcmFileDecoder::Float64;
+      return true;
+    default :
+      return false;
+    }
+  }
+  return false;
+}
@@ -0,0 +1,68 @@
+// Copyright 2026 François CROLLET
+
+// This file is part of VPS Player.
+// VPS Player is free software; you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation; either version 3 of the License, or (at your option) any later version.
+// VPS Player is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License along with VPS Player. If not, see <http://www.gnu.org/licenses/>.
+
+
+#ifndef PCM_FILE_DECODER_H
+#define PCM_FILE_DECODER_H
+
+#include <memory>
+#include <QAudioFormat>
+#include <QFile>
+#include <QString>
+
+#include "Native_decoder.h"
+
+
+// Reads uncompressed WAV (including RF64 and WAVE_FORMAT_EXTENSIBLE) and AIFF/AIFF-C files: audio data is memory-mapped and handed as is to the sample store, converted on the way only if its encoding is not one the store accepts
+class PcmFileDecoder : public NativeDecoder
+{
+public:
+  enum SampleEncoding
+    {
+     UInt8 = 0,
+     Int8 = 1,
+     Int16 = 2,
+     Int24 = 3,
+     Int32 = 4,
+     Float32 = 5,
+     Float64 = 6
+    };
+
+private:
+  QFile file;
+  const uchar *audio_data; // Mapped audio data
+  qint64 audio_data_offset;
+  qint64 nb_frames;
+  qint64 decoding_frame; // Frame the next block starts at
+  unsigned int nb_channels;
+  int sample_rate;
+  PcmFileDecoder::SampleEncoding sample_encoding;
+  bool big_endian;
+  qint64 bytes_per_sample;
+  QAudioFormat::SampleFormat direct_format; // Format in which mapped data can be appended to the store as is (Unknown if it has to be converted)
+  std::unique_ptr<qint32[]> integer_samples; // Conversion buffer for integer encodings...
+  std::unique_ptr<float[]> float_samples; // ... and for floating point encodings
+
+public:
+  PcmFileDecoder(); // Constructor
+  ~PcmFileDecoder(); // Destructor
+  unsigned int channelCount() const override; // Returns the number of channels
+  qint64 decodeNextBlock(const void **samples, QAudioFormat::SampleFormat *sample_format) override; // Decodes the next block of the file: points samples to its interleaved samples (valid until the next call) and sets their format. Returns the number of decoded frames (0 at the end of the file, -1 if the file is corrupt)
+  qint64 frameCount() const override; // Returns the number of frames of the file (0 if unknown)
+  bool openFile(const QString &filename) override; // Opens given file and reads its headers. Returns false if it is not an uncompressed WAV or AIFF file
+  int sampleRate() const override; // Returns the sample rate
+  qint64 seek(qint64 frame) override; // Moves decoding to the start of the first block from given frame. Returns the frame this block starts at
+
+private:
+  void convertToFloat(const uchar *data, qint64 nb_samples); // Converts samples of the mapped data to float, into float_samples
+  void convertToInt32(const uchar *data, qint64 nb_samples); // Converts samples of the mapped data to 32-bit integers, into integer_samples
+  bool readAiffHeaders(bool compressed_format); // Reads the chunks of an AIFF (or AIFF-C) file preceding its audio data. Returns false if the file is not supported
+  bool readWaveHeaders(bool rf64_format); // Reads the chunks of a WAV (or RF64) file preceding its audio data. Returns false if the file is not supported
+  bool setWaveEncoding(int format_tag, int bits_per_sample); // Sets the sample encoding from WAV format tag and sample size. Returns false if the encoding is not supported
+};
+
+#endif
@@ -0,0 +1,28 @@
+// Copyright 2026 François CROLLET
+
+// This file is part of VPS Player.
+// VPS Player is free software; you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation; either version 3 of the License, or (at your option) any later version.
+// VPS Player is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License along with VPS Player. If not, see <http://www.gnu.org/licenses/>.
+
+
+#ifndef PLAYBACK_STATISTICS_H
+#define PLAYBACK_STATISTICS_H
+
+#include <QtGlobal>
+
+
+// Performance counters of live playing, reported periodically to find out why a given file or setting combination glitches
+struct PlaybackStatistics
+{
+  int nb_underruns = 0; // Times the audio device asked for audio while none was rendered, since playing started
+  double mean_processing_time = 0.0; // Mean time spent stretching a slice of decoded audio since the previous report, in microseconds
+  double peak_processing_time = 0.0; // Longest time spent stretching a slice of decoded audio since the previous report, in microseconds
+  double realtime_factor = 0.0; // Duration of the audio rendered since the previous report over the time spent rendering it (0 if nothing has been rendered)
+  int queued_duration = 0; // Stretched audio rendered ahead of playback, in milliseconds
+  int min_sink_fill_level = 0; // Lowest fill level of the audio sink's buffer when it asked for audio since the previous report, in percent
+  int latency = 0; // End-to-end output latency (sink's buffer plus stretcher's delay), in milliseconds
+  qint64 decoded_memory = 0; // Memory used by decoded samples, in bytes
+};
+
+#endif
@@ -29,7 +29,7 @@
 
 
 // Constructor
-PlayerWindow::PlayerWindow(const QIcon &app_icon, const QString &filename)
+PlayerWindow::PlayerWindow(const QIcon &app_icon, const QString &filename, bool decode_cache, bool reduced_memory, int render_ahead, int latency)
 {
   audio_player = new AudioPlayer(this);
 
@@ -42,6 +42,21 @@ PlayerWindow::PlayerWindow(const QIcon &app_icon, const QString &filename)
   QMenu *menu_file = menu_bar->addMenu("&File");
   QMenu *menu_help = menu_bar->addMenu(QStringLiteral("&?"));
   action_open = menu_file->addAction(open_icon, "&Open", QKeySequence(QStringLiteral("Ctrl+O")), this, &PlayerWindow::openFileFromSelector);
+  action_export = menu_file->addAction(QIcon::fromTheme(QIcon::ThemeIcon::DocumentSaveAs), "&Export...", QKeySequence(QStringLiteral("Ctrl+E")), this, &PlayerWindow::exportFileFromSelector);
+  action_export->setToolTip("Render the whole file with current pitch, speed and options to a WAV or FLAC file");
+  menu_file->addSeparator();
+  QAction *action_decode_cache = menu_file->addAction("Keep decoded files in &cache");
+  action_decode_cache->setCheckable(true);
+  action_decode_cache->setToolTip("Decoded audio is written to disk, so that reopening the same file is almost instant");
+  QAction *action_reduced_memory = menu_file->addAction("&Reduced memory usage (16-bit samples)");
+  action_reduced_memory->setCheckable(true);
+  action_reduced_memory->setToolTip("Decoded audio is kept as 16-bit integers instead of floating point numbers, which halves memory usage for long recordings. Applies to files opened afterwards");
+  QAction *action_noise_shaping = menu_file->addAction("&Noise-shaped dither (16-bit output)");
+  action_noise_shaping->setCheckable(true);
+  action_noise_shaping->setToolTip("Quantization noise is moved toward high frequencies, where it is less audible. Only used with sound cards accepting neither floating point nor 32-bit samples");
+  QAction *action_statistics = menu_file->addAction("Show performance &statistics");
+  action_statistics->setCheckable(true);
+  action_statistics->setToolTip("Displays dropouts, processing time, audio rendered ahead, sound card buffer level, latency and memory usage while playing, to find out why a file or a setting combination glitches");
   menu_file->addSeparator();
   menu_file->addAction(QIcon::fromTheme(QIcon::ThemeIcon::WindowClose), "&Quit", QKeySequence(QStringLiteral("Ctrl+Q")), this, &PlayerWindow::close);
   menu_help->addAction(app_icon, "&About", this, &PlayerWindow::showAbout);
@@ -50,8 +65,11 @@ PlayerWindow::PlayerWindow(const QIcon &app_icon, const QString &filename)
   label_status = new QLabel;
   label_loading_progress = new QLabel;
   label_loading_progress->setFont(fixed_font);
+  label_latency = new QLabel;
+  label_latency->setToolTip("Delay before a settings change is heard: audio buffered by the sound card and still queued for it, plus the stretcher's delay (pausing and seeking are heard sooner)");
   QStatusBar *status_bar = statusBar();
   status_bar->addWidget(label_status, 1);
+  status_bar->addPermanentWidget(label_latency, 0);
   status_bar->addPermanentWidget(label_loading_progress, 0);
   
   QLabel *label_pitch = new QLabel("Pitch");
@@ -103,10 +121,17 @@ PlayerWindow::PlayerWindow(const QIcon &app_icon, const QString &filename)
   combobox_engine->addItem("Rubber Band R2 (faster)");
   combobox_engine->addItem("Rubber Band R3 (finer)");
   combobox_engine->setToolTip("R3 engine produces higher-quality results than the R2 engine for most material, especially complex mixes, vocals and other sounds that have soft onsets and smooth pitch changes, and music with substantial bass content. However, it uses much more CPU power than the R2 engine.");
+  QLabel *label_latency_profile = new QLabel("Latency");
+  combobox_latency = new QComboBox;
+  for (int profile_latency : {20, 50, 100, 200})
+    combobox_latency->addItem(QStringLiteral("%1 ms").arg(profile_latency), profile_latency);
+  combobox_latency->setToolTip("Audio buffered by the sound card. Lower values make pausing and settings changes more responsive, but need a faster computer to avoid dropouts. Applies when playing starts.");
   QHBoxLayout *layout_engine = new QHBoxLayout;
   layout_engine->addWidget(label_engine);
   layout_engine->addWidget(combobox_engine);
   layout_engine->addStretch();
+  layout_engine->addWidget(label_latency_profile);
+  layout_engine->addWidget(combobox_latency);
   
   check_high_quality = new QCheckBox("High quality (uses more CPU)");
   check_high_quality->setToolTip("Use the highest quality method for pitch shifting. This method may use much more CPU, especially for large pitch shift.");
@@ -114,12 +139,15 @@ PlayerWindow::PlayerWindow(const QIcon &app_icon, const QString &filename)
   check_formant_preserved->setToolTip("Preserve the spectral envelope of the original signal. This permits shifting the note frequency without so substantially affecting the perceived pitch profile of the voice or instrument.");
   check_channels_together = new QCheckBox("Process channels together");
   check_channels_together->setToolTip("If this option is disabled, all channels are processed individually, which provides the highest quality for the individual channels at the expense of synchronisation, with a more diffuse stereo image and an unnatural increase in \"width\".\nEnabling it provides higher synchronisation at some expense of individual fidelity. In particular, a stretcher processing two channels will treat its input as a stereo pair and aim to maximise clarity at the centre. This gives relatively less stereo space and width, as well as slightly lower fidelity for individual channel content, but the results may be more appropriate for many situations making use of stereo mixes.");
+  check_parallel_channels = new QCheckBox("Process channels in parallel (uses several CPU cores)");
+  check_parallel_channels->setToolTip("Each channel (or each pair of channels, if channels are processed together) is stretched by a separate stretcher in a separate thread, so that multichannel files can be played with the highest quality settings on a multi-core computer.");
   QVBoxLayout *layout_settings = new QVBoxLayout;
   layout_settings->addLayout(layout_sliders);
   layout_settings->addLayout(layout_engine);
   layout_settings->addWidget(check_high_quality);
   layout_settings->addWidget(check_formant_preserved);
   layout_settings->addWidget(check_channels_together);
+  layout_settings->addWidget(check_parallel_channels);
   QGroupBox *groupbox_settings = new QGroupBox("Settings");
   groupbox_settings->setLayout(layout_settings);
   
@@ -140,10 +168,21 @@ PlayerWindow::PlayerWindow(const QIcon &app_icon, const QString &filename)
   button_bwd5 = new QPushButton(backward_icon, QStringLiteral("-5s"));
   button_fwd5 = new QPushButton(forward_icon, QStringLiteral("+5s"));
   button_fwd10 = new QPushButton(forward_icon, QStringLiteral("+10s"));
+  button_loop_start = new QPushButton(QStringLiteral("A"));
+  button_loop_start->setToolTip("Set the start of the loop at the current position");
+  button_loop_end = new QPushButton(QStringLiteral("B"));
+  button_loop_end->setToolTip("Set the end of the loop at the current position, and loop");
+  button_loop = new QPushButton(QIcon::fromTheme(QIcon::ThemeIcon::MediaPlaylistRepeat), "Loop A-B");
+  button_loop->setToolTip("Play the section between A and B again and again. It is stretched only once with the current settings, then replayed from memory");
+  button_loop->setCheckable(true);
   QHBoxLayout *layout_buttons2 = new QHBoxLayout;
   layout_buttons2->addWidget(button_bwd10);
   layout_buttons2->addWidget(button_bwd5);
   layout_buttons2->addStretch();
+  layout_buttons2->addWidget(button_loop_start);
+  layout_buttons2->addWidget(button_loop_end);
+  layout_buttons2->addWidget(button_loop);
+  layout_buttons2->addStretch();
   layout_buttons2->addWidget(button_fwd5);
   layout_buttons2->addWidget(button_fwd10);
 
@@ -163,10 +202,19 @@ PlayerWindow::PlayerWindow(const QIcon &app_icon, const QString &filename)
   layout_player->addLayout(layout_progress);
   QGroupBox *groupbox_player = new QGroupBox("Player");
   groupbox_player->setLayout(layout_player);
+
+  label_statistics = new QLabel;
+  label_statistics->setFont(fixed_font);
+  QVBoxLayout *layout_statistics = new QVBoxLayout;
+  layout_statistics->addWidget(label_statistics);
+  groupbox_statistics = new QGroupBox("Statistics");
+  groupbox_statistics->setLayout(layout_statistics);
+  groupbox_statistics->setVisible(false);
   
   QVBoxLayout *layout_main = new QVBoxLayout;
   layout_main->addWidget(groupbox_settings);
   layout_main->addWidget(groupbox_player);
+  layout_main->addWidget(groupbox_statistics);
   QWidget *widget_main = new QWidget;
   widget_main->setLayout(layout_main);
   setCentralWidget(widget_main);
@@ -179,12 +227,26 @@ PlayerWindow::PlayerWindow(const QIcon &app_icon, const QString &filename)
   updateVolume(100);
   combobox_engine->setCurrentIndex(1);
   audio_player->updateOptionUseR3Engine(true);
+  combobox_latency->setCurrentIndex(qMax(combobox_latency->findData((latency > 0) ? latency : 200), 0));
+  audio_player->setLatency(combobox_latency->currentData().toInt());
   check_high_quality->setChecked(true);
   audio_player->updateOptionHighQuality(true);
   check_formant_preserved->setChecked(true);
   audio_player->updateOptionFormantPreserved(true);
   check_channels_together->setChecked(false);
   audio_player->updateOptionChannelsTogether(false);
+  check_parallel_channels->setChecked(false);
+  audio_player->updateOptionParallelChannels(false);
+  action_decode_cache->setChecked(decode_cache);
+  audio_player->setDecodeCacheEnabled(decode_cache);
+  action_reduced_memory->setChecked(reduced_memory);
+  audio_player->setReducedMemoryUsage(reduced_memory);
+  action_noise_shaping->setChecked(false);
+  audio_player->setNoiseShapingEnabled(false);
+  if (render_ahead > 0)
+    audio_player->setRenderAhead(render_ahead);
+  loop_start = -1;
+  loop_end = -1;
   updateStatus(audio_player->getStatus());
   updateReadingPosition(-1);
   updateDuration(-1);
@@ -192,8 +254,12 @@ PlayerWindow::PlayerWindow(const QIcon &app_icon, const QString &filename)
   adjustSize();
   setMaximumHeight(height());
 
+  connect(action_decode_cache, &QAction::toggled, audio_player, &AudioPlayer::setDecodeCacheEnabled);
+  connect(action_reduced_memory, &QAction::toggled, audio_player, &AudioPlayer::setReducedMemoryUsage);
+  connect(action_noise_shaping, &QAction::toggled, audio_player, &AudioPlayer::setNoiseShapingEnabled);
+  connect(action_statistics, &QAction::toggled, this, &PlayerWindow::showStatistics);
   connect(button_open, &QPushButton::clicked, this, &PlayerWindow::openFileFromSelector);
-  connect(button_cancel, &QPushButton::clicked, audio_player, &AudioPlayer::cancelDecoding);
+  connect(button_cancel, &QPushButton::clicked, [this](){ if (audio_player->isDecoding()) audio_player->cancelDecoding(); else audio_player->cancelExport(); });
   connect(button_play, &QPushButton::clicked, this, &PlayerWindow::playAudio);
   connect(button_pause, &QPushButton::clicked, audio_player, &AudioPlayer::pausePlaying);
   connect(button_stop, &QPushButton::clicked, audio_player, &AudioPlayer::stopPlaying);
@@ -201,17 +267,29 @@ PlayerWindow::PlayerWindow(const QIcon &app_icon, const QString &filename)
   connect(button_bwd5, &QPushButton::clicked, [this](){ moveReadingPosition(-5000); });
   connect(button_fwd5, &QPushButton::clicked, [this](){ moveReadingPosition(5000); });
   connect(button_fwd10, &QPushButton::clicked, [this](){ moveReadingPosition(10000); });
+  connect(button_loop_start, &QPushButton::clicked, this, &PlayerWindow::setLoopStart);
+  connect(button_loop_end, &QPushButton::clicked, this, &PlayerWindow::setLoopEnd);
+  connect(button_loop, &QAbstractButton::toggled, this, &PlayerWindow::updateLoop);
   connect(spinbox_pitch, qOverload<int>(&QSpinBox::valueChanged), slider_pitch, &QAbstractSlider::setValue);
   connect(slider_pitch, &QAbstractSlider::valueChanged, this, &PlayerWindow::updatePitch);
   connect(slider_speed, &QAbstractSlider::valueChanged, this, &PlayerWindow::updateSpeed);
   connect(slider_volume, &QAbstractSlider::valueChanged, this, &PlayerWindow::updateVolume);
   connect(combobox_engine, &QComboBox::currentIndexChanged, [this](int index){ audio_player->updateOptionUseR3Engine(index == 1); });
+  connect(combobox_latency, &QComboBox::currentIndexChanged, [this](int index){ audio_player->setLatency(combobox_latency->itemData(index).toInt()); });
   connect(check_high_quality, &QAbstractButton::toggled, audio_player, &AudioPlayer::updateOptionHighQuality);
   connect(check_formant_preserved, &QAbstractButton::toggled, audio_player, &AudioPlayer::updateOptionFormantPreserved);
+  connect(check_channels_together, &QAbstractButton::toggled, audio_player, &AudioPlayer::updateOptionChannelsTogether);
+  connect(check_parallel_channels, &QAbstractButton::toggled, audio_player, &AudioPlayer::updateOptionParallelChannels);
   connect(audio_player, &AudioPlayer::statusChanged, this, &PlayerWindow::updateStatus);
   connect(audio_player, &AudioPlayer::loadingProgressChanged, [this](int progress){ label_loading_progress->setText(QStringLiteral("%1 \%").arg(progress)); });
+  connect(audio_player, &AudioPlayer::exportProgressChanged, [this](int progress){ label_loading_progress->setText(QStringLiteral("Export: %1 \%").arg(progress)); });
+  connect(audio_player, &AudioPlayer::exportFinished, this, &PlayerWindow::displayExportResult);
   connect(audio_player, &AudioPlayer::durationChanged, this, &PlayerWindow::updateDuration);
+  connect(audio_player, &AudioPlayer::decodedPositionChanged, progress_playing, &PlayingProgress::setDecodedPosition);
+  connect(audio_player, &AudioPlayer::waveformChanged, progress_playing, &PlayingProgress::setWaveform);
   connect(audio_player, &AudioPlayer::readingPositionChanged, this, &PlayerWindow::updateReadingPosition);
+  connect(audio_player, &AudioPlayer::latencyChanged, this, &PlayerWindow::updateLatency);
+  connect(audio_player, &AudioPlayer::statisticsChanged, this, &PlayerWindow::updateStatistics);
   connect(audio_player, &AudioPlayer::audioDecodingError, this, &PlayerWindow::displayAudioDecodingError);
   connect(audio_player, &AudioPlayer::audioOutputError, this, &PlayerWindow::displayAudioDeviceError);
   connect(progress_playing, &PlayingProgress::barClicked, audio_player, &AudioPlayer::moveReadingPosition);
@@ -289,11 +367,41 @@ void PlayerWindow::displayAudioDeviceError(QAudio::Error error)
 }
 
 
+// Prompt a popup telling whether the export succeeded
+void PlayerWindow::displayExportResult(const QString &error_message)
+{
+  label_loading_progress->clear();
+  if (error_message.isEmpty())
+    QMessageBox::information(this, "Export", "The file has been exported successfully.", QMessageBox::Ok);
+  else
+    QMessageBox::critical(this, "Export error", "Error while exporting audio file:\n" + error_message, QMessageBox::Ok);
+}
+
+
+// Export the loaded file with current settings (output file chosen with a file selector)
+void PlayerWindow::exportFileFromSelector()
+{
+  QString export_filter("WAV files (*.wav)");
+  const QString flac_filter("FLAC files (*.flac)");
+  QString selected_file = QFileDialog::getSaveFileName(this, "Export audio file", music_directory, export_filter + ";;" + flac_filter, &export_filter);
+  if (selected_file.isEmpty())
+    return;
+
+  if (QFileInfo(selected_file).suffix().isEmpty())
+    selected_file += (export_filter == flac_filter) ? QStringLiteral(".flac") : QStringLiteral(".wav");
+  audio_player->exportFile(selected_file);
+}
+
+
 // Open file given in parameter
 void PlayerWindow::openFile(const QFileInfo &file_info)
 {
   setWindowTitle(QStringLiteral("VPS Player [%1]").arg(file_info.fileName()));
   music_directory = file_info.canonicalPath();
+  loop_start = -1;
+  loop_end = -1;
+  button_loop->setChecked(false);
+  progress_playing->setLoop(0, 0);
 
   audio_player->decodeFile(file_info.canonicalFilePath());
 }
@@ -302,7 +410,7 @@ void PlayerWindow::openFile(const QFileInfo &file_info)
 // Open a new file (chosen with a file selector)
 void PlayerWindow::openFileFromSelector()
 {
-  QString audio_files_filter("Common audio files (*.aac *.flac *.m4a *.mp3 *.ogg *.wav *.wma)");
+  QString audio_files_filter("Common audio files (*.aac *.aif *.aiff *.flac *.m4a *.mp3 *.ogg *.wav *.wma)");
   const QString selected_file = QFileDialog::getOpenFileName(this, "Select audio file", music_directory, audio_files_filter + ";;All files (*)", &audio_files_filter);
 
   if (!selected_file.isEmpty())
@@ -331,6 +439,36 @@ void PlayerWindow::moveReadingPosition(int delta)
 }
 
 
+// Sets the end of the A–B loop at the reading position, and enables the loop
+void PlayerWindow::setLoopEnd()
+{
+  loop_end = progress_playing->value();
+  if (loop_end <= loop_start)
+    loop_start = -1;
+  button_loop->setEnabled(loop_start >= 0);
+  if (loop_start < 0)
+    button_loop->setChecked(false);
+  else if (button_loop->isChecked())
+    updateLoop();
+  else
+    button_loop->setChecked(true);
+}
+
+
+// Sets the start of the A–B loop at the reading position
+void PlayerWindow::setLoopStart()
+{
+  loop_start = progress_playing->value();
+  if (loop_end <= loop_start)
+    loop_end = -1;
+  button_loop->setEnabled(loop_end >= 0);
+  if (loop_end < 0)
+    button_loop->setChecked(false);
+  else if (button_loop->isChecked())
+    updateLoop();
+}
+
+
 // Displays "About" dialog window
 void PlayerWindow::showAbout()
 {
@@ -340,6 +478,21 @@ void PlayerWindow::showAbout()
 }
 
 
+// Shows or hides the performance statistics panel
+void PlayerWindow::showStatistics(bool visible)
+{
+  label_statistics->setText(QStringLiteral("-"));
+  groupbox_statistics->setVisible(visible);
+  audio_player->setStatisticsEnabled(visible);
+
+  // The window height is fixed: it has to be computed again with or without the panel
+  setMaximumHeight(QWIDGETSIZE_MAX);
+  centralWidget()->layout()->activate();
+  adjustSize();
+  setMaximumHeight(height());
+}
+
+
 // Updates total file duration
 void PlayerWindow::updateDuration(int duration)
 {
@@ -351,6 +504,22 @@ void PlayerWindow::updateDuration(int duration)
 }
 
 
+// Displays the end-to-end output latency
+void PlayerWindow::updateLatency(int latency)
+{
+  label_latency->setText(QStringLiteral("Latency: %1 ms").arg(latency));
+}
+
+
+// Forwards the A–B loop to the player and the progress bar (no loop unless it is enabled)
+void PlayerWindow::updateLoop()
+{
+  const bool enabled = button_loop->isChecked() && (loop_start >= 0) && (loop_end > loop_start);
+  audio_player->setLoop(enabled ? loop_start : 0, enabled ? loop_end : 0);
+  progress_playing->setLoop(enabled ? loop_start : 0, enabled ? loop_end : 0);
+}
+
+
 // Updates the pitch
 void PlayerWindow::updatePitch(int pitch)
 {
@@ -381,6 +550,26 @@ void PlayerWindow::updateSpeed(int speed)
 }
 
 
+// Displays performance counters in the statistics panel
+void PlayerWindow::updateStatistics(const PlaybackStatistics &statistics)
+{
+  QStringList lines;
+  const AudioPlayer::Status status = audio_player->getStatus();
+  if ((status == AudioPlayer::Playing) || (status == AudioPlayer::Paused)) {
+    lines.append(QStringLiteral("Dropouts:             %1").arg(statistics.nb_underruns));
+    if (statistics.realtime_factor > 0.0) {
+      lines.append(QStringLiteral("Processing per slice: %1 ms (peak: %2 ms)").arg(statistics.mean_processing_time / 1000.0, 0, 'f', 2).arg(statistics.peak_processing_time / 1000.0, 0, 'f', 2));
+      lines.append(QStringLiteral("Realtime factor:      x %1").arg(statistics.realtime_factor, 0, 'f', 1));
+    }
+    lines.append(QStringLiteral("Rendered ahead:       %1 ms").arg(statistics.queued_duration));
+    lines.append(QStringLiteral("Sound card buffer:    %1 % full at least").arg(statistics.min_sink_fill_level));
+    lines.append(QStringLiteral("Latency:              %1 ms").arg(statistics.latency));
+  }
+  lines.append(QStringLiteral("Decoded audio memory: %1 MiB").arg(static_cast<double>(statistics.decoded_memory) / (1024.0 * 1024.0), 0, 'f', 1));
+  label_statistics->setText(lines.join(QLatin1Char('\n')));
+}
+
+
 // Updates the window based on the player status
 void PlayerWindow::updateStatus(AudioPlayer::Status status)
 {
@@ -388,17 +577,24 @@ void PlayerWindow::updateStatus(AudioPlayer::Status status)
     label_status->setText(status_text);
     action_open->setEnabled(enable_open);
     button_open->setEnabled(enable_open);
-    button_cancel->setEnabled(decoding);
+    button_cancel->setEnabled(decoding || audio_player->isExporting());
     button_stop->setEnabled(playback_begun);
     button_bwd10->setEnabled(playback_begun);
     button_bwd5->setEnabled(playback_begun);
     button_fwd5->setEnabled(playback_begun);
     button_fwd10->setEnabled(playback_begun);
+    button_loop_start->setEnabled(playback_begun);
+    button_loop_end->setEnabled(playback_begun);
+    button_loop->setEnabled((loop_start >= 0) && (loop_end > loop_start) && (enable_play || enable_pause));
     button_play->setEnabled(enable_play);
     button_pause->setEnabled(enable_pause);
     combobox_engine->setEnabled(enable_options);
     check_high_quality->setEnabled(enable_options);
     check_channels_together->setEnabled(enable_options);
+    check_parallel_channels->setEnabled(enable_options);
+    combobox_latency->setEnabled(!playback_begun);
+    if (!playback_begun)
+      label_latency->clear();
     progress_playing->setClickable(playback_begun);
   };
 
@@ -412,15 +608,16 @@ void PlayerWindow::updateStatus(AudioPlayer::Status status)
     set_controls("Loading file", false, true, false, false, false, false);
     break;
   case AudioPlayer::Stopped :
-    set_controls("Stopped", true, false, false, true, false, true);
+    set_controls("Stopped", true, audio_player->isDecoding(), false, true, false, true);
     break;
   case AudioPlayer::Paused :
-    set_controls("Paused", true, false, true, true, false, false);
+    set_controls("Paused", true, audio_player->isDecoding(), true, true, false, true);
     break;
   case AudioPlayer::Playing :
-    set_controls("Playing", true, false, true, false, true, false);
+    set_controls("Playing", true, audio_player->isDecoding(), true, false, true, true);
     break;
   }
+  action_export->setEnabled((status != AudioPlayer::NoFileLoaded) && (status != AudioPlayer::Loading) && !audio_player->isDecoding() && !audio_player->isExporting());
 }
 
 
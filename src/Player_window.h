@@ -13,6 +13,7 @@
 #include <QCheckBox>
 #include <QComboBox>
 #include <QFileInfo>
+#include <QGroupBox>
 #include <QIcon>
 #include <QLabel>
 #include <QLCDNumber>
@@ -21,6 +22,7 @@
 #include <QString>
 
 #include "Audio_player.h"
+#include "Playback_statistics.h"
 #include "Playing_progress.h"
 
 
@@ -31,6 +33,7 @@ class PlayerWindow : public QMainWindow
 private:
   AudioPlayer *audio_player;
   QAction *action_open;
+  QAction *action_export;
   QPushButton *button_open;
   QPushButton *button_cancel;
   QPushButton *button_play;
@@ -40,35 +43,53 @@ private:
   QPushButton *button_bwd5;
   QPushButton *button_fwd5;
   QPushButton *button_fwd10;
+  QPushButton *button_loop_start;
+  QPushButton *button_loop_end;
+  QPushButton *button_loop;
   QSpinBox *spinbox_pitch;
   QLabel *label_speed_value;
   QLCDNumber *lcd_volume;
   QComboBox *combobox_engine;
+  QComboBox *combobox_latency;
   QCheckBox *check_high_quality;
   QCheckBox *check_channels_together;
+  QCheckBox *check_parallel_channels;
   PlayingProgress *progress_playing;
   QLabel *label_reading_progress;
   QLabel *label_duration;
   QLabel *label_status;
   QLabel *label_loading_progress;
+  QLabel *label_latency;
+  QGroupBox *groupbox_statistics;
+  QLabel *label_statistics;
   QString music_directory;
+  int loop_start; // A–B loop bounds in milliseconds (-1 until set)
+  int loop_end;
   
 public:
-  PlayerWindow(const QIcon &app_icon, const QString &filename = QString()); // Constructor
+  PlayerWindow(const QIcon &app_icon, const QString &filename = QString(), bool decode_cache = false, bool reduced_memory = false, int render_ahead = 0, int latency = 0); // Constructor. render_ahead: maximum duration of audio rendered ahead of playback, latency: latency profile (both in milliseconds, 0: default)
   ~PlayerWindow(); // Destructor
 
 private:
   void displayAudioDecodingError(QAudioDecoder::Error error); // Prompt an error popup for an audio decoding error
   void displayAudioDeviceError(QAudio::Error error); // Prompt an error popup for an audio device error
+  void displayExportResult(const QString &error_message); // Prompt a popup telling whether the export succeeded
+  void exportFileFromSelector(); // Export the loaded file with current settings (output file chosen with a file selector)
   void openFile(const QFileInfo &file_info); // Open file given in parameter
   void openFileFromSelector(); // Open a new file (chosen with a file selector)
   void playAudio(); // Start or resume audio playing
   void moveReadingPosition(int delta); // Moves reading position backward or forward. Parameter: position change in milliseconds
+  void setLoopEnd(); // Sets the end of the A–B loop at the reading position, and enables the loop
+  void setLoopStart(); // Sets the start of the A–B loop at the reading position
   void showAbout(); // Displays "About" dialog window
+  void showStatistics(bool visible); // Shows or hides the performance statistics panel
   void updateDuration(int duration); // Updates total file duration
+  void updateLatency(int latency); // Displays the end-to-end output latency
+  void updateLoop(); // Forwards the A–B loop to the player and the progress bar (no loop unless it is enabled)
   void updatePitch(int pitch); // Updates the pitch
   void updateReadingPosition(int position); // Updates current reading position
   void updateSpeed(int speed); // Updates the speed
+  void updateStatistics(const PlaybackStatistics &statistics); // Displays performance counters in the statistics panel
   void updateStatus(AudioPlayer::Status status); // Updates the window based on the player status
   void updateVolume(int volume); // Updates the volume
 };
@@ -5,18 +5,29 @@
 // VPS Player is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
 // You should have received a copy of the GNU General Public License along with VPS Player. If not, see <http://www.gnu.org/licenses/>.
 
+#include <QBrush>
+#include <QColor>
+#include <QLine>
+#include <QList>
+#include <QPainter>
 #include <QStyle>
 #include <QToolTip>
 
 #include "Playing_progress.h"
 #include "tools.h"
 
+#define PLAYING_PROGRESS_MIN_HEIGHT 32 // Leaves room for the waveform (in pixels)
+
 
 // Constructor
 PlayingProgress::PlayingProgress(QWidget *parent) : QProgressBar(parent),
-						    is_clickable(false)
+						    is_clickable(false),
+						    decoded_position(-1),
+						    loop_start(0),
+						    loop_end(0)
 {
   setTextVisible(false);
+  setMinimumHeight(PLAYING_PROGRESS_MIN_HEIGHT);
 }
 
 
@@ -44,6 +55,31 @@ void PlayingProgress::setClickable(bool clickable)
 }
 
 
+// Sets the end of the decoded region. Parameter: position in milliseconds (-1 if the whole bar should be shown as decoded)
+void PlayingProgress::setDecodedPosition(int position)
+{
+  decoded_position = position;
+  update();
+}
+
+
+// Sets the A–B loop highlighted on the bar. Parameters: bounds in milliseconds (no loop if end is not after start)
+void PlayingProgress::setLoop(int start, int end)
+{
+  loop_start = start;
+  loop_end = end;
+  update();
+}
+
+
+// Sets the waveform overview drawn on the bar (nullptr for none)
+void PlayingProgress::setWaveform(std::shared_ptr<const WaveformOverview> overview)
+{
+  waveform = std::move(overview);
+  update();
+}
+
+
 // Reimplementation of QWidget's "mouse moved" event handler
 void PlayingProgress::mouseMoveEvent(QMouseEvent *event)
 {
@@ -64,6 +100,58 @@ void PlayingProgress::mousePressEvent(QMouseEvent *event)
 }
 
 
+// Reimplementation of QWidget's paint event handler: draws the waveform, highlights the A–B loop and shades the region that is not decoded yet
+void PlayingProgress::paintEvent(QPaintEvent *event)
+{
+  QProgressBar::paintEvent(event);
+  QPainter painter(this);
+
+  // One line per column for the peaks, and a darker one for the RMS level: the overview is summarized at the width of the bar, up to the end of the decoded region
+  if (waveform && (maximum() > 0)) {
+    const qint64 nb_frames = (static_cast<qint64>(maximum()) * waveform->sampleRate()) / 1000;
+    const qint64 end_frame = (decoded_position < 0) ? nb_frames : (static_cast<qint64>(decoded_position) * waveform->sampleRate()) / 1000;
+    const QList<WaveformOverview::Peak> peaks = waveform->columnPeaks(nb_frames, width(), end_frame);
+    const int center_y = height() / 2;
+    const float half_height = static_cast<float>(height() - 1) / 2.0f;
+    QList<QLine> peak_lines;
+    QList<QLine> rms_lines;
+    peak_lines.reserve(peaks.size());
+    rms_lines.reserve(peaks.size());
+    for (qsizetype x = 0; x < peaks.size(); x++) {
+      const WaveformOverview::Peak &peak = peaks.at(x);
+      peak_lines.append(QLine(static_cast<int>(x), center_y - qRound(qBound(-1.0f, peak.max, 1.0f) * half_height), static_cast<int>(x), center_y - qRound(qBound(-1.0f, peak.min, 1.0f) * half_height)));
+      const int rms_height = qRound(qMin(peak.rms, 1.0f) * half_height);
+      rms_lines.append(QLine(static_cast<int>(x), center_y - rms_height, static_cast<int>(x), center_y + rms_height));
+    }
+
+    QColor waveform_color = palette().color(QPalette::WindowText);
+    waveform_color.setAlpha(96);
+    painter.setPen(waveform_color);
+    painter.drawLines(peak_lines);
+    waveform_color.setAlpha(160);
+    painter.setPen(waveform_color);
+    painter.drawLines(rms_lines);
+  }
+
+  if (loop_end > loop_start) {
+    const int start_x = QStyle::sliderPositionFromValue(0, maximum(), qMin(loop_start, maximum()), width());
+    const int end_x = QStyle::sliderPositionFromValue(0, maximum(), qMin(loop_end, maximum()), width());
+    QColor loop_color = palette().color(QPalette::Highlight);
+    loop_color.setAlpha(64);
+    painter.fillRect(start_x, 0, end_x - start_x, height(), loop_color);
+    painter.setPen(palette().color(QPalette::Highlight));
+    painter.drawLine(start_x, 0, start_x, height() - 1);
+    painter.drawLine(end_x, 0, end_x, height() - 1);
+  }
+
+  if ((decoded_position < 0) || (decoded_position >= maximum()))
+    return;
+
+  int decoded_x = QStyle::sliderPositionFromValue(0, maximum(), decoded_position, width());
+  painter.fillRect(decoded_x, 0, width() - decoded_x, height(), QBrush(palette().color(QPalette::Mid), Qt::BDiagPattern));
+}
+
+
 // Returns the position in milliseconds corresponding to the mouse position on the progress bar where the event occured
 int PlayingProgress::mouseEventPosition(const QMouseEvent *event) const
 {
@@ -8,9 +8,13 @@
 #ifndef PLAYING_PROGRESS_H
 #define PLAYING_PROGRESS_H
 
+#include <memory>
 #include <QMouseEvent>
+#include <QPaintEvent>
 #include <QProgressBar>
 
+#include "Waveform_overview.h"
+
 
 class PlayingProgress : public QProgressBar
 {
@@ -18,15 +22,23 @@ class PlayingProgress : public QProgressBar
 
 private:
   bool is_clickable;
+  int decoded_position;
+  int loop_start;
+  int loop_end;
+  std::shared_ptr<const WaveformOverview> waveform;
 
 public:
   PlayingProgress(QWidget *parent = nullptr); // Constructor
   ~PlayingProgress(); // Destructor
   void setClickable(bool clickable); // Sets whether the progress bar is clickable
+  void setDecodedPosition(int position); // Sets the end of the decoded region. Parameter: position in milliseconds (-1 if the whole bar should be shown as decoded)
+  void setLoop(int start, int end); // Sets the A–B loop highlighted on the bar. Parameters: bounds in milliseconds (no loop if end is not after start)
+  void setWaveform(std::shared_ptr<const WaveformOverview> overview); // Sets the waveform overview drawn on the bar (nullptr for none)
 
 protected:
   void mouseMoveEvent(QMouseEvent *event) override; // Reimplementation of QWidget's "mouse moved" event handler
   void mousePressEvent(QMouseEvent *event) override; // Reimplementation of QWidget's "mouse button pressed" event handler
+  void paintEvent(QPaintEvent *event) override; // Reimplementation of QWidget's paint event handler: draws the waveform, highlights the A–B loop and shades the region that is not decoded yet
 
 private:
   int mouseEventPosition(const QMouseEvent *event) const; // Returns the position in milliseconds corresponding to the mouse position on the progress bar where the event occured
@@ -0,0 +1,686 @@
+// Copyright 2026 François CROLLET
+
+// This file is part of VPS Player.
+// VPS Player is free software; you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation; either version 3 of the License, or (at your option) any later version.
+// VPS Player is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License along with VPS Player. If not, see <http://www.gnu.org/licenses/>.
+
+#include <atomic>
+#include <cmath>
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#include <immintrin.h>
+#define SAMPLE_CONVERSION_X86 // Vectorized kernels are built for x86 CPUs (GCC or Clang)
+#endif
+
+#include "Sample_conversion.h"
+
+#define DITHER_CHANNEL_STRIDE 0x9E3779B9u // Offset between the dither sequences of two channels, so that channels get uncorrelated dither
+#define NOISE_SHAPING_COEFFICIENT_1 1.0f // Error feedback coefficients: the noise transfer function 1 - z^-1 + 0.5 z^-2 lowers noise by up to 8 dB below a few kHz, and raises it toward the top of the spectrum
+#define NOISE_SHAPING_COEFFICIENT_2 -0.5f
+#define ROUNDING_OFFSET 12582912.0f // 1.5 * 2^23: adding then subtracting it rounds a float below 2^22 to the nearest integer
+
+
+// Table of the kernels built for an instruction set
+struct ConversionKernels
+{
+  SampleConversion::InstructionSet instruction_set;
+  void (*convert_int16_to_float)(const qint16*, float*, qint64);
+  void (*deinterleave)(const float*, unsigned int, float *const*, unsigned int, qint64);
+  void (*interleave)(const float *const*, float*, unsigned int, qint64);
+  void (*interleave_to_int16)(const float *const*, qint16*, unsigned int, qint64);
+  void (*interleave_to_int16_dithered)(const float *const*, qint16*, unsigned int, qint64, quint32);
+  void (*interleave_to_int32)(const float *const*, qint32*, unsigned int, qint64);
+};
+
+
+// Converts a 16-bit sample to a float sample: reference for vectorized kernels (scaling by a power of 2 is exact)
+static inline float convertInt16ToFloatSample(qint16 sample)
+{
+  return static_cast<float>(sample) * (1.0f / 32768.0f);
+}
+
+
+// Converts a float sample to a 16-bit sample: reference for vectorized kernels, which clamp before rounding the same way
+static inline qint16 convertFloatToInt16(float sample)
+{
+  return static_cast<qint16>(qRound(qBound(-32767.0f, sample * 32767.0f, 32767.0f)));
+}
+
+
+// Converts a float sample to a 16-bit sample with given dither (in LSB): reference for vectorized kernels
+static inline qint16 convertFloatToInt16Dithered(float sample, float dither)
+{
+  return static_cast<qint16>(qBound(-32768, qRound(qBound(-32767.0f, sample * 32767.0f, 32767.0f) + dither), 32767));
+}
+
+
+// Converts a float sample to a 32-bit sample, rounding to nearest: reference for vectorized kernels (2147483520 is the largest float below 2^31)
+static inline qint32 convertFloatToInt32(float sample)
+{
+  return static_cast<qint32>(std::lrint(qBound(-2147483648.0f, sample * 2147483648.0f, 2147483520.0f)));
+}
+
+
+// Returns the index of the dither value of given frame of given channel
+static inline quint32 ditherIndex(quint32 dither_position, unsigned int channel, qint64 frame)
+{
+  return dither_position + static_cast<quint32>(frame) + (channel * DITHER_CHANNEL_STRIDE);
+}
+
+
+// Returns the TPDF dither value (in LSB, between -1 and 1) of given index: the sum of two uniform values taken from a hash of the index, so that vectorized kernels get exactly the same dither
+static inline float ditherValue(quint32 index)
+{
+  quint32 random = index ^ (index >> 16);
+  random *= 0x7FEB352Du;
+  random ^= random >> 15;
+  random *= 0x846CA68Bu;
+  random ^= random >> 16;
+  return static_cast<float>(static_cast<qint32>((random & 0xFFFFu) + (random >> 16)) - 65535) * (1.0f / 65536.0f);
+}
+
+
+// Converts samples [first_sample, end_sample) of 16-bit samples to float samples
+static void convertSamplesInt16ToFloat(const qint16 *input, float *output, qint64 first_sample, qint64 end_sample)
+{
+  for (qint64 j = first_sample; j < end_sample; j++)
+    output[j] = convertInt16ToFloatSample(input[j]);
+}
+
+
+// Splits frames [first_frame, end_frame) of interleaved samples into planar channels
+static void deinterleaveFrames(const float *input, unsigned int nb_input_channels, float *const *output, unsigned int nb_output_channels, qint64 first_frame, qint64 end_frame)
+{
+  for (qint64 j = first_frame; j < end_frame; j++)
+    for (unsigned int i = 0; i < nb_output_channels; i++)
+      output[i][j] = input[(j * nb_input_channels) + i];
+}
+
+
+// Merges frames [first_frame, end_frame) of planar channels into interleaved samples
+static void interleaveFrames(const float *const *input, float *output, unsigned int nb_channels, qint64 first_frame, qint64 end_frame)
+{
+  for (qint64 j = first_frame; j < end_frame; j++)
+    for (unsigned int i = 0; i < nb_channels; i++)
+      output[(j * nb_channels) + i] = input[i][j];
+}
+
+
+// Merges frames [first_frame, end_frame) of planar channels into interleaved 16-bit samples
+static void interleaveFramesToInt16(const float *const *input, qint16 *output, unsigned int nb_channels, qint64 first_frame, qint64 end_frame)
+{
+  for (qint64 j = first_frame; j < end_frame; j++)
+    for (unsigned int i = 0; i < nb_channels; i++)
+      output[(j * nb_channels) + i] = convertFloatToInt16(input[i][j]);
+}
+
+
+// Merges frames [first_frame, end_frame) of planar channels into interleaved 16-bit samples with TPDF dither
+static void interleaveFramesToInt16Dithered(const float *const *input, qint16 *output, unsigned int nb_channels, qint64 first_frame, qint64 end_frame, quint32 dither_position)
+{
+  for (qint64 j = first_frame; j < end_frame; j++)
+    for (unsigned int i = 0; i < nb_channels; i++)
+      output[(j * nb_channels) + i] = convertFloatToInt16Dithered(input[i][j], ditherValue(ditherIndex(dither_position, i, j)));
+}
+
+
+// Merges frames [first_frame, end_frame) of planar channels into interleaved 32-bit samples
+static void interleaveFramesToInt32(const float *const *input, qint32 *output, unsigned int nb_channels, qint64 first_frame, qint64 end_frame)
+{
+  for (qint64 j = first_frame; j < end_frame; j++)
+    for (unsigned int i = 0; i < nb_channels; i++)
+      output[(j * nb_channels) + i] = convertFloatToInt32(input[i][j]);
+}
+
+
+// Scalar kernel: converts 16-bit samples to float samples
+static void convertInt16ToFloatScalar(const qint16 *input, float *output, qint64 nb_samples)
+{
+  convertSamplesInt16ToFloat(input, output, 0, nb_samples);
+}
+
+
+// Scalar kernel: splits interleaved samples into planar channels
+static void deinterleaveScalar(const float *input, unsigned int nb_input_channels, float *const *output, unsigned int nb_output_channels, qint64 nb_frames)
+{
+  deinterleaveFrames(input, nb_input_channels, output, nb_output_channels, 0, nb_frames);
+}
+
+
+// Scalar kernel: merges planar channels into interleaved samples
+static void interleaveScalar(const float *const *input, float *output, unsigned int nb_channels, qint64 nb_frames)
+{
+  interleaveFrames(input, output, nb_channels, 0, nb_frames);
+}
+
+
+// Scalar kernel: merges planar channels into interleaved 16-bit samples
+static void interleaveToInt16Scalar(const float *const *input, qint16 *output, unsigned int nb_channels, qint64 nb_frames)
+{
+  interleaveFramesToInt16(input, output, nb_channels, 0, nb_frames);
+}
+
+
+// Scalar kernel: merges planar channels into interleaved 16-bit samples with TPDF dither
+static void interleaveToInt16DitheredScalar(const float *const *input, qint16 *output, unsigned int nb_channels, qint64 nb_frames, quint32 dither_position)
+{
+  interleaveFramesToInt16Dithered(input, output, nb_channels, 0, nb_frames, dither_position);
+}
+
+
+// Scalar kernel: merges planar channels into interleaved 32-bit samples
+static void interleaveToInt32Scalar(const float *const *input, qint32 *output, unsigned int nb_channels, qint64 nb_frames)
+{
+  interleaveFramesToInt32(input, output, nb_channels, 0, nb_frames);
+}
+
+
+static const ConversionKernels scalar_kernels = {SampleConversion::Scalar, convertInt16ToFloatScalar, deinterleaveScalar, interleaveScalar, interleaveToInt16Scalar, interleaveToInt16DitheredScalar, interleaveToInt32Scalar};
+
+
+#ifdef SAMPLE_CONVERSION_X86
+
+// Converts 4 float samples to 32-bit integers in the 16-bit range, exactly like convertFloatToInt16() (SSE2)
+__attribute__((target("sse2")))
+static inline __m128i convertFloatToInt16RangeSSE2(__m128 samples)
+{
+  // Clamping first keeps NaN and out-of-range values saturated; adding ±0.5 then truncating is qRound()
+  const __m128 scaled = _mm_max_ps(_mm_min_ps(_mm_mul_ps(samples, _mm_set1_ps(32767.0f)), _mm_set1_ps(32767.0f)), _mm_set1_ps(-32767.0f));
+  const __m128 half = _mm_or_ps(_mm_and_ps(scaled, _mm_set1_ps(-0.0f)), _mm_set1_ps(0.5f));
+  return _mm_cvttps_epi32(_mm_add_ps(scaled, half));
+}
+
+
+// Converts 4 float samples to 32-bit integers in the 16-bit range (only +32768 is out of range: packing saturates it) with given dither, exactly like convertFloatToInt16Dithered() (SSE2)
+__attribute__((target("sse2")))
+static inline __m128i convertFloatToInt16RangeDitheredSSE2(__m128 samples, __m128 dither)
+{
+  const __m128 scaled = _mm_max_ps(_mm_min_ps(_mm_mul_ps(samples, _mm_set1_ps(32767.0f)), _mm_set1_ps(32767.0f)), _mm_set1_ps(-32767.0f));
+  const __m128 dithered = _mm_add_ps(scaled, dither);
+  const __m128 half = _mm_or_ps(_mm_and_ps(dithered, _mm_set1_ps(-0.0f)), _mm_set1_ps(0.5f));
+  return _mm_cvttps_epi32(_mm_add_ps(dithered, half));
+}
+
+
+// Converts 4 float samples to 32-bit integers, exactly like convertFloatToInt32() (SSE2)
+__attribute__((target("sse2")))
+static inline __m128i convertFloatToInt32SSE2(__m128 samples)
+{
+  return _mm_cvtps_epi32(_mm_max_ps(_mm_min_ps(_mm_mul_ps(samples, _mm_set1_ps(2147483648.0f)), _mm_set1_ps(2147483520.0f)), _mm_set1_ps(-2147483648.0f)));
+}
+
+
+// Multiplies 32-bit integers, keeping the low 32 bits of the products (SSE2 has no such instruction)
+__attribute__((target("sse2")))
+static inline __m128i multiplyInt32SSE2(__m128i values, __m128i factors)
+{
+  const __m128i even_products = _mm_mul_epu32(values, factors);
+  const __m128i odd_products = _mm_mul_epu32(_mm_srli_epi64(values, 32), _mm_srli_epi64(factors, 32));
+  return _mm_unpacklo_epi32(_mm_shuffle_epi32(even_products, _MM_SHUFFLE(0, 0, 2, 0)), _mm_shuffle_epi32(odd_products, _MM_SHUFFLE(0, 0, 2, 0)));
+}
+
+
+// Returns the TPDF dither values of 4 indexes, exactly like ditherValue() (SSE2)
+__attribute__((target("sse2")))
+static inline __m128 ditherValuesSSE2(__m128i indexes)
+{
+  __m128i random = _mm_xor_si128(indexes, _mm_srli_epi32(indexes, 16));
+  random = multiplyInt32SSE2(random, _mm_set1_epi32(0x7FEB352D));
+  random = _mm_xor_si128(random, _mm_srli_epi32(random, 15));
+  random = multiplyInt32SSE2(random, _mm_set1_epi32(static_cast<int>(0x846CA68Bu)));
+  random = _mm_xor_si128(random, _mm_srli_epi32(random, 16));
+  const __m128i sum = _mm_add_epi32(_mm_and_si128(random, _mm_set1_epi32(0xFFFF)), _mm_srli_epi32(random, 16));
+  return _mm_mul_ps(_mm_cvtepi32_ps(_mm_sub_epi32(sum, _mm_set1_epi32(65535))), _mm_set1_ps(1.0f / 65536.0f));
+}
+
+
+// SSE2 kernel: converts 16-bit samples to float samples
+__attribute__((target("sse2")))
+static void convertInt16ToFloatSSE2(const qint16 *input, float *output, qint64 nb_samples)
+{
+  const __m128 scale = _mm_set1_ps(1.0f / 32768.0f);
+  qint64 j = 0;
+  for (; (j + 8) <= nb_samples; j += 8) {
+    const __m128i samples = _mm_loadu_si128(reinterpret_cast<const __m128i*>(input + j));
+    // Each 16-bit sample is unpacked into the high half of a 32-bit lane, then sign-extended by shifting it back
+    _mm_storeu_ps(output + j, _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpacklo_epi16(samples, samples), 16)), scale));
+    _mm_storeu_ps(output + j + 4, _mm_mul_ps(_mm_cvtepi32_ps(_mm_srai_epi32(_mm_unpackhi_epi16(samples, samples), 16)), scale));
+  }
+  convertSamplesInt16ToFloat(input, output, j, nb_samples);
+}
+
+
+// SSE2 kernel: splits interleaved samples into planar channels
+__attribute__((target("sse2")))
+static void deinterleaveSSE2(const float *input, unsigned int nb_input_channels, float *const *output, unsigned int nb_output_channels, qint64 nb_frames)
+{
+  qint64 j = 0;
+
+  if ((nb_input_channels == 2) && (nb_output_channels == 2)) {
+    for (; (j + 4) <= nb_frames; j += 4) {
+      const __m128 frames_01 = _mm_loadu_ps(input + (2 * j));
+      const __m128 frames_23 = _mm_loadu_ps(input + (2 * j) + 4);
+      _mm_storeu_ps(output[0] + j, _mm_shuffle_ps(frames_01, frames_23, _MM_SHUFFLE(2, 0, 2, 0)));
+      _mm_storeu_ps(output[1] + j, _mm_shuffle_ps(frames_01, frames_23, _MM_SHUFFLE(3, 1, 3, 1)));
+    }
+  }
+  else if (nb_output_channels >= 4) { // Blocks of 4 frames by 4 channels are transposed, remaining channels are copied one by one
+    const unsigned int nb_vector_channels = nb_output_channels & ~3u;
+    for (; (j + 4) <= nb_frames; j += 4) {
+      const float *input_frames = input + (j * nb_input_channels);
+      for (unsigned int i = 0; i < nb_vector_channels; i += 4) {
+	__m128 row_0 = _mm_loadu_ps(input_frames + i);
+	__m128 row_1 = _mm_loadu_ps(input_frames + nb_input_channels + i);
+	__m128 row_2 = _mm_loadu_ps(input_frames + (2 * nb_input_channels) + i);
+	__m128 row_3 = _mm_loadu_ps(input_frames + (3 * nb_input_channels) + i);
+	_MM_TRANSPOSE4_PS(row_0, row_1, row_2, row_3);
+	_mm_storeu_ps(output[i] + j, row_0);
+	_mm_storeu_ps(output[i + 1] + j, row_1);
+	_mm_storeu_ps(output[i + 2] + j, row_2);
+	_mm_storeu_ps(output[i + 3] + j, row_3);
+      }
+      for (unsigned int i = nb_vector_channels; i < nb_output_channels; i++)
+	for (qint64 k = 0; k < 4; k++)
+	  output[i][j + k] = input_frames[(k * nb_input_channels) + i];
+    }
+  }
+
+  deinterleaveFrames(input, nb_input_channels, output, nb_output_channels, j, nb_frames);
+}
+
+
+// SSE2 kernel: merges planar channels into interleaved samples
+__attribute__((target("sse2")))
+static void interleaveSSE2(const float *const *input, float *output, unsigned int nb_channels, qint64 nb_frames)
+{
+  qint64 j = 0;
+
+  if (nb_channels == 2) {
+    for (; (j + 4) <= nb_frames; j += 4) {
+      const __m128 left = _mm_loadu_ps(input[0] + j);
+      const __m128 right = _mm_loadu_ps(input[1] + j);
+      _mm_storeu_ps(output + (2 * j), _mm_unpacklo_ps(left, right));
+      _mm_storeu_ps(output + (2 * j) + 4, _mm_unpackhi_ps(left, right));
+    }
+  }
+  else if (nb_channels >= 4) { // Blocks of 4 channels by 4 frames are transposed, remaining channels are copied one by one
+    const unsigned int nb_vector_channels = nb_channels & ~3u;
+    for (; (j + 4) <= nb_frames; j += 4) {
+      float *output_frames = output + (j * nb_channels);
+      for (unsigned int i = 0; i < nb_vector_channels; i += 4) {
+	__m128 row_0 = _mm_loadu_ps(input[i] + j);
+	__m128 row_1 = _mm_loadu_ps(input[i + 1] + j);
+	__m128 row_2 = _mm_loadu_ps(input[i + 2] + j);
+	__m128 row_3 = _mm_loadu_ps(input[i + 3] + j);
+	_MM_TRANSPOSE4_PS(row_0, row_1, row_2, row_3);
+	_mm_storeu_ps(output_frames + i, row_0);
+	_mm_storeu_ps(output_frames + nb_channels + i, row_1);
+	_mm_storeu_ps(output_frames + (2 * nb_channels) + i, row_2);
+	_mm_storeu_ps(output_frames + (3 * nb_channels) + i, row_3);
+      }
+      for (unsigned int i = nb_vector_channels; i < nb_channels; i++)
+	for (qint64 k = 0; k < 4; k++)
+	  output_frames[(k * nb_channels) + i] = input[i][j + k];
+    }
+  }
+
+  interleaveFrames(input, output, nb_channels, j, nb_frames);
+}
+
+
+// SSE2 kernel: merges planar channels into interleaved 16-bit samples
+__attribute__((target("sse2")))
+static void interleaveToInt16SSE2(const float *const *input, qint16 *output, unsigned int nb_channels, qint64 nb_frames)
+{
+  qint64 j = 0;
+
+  if (nb_channels == 1) {
+    for (; (j + 8) <= nb_frames; j += 8) {
+      const __m128i samples_0 = convertFloatToInt16RangeSSE2(_mm_loadu_ps(input[0] + j));
+      const __m128i samples_1 = convertFloatToInt16RangeSSE2(_mm_loadu_ps(input[0] + j + 4));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(output + j), _mm_packs_epi32(samples_0, samples_1));
+    }
+  }
+  else if (nb_channels == 2) {
+    for (; (j + 4) <= nb_frames; j += 4) {
+      const __m128i left = convertFloatToInt16RangeSSE2(_mm_loadu_ps(input[0] + j));
+      const __m128i right = convertFloatToInt16RangeSSE2(_mm_loadu_ps(input[1] + j));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(output + (2 * j)), _mm_packs_epi32(_mm_unpacklo_epi32(left, right), _mm_unpackhi_epi32(left, right)));
+    }
+  }
+  else if (nb_channels >= 4) { // Blocks of 4 channels by 4 frames are transposed, remaining channels are converted one by one
+    const unsigned int nb_vector_channels = nb_channels & ~3u;
+    for (; (j + 4) <= nb_frames; j += 4) {
+      qint16 *output_frames = output + (j * nb_channels);
+      for (unsigned int i = 0; i < nb_vector_channels; i += 4) {
+	__m128 row_0 = _mm_loadu_ps(input[i] + j);
+	__m128 row_1 = _mm_loadu_ps(input[i + 1] + j);
+	__m128 row_2 = _mm_loadu_ps(input[i + 2] + j);
+	__m128 row_3 = _mm_loadu_ps(input[i + 3] + j);
+	_MM_TRANSPOSE4_PS(row_0, row_1, row_2, row_3);
+	const __m128i frames_01 = _mm_packs_epi32(convertFloatToInt16RangeSSE2(row_0), convertFloatToInt16RangeSSE2(row_1));
+	const __m128i frames_23 = _mm_packs_epi32(convertFloatToInt16RangeSSE2(row_2), convertFloatToInt16RangeSSE2(row_3));
+	_mm_storel_epi64(reinterpret_cast<__m128i*>(output_frames + i), frames_01);
+	_mm_storel_epi64(reinterpret_cast<__m128i*>(output_frames + nb_channels + i), _mm_srli_si128(frames_01, 8));
+	_mm_storel_epi64(reinterpret_cast<__m128i*>(output_frames + (2 * nb_channels) + i), frames_23);
+	_mm_storel_epi64(reinterpret_cast<__m128i*>(output_frames + (3 * nb_channels) + i), _mm_srli_si128(frames_23, 8));
+      }
+      for (unsigned int i = nb_vector_channels; i < nb_channels; i++)
+	for (qint64 k = 0; k < 4; k++)
+	  output_frames[(k * nb_channels) + i] = convertFloatToInt16(input[i][j + k]);
+    }
+  }
+
+  interleaveFramesToInt16(input, output, nb_channels, j, nb_frames);
+}
+
+
+// SSE2 kernel: merges planar channels into interleaved 16-bit samples with TPDF dither
+__attribute__((target("sse2")))
+static void interleaveToInt16DitheredSSE2(const float *const *input, qint16 *output, unsigned int nb_channels, qint64 nb_frames, quint32 dither_position)
+{
+  const __m128i frame_offsets = _mm_set_epi32(3, 2, 1, 0);
+  qint64 j = 0;
+
+  if (nb_channels == 1) {
+    for (; (j + 8) <= nb_frames; j += 8) {
+      const __m128i indexes = _mm_add_epi32(_mm_set1_epi32(static_cast<int>(ditherIndex(dither_position, 0, j))), frame_offsets);
+      const __m128i samples_0 = convertFloatToInt16RangeDitheredSSE2(_mm_loadu_ps(input[0] + j), ditherValuesSSE2(indexes));
+      const __m128i samples_1 = convertFloatToInt16RangeDitheredSSE2(_mm_loadu_ps(input[0] + j + 4), ditherValuesSSE2(_mm_add_epi32(indexes, _mm_set1_epi32(4))));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(output + j), _mm_packs_epi32(samples_0, samples_1));
+    }
+  }
+  else if (nb_channels == 2) {
+    for (; (j + 4) <= nb_frames; j += 4) {
+      const __m128i indexes = _mm_add_epi32(_mm_set1_epi32(static_cast<int>(ditherIndex(dither_position, 0, j))), frame_offsets);
+      const __m128i left = convertFloatToInt16RangeDitheredSSE2(_mm_loadu_ps(input[0] + j), ditherValuesSSE2(indexes));
+      const __m128i right = convertFloatToInt16RangeDitheredSSE2(_mm_loadu_ps(input[1] + j), ditherValuesSSE2(_mm_add_epi32(indexes, _mm_set1_epi32(static_cast<int>(DITHER_CHANNEL_STRIDE)))));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(output + (2 * j)), _mm_packs_epi32(_mm_unpacklo_epi32(left, right), _mm_unpackhi_epi32(left, right)));
+    }
+  }
+  else if (nb_channels >= 4) { // Blocks of 4 channels by 4 frames are transposed (each row then holds a frame of 4 channels), remaining channels are converted one by one
+    const unsigned int nb_vector_channels = nb_channels & ~3u;
+    for (; (j + 4) <= nb_frames; j += 4) {
+      qint16 *output_frames = output + (j * nb_channels);
+      for (unsigned int i = 0; i < nb_vector_channels; i += 4) {
+	const __m128i indexes = _mm_set_epi32(static_cast<int>(ditherIndex(dither_position, i + 3, j)), static_cast<int>(ditherIndex(dither_position, i + 2, j)), static_cast<int>(ditherIndex(dither_position, i + 1, j)), static_cast<int>(ditherIndex(dither_position, i, j)));
+	__m128 row_0 = _mm_loadu_ps(input[i] + j);
+	__m128 row_1 = _mm_loadu_ps(input[i + 1] + j);
+	__m128 row_2 = _mm_loadu_ps(input[i + 2] + j);
+	__m128 row_3 = _mm_loadu_ps(input[i + 3] + j);
+	_MM_TRANSPOSE4_PS(row_0, row_1, row_2, row_3);
+	const __m128i frames_01 = _mm_packs_epi32(convertFloatToInt16RangeDitheredSSE2(row_0, ditherValuesSSE2(indexes)), convertFloatToInt16RangeDitheredSSE2(row_1, ditherValuesSSE2(_mm_add_epi32(indexes, _mm_set1_epi32(1)))));
+	const __m128i frames_23 = _mm_packs_epi32(convertFloatToInt16RangeDitheredSSE2(row_2, ditherValuesSSE2(_mm_add_epi32(indexes, _mm_set1_epi32(2)))), convertFloatToInt16RangeDitheredSSE2(row_3, ditherValuesSSE2(_mm_add_epi32(indexes, _mm_set1_epi32(3)))));
+	_mm_storel_epi64(reinterpret_cast<__m128i*>(output_frames + i), frames_01);
+	_mm_storel_epi64(reinterpret_cast<__m128i*>(output_frames + nb_channels + i), _mm_srli_si128(frames_01, 8));
+	_mm_storel_epi64(reinterpret_cast<__m128i*>(output_frames + (2 * nb_channels) + i), frames_23);
+	_mm_storel_epi64(reinterpret_cast<__m128i*>(output_frames + (3 * nb_channels) + i), _mm_srli_si128(frames_23, 8));
+      }
+      for (unsigned int i = nb_vector_channels; i < nb_channels; i++)
+	for (qint64 k = 0; k < 4; k++)
+	  output_frames[(k * nb_channels) + i] = convertFloatToInt16Dithered(input[i][j + k], ditherValue(ditherIndex(dither_position, i, j + k)));
+    }
+  }
+
+  interleaveFramesToInt16Dithered(input, output, nb_channels, j, nb_frames, dither_position);
+}
+
+
+// SSE2 kernel: merges planar channels into interleaved 32-bit samples
+__attribute__((target("sse2")))
+static void interleaveToInt32SSE2(const float *const *input, qint32 *output, unsigned int nb_channels, qint64 nb_frames)
+{
+  qint64 j = 0;
+
+  if (nb_channels == 1) {
+    for (; (j + 4) <= nb_frames; j += 4)
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(output + j), convertFloatToInt32SSE2(_mm_loadu_ps(input[0] + j)));
+  }
+  else if (nb_channels == 2) {
+    for (; (j + 4) <= nb_frames; j += 4) {
+      const __m128i left = convertFloatToInt32SSE2(_mm_loadu_ps(input[0] + j));
+      const __m128i right = convertFloatToInt32SSE2(_mm_loadu_ps(input[1] + j));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(output + (2 * j)), _mm_unpacklo_epi32(left, right));
+      _mm_storeu_si128(reinterpret_cast<__m128i*>(output + (2 * j) + 4), _mm_unpackhi_epi32(left, right));
+    }
+  }
+  else if (nb_channels >= 4) { // Blocks of 4 channels by 4 frames are transposed, remaining channels are converted one by one
+    const unsigned int nb_vector_channels = nb_channels & ~3u;
+    for (; (j + 4) <= nb_frames; j += 4) {
+      qint32 *output_frames = output + (j * nb_channels);
+      for (unsigned int i = 0; i < nb_vector_channels; i += 4) {
+	__m128 row_0 = _mm_loadu_ps(input[i] + j);
+	__m128 row_1 = _mm_loadu_ps(input[i + 1] + j);
+	__m128 row_2 = _mm_loadu_ps(input[i + 2] + j);
+	__m128 row_3 = _mm_loadu_ps(input[i + 3] + j);
+	_MM_TRANSPOSE4_PS(row_0, row_1, row_2, row_3);
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(output_frames + i), convertFloatToInt32SSE2(row_0));
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(output_frames + nb_channels + i), convertFloatToInt32SSE2(row_1));
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(output_frames + (2 * nb_channels) + i), convertFloatToInt32SSE2(row_2));
+	_mm_storeu_si128(reinterpret_cast<__m128i*>(output_frames + (3 * nb_channels) + i), convertFloatToInt32SSE2(row_3));
+      }
+      for (unsigned int i = nb_vector_channels; i < nb_channels; i++)
+	for (qint64 k = 0; k < 4; k++)
+	  output_frames[(k * nb_channels) + i] = convertFloatToInt32(input[i][j + k]);
+    }
+  }
+
+  interleaveFramesToInt32(input, output, nb_channels, j, nb_frames);
+}
+
+
+// Converts 8 float samples to 32-bit integers in the 16-bit range, exactly like convertFloatToInt16() (AVX2)
+__attribute__((target("avx2")))
+static inline __m256i convertFloatToInt16RangeAVX2(__m256 samples)
+{
+  const __m256 scaled = _mm256_max_ps(_mm256_min_ps(_mm256_mul_ps(samples, _mm256_set1_ps(32767.0f)), _mm256_set1_ps(32767.0f)), _mm256_set1_ps(-32767.0f));
+  const __m256 half = _mm256_or_ps(_mm256_and_ps(scaled, _mm256_set1_ps(-0.0f)), _mm256_set1_ps(0.5f));
+  return _mm256_cvttps_epi32(_mm256_add_ps(scaled, half));
+}
+
+
+// AVX2 kernel: converts 16-bit samples to float samples
+__attribute__((target("avx2")))
+static void convertInt16ToFloatAVX2(const qint16 *input, float *output, qint64 nb_samples)
+{
+  const __m256 scale = _mm256_set1_ps(1.0f / 32768.0f);
+  qint64 j = 0;
+  for (; (j + 16) <= nb_samples; j += 16) {
+    const __m256i samples_0 = _mm256_cvtepi16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(input + j)));
+    const __m256i samples_1 = _mm256_cvtepi16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(input + j + 8)));
+    _mm256_storeu_ps(output + j, _mm256_mul_ps(_mm256_cvtepi32_ps(samples_0), scale));
+    _mm256_storeu_ps(output + j + 8, _mm256_mul_ps(_mm256_cvtepi32_ps(samples_1), scale));
+  }
+  convertSamplesInt16ToFloat(input, output, j, nb_samples);
+}
+
+
+// AVX2 kernel: splits interleaved samples into planar channels (other layouts than stereo are handled by the SSE2 kernel)
+__attribute__((target("avx2")))
+static void deinterleaveAVX2(const float *input, unsigned int nb_input_channels, float *const *output, unsigned int nb_output_channels, qint64 nb_frames)
+{
+  if ((nb_input_channels != 2) || (nb_output_channels != 2)) {
+    deinterleaveSSE2(input, nb_input_channels, output, nb_output_channels, nb_frames);
+    return;
+  }
+
+  qint64 j = 0;
+  for (; (j + 8) <= nb_frames; j += 8) {
+    const __m256 frames_0123 = _mm256_loadu_ps(input + (2 * j));
+    const __m256 frames_4567 = _mm256_loadu_ps(input + (2 * j) + 8);
+    // Shuffles work within 128-bit lanes: 64-bit pairs of samples are then put back in order
+    const __m256 left = _mm256_shuffle_ps(frames_0123, frames_4567, _MM_SHUFFLE(2, 0, 2, 0));
+    const __m256 right = _mm256_shuffle_ps(frames_0123, frames_4567, _MM_SHUFFLE(3, 1, 3, 1));
+    _mm256_storeu_ps(output[0] + j, _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(left), _MM_SHUFFLE(3, 1, 2, 0))));
+    _mm256_storeu_ps(output[1] + j, _mm256_castpd_ps(_mm256_permute4x64_pd(_mm256_castps_pd(right), _MM_SHUFFLE(3, 1, 2, 0))));
+  }
+  deinterleaveFrames(input, nb_input_channels, output, nb_output_channels, j, nb_frames);
+}
+
+
+// AVX2 kernel: merges planar channels into interleaved samples (other layouts than stereo are handled by the SSE2 kernel)
+__attribute__((target("avx2")))
+static void interleaveAVX2(const float *const *input, float *output, unsigned int nb_channels, qint64 nb_frames)
+{
+  if (nb_channels != 2) {
+    interleaveSSE2(input, output, nb_channels, nb_frames);
+    return;
+  }
+
+  qint64 j = 0;
+  for (; (j + 8) <= nb_frames; j += 8) {
+    const __m256 left = _mm256_loadu_ps(input[0] + j);
+    const __m256 right = _mm256_loadu_ps(input[1] + j);
+    const __m256 frames_0145 = _mm256_unpacklo_ps(left, right);
+    const __m256 frames_2367 = _mm256_unpackhi_ps(left, right);
+    _mm256_storeu_ps(output + (2 * j), _mm256_permute2f128_ps(frames_0145, frames_2367, 0x20));
+    _mm256_storeu_ps(output + (2 * j) + 8, _mm256_permute2f128_ps(frames_0145, frames_2367, 0x31));
+  }
+  interleaveFrames(input, output, nb_channels, j, nb_frames);
+}
+
+
+// AVX2 kernel: merges planar channels into interleaved 16-bit samples (other layouts than mono and stereo are handled by the SSE2 kernel)
+__attribute__((target("avx2")))
+static void interleaveToInt16AVX2(const float *const *input, qint16 *output, unsigned int nb_channels, qint64 nb_frames)
+{
+  qint64 j = 0;
+
+  if (nb_channels == 1) {
+    for (; (j + 16) <= nb_frames; j += 16) {
+      const __m256i samples_0 = convertFloatToInt16RangeAVX2(_mm256_loadu_ps(input[0] + j));
+      const __m256i samples_1 = convertFloatToInt16RangeAVX2(_mm256_loadu_ps(input[0] + j + 8));
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(output + j), _mm256_permute4x64_epi64(_mm256_packs_epi32(samples_0, samples_1), _MM_SHUFFLE(3, 1, 2, 0)));
+    }
+  }
+  else if (nb_channels == 2) {
+    for (; (j + 8) <= nb_frames; j += 8) {
+      const __m256i left = convertFloatToInt16RangeAVX2(_mm256_loadu_ps(input[0] + j));
+      const __m256i right = convertFloatToInt16RangeAVX2(_mm256_loadu_ps(input[1] + j));
+      // Within each 128-bit lane, unpacking then packing gives 4 consecutive stereo frames: lanes are already in order
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(output + (2 * j)), _mm256_packs_epi32(_mm256_unpacklo_epi32(left, right), _mm256_unpackhi_epi32(left, right)));
+    }
+  }
+  else {
+    interleaveToInt16SSE2(input, output, nb_channels, nb_frames);
+    return;
+  }
+
+  interleaveFramesToInt16(input, output, nb_channels, j, nb_frames);
+}
+
+
+static const ConversionKernels sse2_kernels = {SampleConversion::SSE2, convertInt16ToFloatSSE2, deinterleaveSSE2, interleaveSSE2, interleaveToInt16SSE2, interleaveToInt16DitheredSSE2, interleaveToInt32SSE2};
+static const ConversionKernels avx2_kernels = {SampleConversion::AVX2, convertInt16ToFloatAVX2, deinterleaveAVX2, interleaveAVX2, interleaveToInt16AVX2, interleaveToInt16DitheredSSE2, interleaveToInt32SSE2}; // Output formats only used without float support keep the SSE2 kernels
+
+#endif
+
+
+// Returns the kernels built for given instruction set
+static const ConversionKernels* kernelsForInstructionSet(SampleConversion::InstructionSet instruction_set)
+{
+#ifdef SAMPLE_CONVERSION_X86
+  if (instruction_set == SampleConversion::AVX2)
+    return &avx2_kernels;
+  if (instruction_set == SampleConversion::SSE2)
+    return &sse2_kernels;
+#endif
+  Q_UNUSED(instruction_set);
+  return &scalar_kernels;
+}
+
+
+static std::atomic<const ConversionKernels*> current_kernels(kernelsForInstructionSet(SampleConversion::bestInstructionSet()));
+
+
+// Returns the most capable instruction set supported by the CPU
+SampleConversion::InstructionSet SampleConversion::bestInstructionSet()
+{
+#ifdef SAMPLE_CONVERSION_X86
+  __builtin_cpu_init(); // May be called before static constructors of the runtime library
+  if (__builtin_cpu_supports("avx2"))
+    return SampleConversion::AVX2;
+  if (__builtin_cpu_supports("sse2"))
+    return SampleConversion::SSE2;
+#endif
+  return SampleConversion::Scalar;
+}
+
+
+// Returns the instruction set of the kernels in use
+SampleConversion::InstructionSet SampleConversion::currentInstructionSet()
+{
+  return current_kernels.load(std::memory_order_relaxed)->instruction_set;
+}
+
+
+// Converts 16-bit samples to float samples, scaling by 1/32768
+void SampleConversion::convertInt16ToFloat(const qint16 *input, float *output, qint64 nb_samples)
+{
+  current_kernels.load(std::memory_order_relaxed)->convert_int16_to_float(input, output, nb_samples);
+}
+
+
+// Splits the first nb_output_channels channels of interleaved frames into planar channels
+void SampleConversion::deinterleave(const float *input, unsigned int nb_input_channels, float *const *output, unsigned int nb_output_channels, qint64 nb_frames)
+{
+  current_kernels.load(std::memory_order_relaxed)->deinterleave(input, nb_input_channels, output, nb_output_channels, nb_frames);
+}
+
+
+// Merges planar channels into interleaved frames
+void SampleConversion::interleave(const float *const *input, float *output, unsigned int nb_channels, qint64 nb_frames)
+{
+  current_kernels.load(std::memory_order_relaxed)->interleave(input, output, nb_channels, nb_frames);
+}
+
+
+// Merges planar channels into interleaved 16-bit frames, scaling by 32767 with rounding and saturation
+void SampleConversion::interleaveToInt16(const float *const *input, qint16 *output, unsigned int nb_channels, qint64 nb_frames)
+{
+  current_kernels.load(std::memory_order_relaxed)->interleave_to_int16(input, output, nb_channels, nb_frames);
+}
+
+
+// Merges planar channels into interleaved 16-bit frames like interleaveToInt16(), adding TPDF dither of ±1 LSB first. dither_position is advanced by nb_frames, so that consecutive calls continue the dither sequence
+void SampleConversion::interleaveToInt16Dithered(const float *const *input, qint16 *output, unsigned int nb_channels, qint64 nb_frames, quint32 &dither_position)
+{
+  current_kernels.load(std::memory_order_relaxed)->interleave_to_int16_dithered(input, output, nb_channels, nb_frames, dither_position);
+  dither_position += static_cast<quint32>(nb_frames);
+}
+
+
+// Merges planar channels into interleaved 16-bit frames like interleaveToInt16Dithered(), shaping the quantization noise by error feedback. shaping_errors holds the last 2 errors of each channel, kept between calls (zeroed at first)
+void SampleConversion::interleaveToInt16NoiseShaped(const float *const *input, qint16 *output, unsigned int nb_channels, qint64 nb_frames, quint32 &dither_position, float *shaping_errors)
+{
+  // Each sample depends on the error of the previous one: channels are converted one after the other, sample by sample, with the same dither as interleaveToInt16Dithered().
+  // Clipped samples feed their whole error back, which then decays (1 / (1 - z^-1 + 0.5 z^-2) is stable)
+  for (unsigned int i = 0; i < nb_channels; i++) {
+    float error_1 = shaping_errors[2 * i];
+    float error_2 = shaping_errors[(2 * i) + 1];
+    for (qint64 j = 0; j < nb_frames; j++) {
+      const float target = (qBound(-32767.0f, input[i][j] * 32767.0f, 32767.0f) - (NOISE_SHAPING_COEFFICIENT_2 * error_2)) - (NOISE_SHAPING_COEFFICIENT_1 * error_1); // Only the last subtraction waits for the previous error
+      const float sample = qBound(-32768.0f, ((target + ditherValue(ditherIndex(dither_position, i, j))) + ROUNDING_OFFSET) - ROUNDING_OFFSET, 32767.0f);
+      error_2 = error_1;
+      error_1 = sample - target;
+      output[(j * nb_channels) + i] = static_cast<qint16>(sample);
+    }
+    shaping_errors[2 * i] = error_1;
+    shaping_errors[(2 * i) + 1] = error_2;
+  }
+  dither_position += static_cast<quint32>(nb_frames);
+}
+
+
+// Merges planar channels into interleaved 32-bit frames, scaling by 2^31 with rounding to nearest and saturation
+void SampleConversion::interleaveToInt32(const float *const *input, qint32 *output, unsigned int nb_channels, qint64 nb_frames)
+{
+  current_kernels.load(std::memory_order_relaxed)->interleave_to_int32(input, output, nb_channels, nb_frames);
+}
+
+
+// Selects the kernels to use (at most the best supported ones). Must not be called while samples are converted
+void SampleConversion::setInstructionSet(SampleConversion::InstructionSet instruction_set)
+{
+  current_kernels.store(kernelsForInstructionSet(qMin(instruction_set, bestInstructionSet())), std::memory_order_relaxed);
+}
@@ -0,0 +1,36 @@
+// Copyright 2026 François CROLLET
+
+// This file is part of VPS Player.
+// VPS Player is free software; you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation; either version 3 of the License, or (at your option) any later version.
+// VPS Player is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License along with VPS Player. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef SAMPLE_CONVERSION_H
+#define SAMPLE_CONVERSION_H
+
+#include <QtGlobal>
+
+
+// Kernels moving samples between interleaved and planar layouts (or converting planar samples), vectorized with the best instruction set supported by the CPU (chosen at run time)
+namespace SampleConversion
+{
+  enum InstructionSet
+    {
+     Scalar = 0,
+     SSE2 = 1,
+     AVX2 = 2
+    };
+
+  SampleConversion::InstructionSet bestInstructionSet(); // Returns the most capable instruction set supported by the CPU
+  SampleConversion::InstructionSet currentInstructionSet(); // Returns the instruction set of the kernels in use
+  void convertInt16ToFloat(const qint16 *input, float *output, qint64 nb_samples); // Converts 16-bit samples to float samples, scaling by 1/32768
+  void deinterleave(const float *input, unsigned int nb_input_channels, float *const *output, unsigned int nb_output_channels, qint64 nb_frames); // Splits the first nb_output_channels channels of interleaved frames into planar channels
+  void interleave(const float *const *input, float *output, unsigned int nb_channels, qint64 nb_frames); // Merges planar channels into interleaved frames
+  void interleaveToInt16(const float *const *input, qint16 *output, unsigned int nb_channels, qint64 nb_frames); // Merges planar channels into interleaved 16-bit frames, scaling by 32767 with rounding and saturation
+  void interleaveToInt16Dithered(const float *const *input, qint16 *output, unsigned int nb_channels, qint64 nb_frames, quint32 &dither_position); // Merges planar channels into interleaved 16-bit frames like interleaveToInt16(), adding TPDF dither of ±1 LSB first. dither_position is advanced by nb_frames, so that consecutive calls continue the dither sequence
+  void interleaveToInt16NoiseShaped(const float *const *input, qint16 *output, unsigned int nb_channels, qint64 nb_frames, quint32 &dither_position, float *shaping_errors); // Merges planar channels into interleaved 16-bit frames like interleaveToInt16Dithered(), shaping the quantization noise by error feedback. shaping_errors holds the last 2 errors of each channel, kept between calls (zeroed at first)
+  void interleaveToInt32(const float *const *input, qint32 *output, unsigned int nb_channels, qint64 nb_frames); // Merges planar channels into interleaved 32-bit frames, scaling by 2^31 with rounding to nearest and saturation
+  void setInstructionSet(SampleConversion::InstructionSet instruction_set); // Selects the kernels to use (at most the best supported ones). Must not be called while samples are converted
+}
+
+#endif
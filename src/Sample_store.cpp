@@ -0,0 +1,511 @@
+// Copyright 2026 François CROLLET
+
+// This file is part of VPS Player.
+// VPS Player is free software; you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation; either version 3 of the License, or (at your option) any later version.
+// VPS Player is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License along with VPS Player. If not, see <http://www.gnu.org/licenses/>.
+
+#include <cstring>
+#include <new>
+#include <type_traits>
+#include <QAudioFormat>
+#include <QMutexLocker>
+#include <QVarLengthArray>
+
+#include "Sample_conversion.h"
+#include "Sample_store.h"
+
+#define SAMPLE_STORE_SURROUND_GAIN 0.70710678f // Gain (-3 dB) of remixed channels that have no counterpart in the store, on each channel they go to
+
+
+// Constructor
+SampleStore::SampleStore(unsigned int channel_count, int frame_rate, SampleStore::StorageFormat format) : nb_channels(channel_count),
+													   sample_rate(frame_rate),
+													   storage_format(format),
+													   chunk_size(static_cast<qint64>((format == SampleStore::Int16) ? sizeof(qint16) : sizeof(float)) * channel_count * SAMPLE_STORE_CHUNK_FRAMES),
+													   nb_frames(0),
+													   complete(false),
+													   waveform_overview(std::make_shared<WaveformOverview>(frame_rate)),
+													   nb_remixed_channels(0)
+{
+
+}
+
+
+// Destructor
+SampleStore::~SampleStore()
+{
+  if (!mapped_file) // Mapped chunks are released when the file is closed
+    for (char *chunk : chunks)
+      ::operator delete[](chunk, std::align_val_t(SAMPLE_STORE_ALIGNMENT));
+}
+
+
+// Append a decoded buffer (samples are converted to the storage format)
+void SampleStore::append(const QAudioBuffer &audio_buffer)
+{
+  append(audio_buffer.constData<void>(), audio_buffer.format().sampleFormat(), static_cast<qint64>(audio_buffer.frameCount()), static_cast<unsigned int>(audio_buffer.format().channelCount()));
+}
+
+
+// Append interleaved samples (converted to the storage format)
+void SampleStore::append(const void *samples, QAudioFormat::SampleFormat sample_format, qint64 frame_count, unsigned int channel_count)
+{
+  if ((sample_format == QAudioFormat::Unknown) || (frame_count <= 0)) [[unlikely]]
+    return;
+
+  const qint64 frame = nb_frames.load(std::memory_order_relaxed); // The decoder is the only writer
+  write(frame, samples, sample_format, frame_count, channel_count);
+  nb_frames.store(frame + frame_count, std::memory_order_release);
+}
+
+
+// Append planar float samples, one array per channel (converted to the storage format)
+void SampleStore::append(const float *const *channel_samples, qint64 frame_count)
+{
+  if (frame_count <= 0) [[unlikely]]
+    return;
+
+  qint64 frame = nb_frames.load(std::memory_order_relaxed); // The prerenderer is the only writer
+  const qint64 end_frame = frame + frame_count;
+
+  while (frame < end_frame) {
+    const qsizetype chunk_index = static_cast<qsizetype>(frame / SAMPLE_STORE_CHUNK_FRAMES);
+    const qint64 chunk_offset = frame % SAMPLE_STORE_CHUNK_FRAMES;
+    char *chunk = chunkForWriting(chunk_index);
+    const qint64 nb_chunk_frames = qMin(SAMPLE_STORE_CHUNK_FRAMES - chunk_offset, end_frame - frame);
+    const qint64 input_offset = frame_count - (end_frame - frame);
+    QVarLengthArray<const float*, 8> input_channels(nb_channels);
+
+    for (unsigned int i = 0; i < nb_channels; i++) {
+      const float *input_samples = channel_samples[i] + input_offset;
+      input_channels[i] = input_samples;
+      if (storage_format == SampleStore::Int16) {
+	qint16 *stored_samples = reinterpret_cast<qint16*>(chunk) + (i * SAMPLE_STORE_CHUNK_FRAMES) + chunk_offset;
+	for (qint64 j = 0; j < nb_chunk_frames; j++)
+	  stored_samples[j] = static_cast<qint16>(qBound(-32768, qRound(input_samples[j] * 32768.0f), 32767));
+      }
+      else
+	std::memcpy(reinterpret_cast<float*>(chunk) + (i * SAMPLE_STORE_CHUNK_FRAMES) + chunk_offset, input_samples, sizeof(float) * nb_chunk_frames);
+    }
+    waveform_overview->addFrames(frame, input_channels.data(), nb_channels, nb_chunk_frames);
+    frame += nb_chunk_frames;
+  }
+
+  nb_frames.store(end_frame, std::memory_order_release);
+}
+
+
+// Returns the number of channels
+unsigned int SampleStore::channelCount() const
+{
+  return nb_channels;
+}
+
+
+// Returns the duration of decoded audio in microseconds
+qint64 SampleStore::decodedDuration() const
+{
+  return positionForFrame(frameCount());
+}
+
+
+// Returns the number of decoded frames
+qint64 SampleStore::frameCount() const
+{
+  return nb_frames.load(std::memory_order_acquire);
+}
+
+
+// Returns the frame corresponding to given position (in microseconds)
+qint64 SampleStore::frameForPosition(qint64 position) const
+{
+  return (position * sample_rate) / 1000000;
+}
+
+
+// Returns the format samples are kept in
+SampleStore::StorageFormat SampleStore::getStorageFormat() const
+{
+  return storage_format;
+}
+
+
+// Returns true if the whole file has been decoded
+bool SampleStore::isComplete() const
+{
+  return complete.load(std::memory_order_acquire);
+}
+
+
+// Maps chunks previously written by writeChunks() from an open file (and reads the waveform overview following them), and marks the store as complete
+bool SampleStore::mapFile(std::unique_ptr<QFile> file, qint64 offset, qint64 frame_count)
+{
+  const qint64 nb_chunks = (frame_count + SAMPLE_STORE_CHUNK_FRAMES - 1) / SAMPLE_STORE_CHUNK_FRAMES;
+  if (!chunks.isEmpty() || (file->size() < offset + (nb_chunks * chunk_size)))
+    return false;
+  if (!file->seek(offset + (nb_chunks * chunk_size)) || !waveform_overview->read(*file, frame_count))
+    return false;
+
+  uchar *mapped_data = file->map(offset, nb_chunks * chunk_size);
+  if (mapped_data == nullptr)
+    return false;
+
+  {
+    QMutexLocker locker(&mutex);
+    for (qint64 i = 0; i < nb_chunks; i++)
+      chunks.append(reinterpret_cast<char*>(mapped_data + (i * chunk_size)));
+  }
+  mapped_file = std::move(file);
+  nb_frames.store(frame_count, std::memory_order_release);
+  complete.store(true, std::memory_order_release);
+  return true;
+}
+
+
+// Returns the memory used by the chunks (in bytes)
+qint64 SampleStore::memoryUsage() const
+{
+  QMutexLocker locker(&mutex);
+  return chunks.size() * chunk_size;
+}
+
+
+// Returns the position (in microseconds) corresponding to given frame
+qint64 SampleStore::positionForFrame(qint64 frame) const
+{
+  return (frame * 1000000) / sample_rate;
+}
+
+
+// Points channel_data to contiguous planar float samples starting at given frame (converted into conversion_buffer, which must hold max_frames frames per channel, if samples are not stored as float). Returns the number of frames readable from these pointers
+qint64 SampleStore::readFrames(qint64 frame, qint64 max_frames, const float **channel_data, float *const *conversion_buffer) const
+{
+  const qint64 available_frames = frameCount();
+  if (frame >= available_frames)
+    return 0;
+
+  const qsizetype chunk_index = static_cast<qsizetype>(frame / SAMPLE_STORE_CHUNK_FRAMES);
+  const qint64 chunk_offset = frame % SAMPLE_STORE_CHUNK_FRAMES;
+  const qint64 nb_read_frames = qMin(qMin(max_frames, available_frames - frame), SAMPLE_STORE_CHUNK_FRAMES - chunk_offset);
+  const char *chunk;
+  {
+    QMutexLocker locker(&mutex);
+    chunk = chunks.at(chunk_index);
+  }
+
+  if (storage_format == SampleStore::Int16) {
+    const qint16 *stored_samples = reinterpret_cast<const qint16*>(chunk) + chunk_offset;
+    for (unsigned int i = 0; i < nb_channels; i++) {
+      SampleConversion::convertInt16ToFloat(stored_samples + (i * SAMPLE_STORE_CHUNK_FRAMES), conversion_buffer[i], nb_read_frames);
+      channel_data[i] = conversion_buffer[i];
+    }
+  }
+  else {
+    const float *stored_samples = reinterpret_cast<const float*>(chunk) + chunk_offset;
+    for (unsigned int i = 0; i < nb_channels; i++)
+      channel_data[i] = stored_samples + (i * SAMPLE_STORE_CHUNK_FRAMES);
+  }
+
+  return nb_read_frames;
+}
+
+
+// Returns the sample rate
+int SampleStore::sampleRate() const
+{
+  return sample_rate;
+}
+
+
+// Mark the store as complete (no more buffer will be appended)
+void SampleStore::setComplete()
+{
+  complete.store(true, std::memory_order_release);
+}
+
+
+// Makes the frames before given one readable, once they have been filled by write()
+void SampleStore::setFrameCount(qint64 frame_count)
+{
+  nb_frames.store(frame_count, std::memory_order_release);
+}
+
+
+// Sets the channel count (and layout) of samples to be written: if it is not the store's, they are remixed as they are written. Must be called before any write
+void SampleStore::setInputChannels(unsigned int channel_count, QAudioFormat::ChannelConfig channel_config)
+{
+  remix_matrix.clear();
+  nb_remixed_channels = 0;
+  if ((channel_count == nb_channels) || (channel_count == 0)) [[likely]]
+    return;
+
+  nb_remixed_channels = channel_count;
+  remix_matrix = QList<float>(static_cast<qsizetype>(nb_channels) * channel_count, 0.0f);
+  if (channel_count == 1) { // Mono is played on every channel
+    remix_matrix.fill(1.0f);
+    return;
+  }
+  if (nb_channels == 1) {
+    remix_matrix.fill(1.0f / static_cast<float>(channel_count));
+    return;
+  }
+
+  // Input channels go to the stored channel at the same position, otherwise to the front channel of their side (center ones to both front channels), except LFE ones
+  const QList<QAudioFormat::AudioChannelPosition> input_positions = channelPositions(channel_config, channel_count);
+  const QList<QAudioFormat::AudioChannelPosition> stored_positions = channelPositions(QAudioFormat::ChannelConfigUnknown, nb_channels);
+  auto add_gain = [this, channel_count, &stored_positions](QAudioFormat::AudioChannelPosition stored_position, unsigned int input_channel, float gain){
+    const qsizetype stored_channel = stored_positions.indexOf(stored_position);
+    if (stored_channel >= 0)
+      remix_matrix[(stored_channel * channel_count) + input_channel] += gain;
+    return (stored_channel >= 0);
+  };
+  for (unsigned int i = 0; i < channel_count; i++) {
+    const QAudioFormat::AudioChannelPosition position = input_positions.at(static_cast<qsizetype>(i));
+    if (position == QAudioFormat::UnknownPosition) {
+      remix_matrix[((i % nb_channels) * channel_count) + i] = 1.0f;
+      continue;
+    }
+    if (add_gain(position, i, 1.0f))
+      continue;
+    switch(position) {
+    case QAudioFormat::LFE :
+    case QAudioFormat::LFE2 :
+      break;
+    case QAudioFormat::FrontLeftOfCenter :
+    case QAudioFormat::BackLeft :
+    case QAudioFormat::SideLeft :
+    case QAudioFormat::TopFrontLeft :
+    case QAudioFormat::TopBackLeft :
+    case QAudioFormat::TopSideLeft :
+    case QAudioFormat::BottomFrontLeft :
+      add_gain(QAudioFormat::FrontLeft, i, SAMPLE_STORE_SURROUND_GAIN);
+      break;
+    case QAudioFormat::FrontRightOfCenter :
+    case QAudioFormat::BackRight :
+    case QAudioFormat::SideRight :
+    case QAudioFormat::TopFrontRight :
+    case QAudioFormat::TopBackRight :
+    case QAudioFormat::TopSideRight :
+    case QAudioFormat::BottomFrontRight :
+      add_gain(QAudioFormat::FrontRight, i, SAMPLE_STORE_SURROUND_GAIN);
+      break;
+    default : // Center channels
+      if (!add_gain(QAudioFormat::FrontCenter, i, SAMPLE_STORE_SURROUND_GAIN)) {
+	add_gain(QAudioFormat::FrontLeft, i, SAMPLE_STORE_SURROUND_GAIN);
+	add_gain(QAudioFormat::FrontRight, i, SAMPLE_STORE_SURROUND_GAIN);
+      }
+    }
+  }
+
+  // Gains are scaled down so that no stored channel can exceed full scale
+  float max_gain_sum = 1.0f;
+  for (unsigned int i = 0; i < nb_channels; i++) {
+    float gain_sum = 0.0f;
+    for (unsigned int j = 0; j < channel_count; j++)
+      gain_sum += remix_matrix.at((i * channel_count) + j);
+    max_gain_sum = qMax(max_gain_sum, gain_sum);
+  }
+  for (float &gain : remix_matrix)
+    gain /= max_gain_sum;
+}
+
+
+// Returns the waveform overview of the samples written so far
+std::shared_ptr<const WaveformOverview> SampleStore::waveformOverview() const
+{
+  return waveform_overview;
+}
+
+
+// Writes interleaved samples at given frame (converted to the storage format), without making them readable: regions written concurrently by several decoders must not overlap
+void SampleStore::write(qint64 frame, const void *samples, QAudioFormat::SampleFormat sample_format, qint64 frame_count, unsigned int channel_count)
+{
+  switch(sample_format) {
+  case QAudioFormat::UInt8 :
+    writeInterleavedSamples<quint8>(frame, static_cast<const quint8*>(samples), frame_count, channel_count);
+    break;
+  case QAudioFormat::Int16 :
+    writeInterleavedSamples<qint16>(frame, static_cast<const qint16*>(samples), frame_count, channel_count);
+    break;
+  case QAudioFormat::Int32 :
+    writeInterleavedSamples<qint32>(frame, static_cast<const qint32*>(samples), frame_count, channel_count);
+    break;
+  case QAudioFormat::Float :
+    writeInterleavedSamples<float>(frame, static_cast<const float*>(samples), frame_count, channel_count);
+    break;
+  default :
+    break;
+  }
+}
+
+
+// Writes all chunks, then the waveform overview, to given device, in the layout expected by mapFile()
+bool SampleStore::writeChunks(QIODevice &device) const
+{
+  QList<char*> written_chunks;
+  {
+    QMutexLocker locker(&mutex); // Only the list is copied under the lock, so that readers are not held up while writing: chunks are never moved nor freed while the store exists
+    written_chunks = chunks;
+  }
+  for (const char *chunk : written_chunks)
+    if (device.write(chunk, chunk_size) != chunk_size)
+      return false;
+  return waveform_overview->write(device, frameCount());
+}
+
+
+// Converts a decoded sample to float <quint8>
+template<>
+inline float SampleStore::convertSampleToFloat<quint8>(quint8 sample) const
+{
+  return (static_cast<float>(sample) - 128.0f) / 128.0f;
+}
+
+
+// Converts a decoded sample to float <qint16>
+template<>
+inline float SampleStore::convertSampleToFloat<qint16>(qint16 sample) const
+{
+  return static_cast<float>(sample) / 32768.0f;
+}
+
+
+// Converts a decoded sample to float <qint32>
+template<>
+inline float SampleStore::convertSampleToFloat<qint32>(qint32 sample) const
+{
+  return static_cast<float>(sample) / 2147483648.0f;
+}
+
+
+// Converts a decoded sample to float <float>
+template<>
+inline float SampleStore::convertSampleToFloat<float>(float sample) const
+{
+  return sample;
+}
+
+
+// Converts a float sample to storage format <qint16>
+template<>
+inline qint16 SampleStore::convertFloatToStorageFormat<qint16>(float sample) const
+{
+  return static_cast<qint16>(qBound(-32768, qRound(sample * 32768.0f), 32767));
+}
+
+
+// Converts a float sample to storage format <float>
+template<>
+inline float SampleStore::convertFloatToStorageFormat<float>(float sample) const
+{
+  return sample;
+}
+
+
+// Deinterleaves samples into the chunks from given frame, in the storage format
+template<typename INPUT_FORMAT>
+void SampleStore::writeInterleavedSamples(qint64 frame, const INPUT_FORMAT *input_samples, qint64 nb_input_frames, unsigned int nb_input_channels)
+{
+  if (storage_format == SampleStore::Int16)
+    copyInterleavedSamples<INPUT_FORMAT, qint16>(input_samples, nb_input_frames, nb_input_channels, frame);
+  else
+    copyInterleavedSamples<INPUT_FORMAT, float>(input_samples, nb_input_frames, nb_input_channels, frame);
+}
+
+
+// Deinterleaves samples into the chunks from given frame, converting them to STORAGE_FORMAT. Returns the frame following the last copied one
+template<typename INPUT_FORMAT, typename STORAGE_FORMAT>
+qint64 SampleStore::copyInterleavedSamples(const INPUT_FORMAT *input_samples, qint64 nb_input_frames, unsigned int nb_input_channels, qint64 frame)
+{
+  const unsigned int nb_copied_channels = qMin(nb_channels, nb_input_channels);
+  qint64 nb_done_frames = 0;
+
+  while (nb_done_frames < nb_input_frames) {
+    const qsizetype chunk_index = static_cast<qsizetype>(frame / SAMPLE_STORE_CHUNK_FRAMES);
+    const qint64 chunk_offset = frame % SAMPLE_STORE_CHUNK_FRAMES;
+    STORAGE_FORMAT *chunk = reinterpret_cast<STORAGE_FORMAT*>(chunkForWriting(chunk_index));
+    const qint64 nb_chunk_frames = qMin(SAMPLE_STORE_CHUNK_FRAMES - chunk_offset, nb_input_frames - nb_done_frames);
+
+    if (nb_input_channels == nb_remixed_channels) { // Each stored channel is a weighted sum of the input channels
+      for (unsigned int i = 0; i < nb_channels; i++) {
+	STORAGE_FORMAT *channel_samples = chunk + (i * SAMPLE_STORE_CHUNK_FRAMES) + chunk_offset;
+	const float *gains = remix_matrix.constData() + (i * nb_input_channels);
+	for (qint64 j = 0; j < nb_chunk_frames; j++) {
+	  const INPUT_FORMAT *input_frame = input_samples + ((nb_done_frames + j) * nb_input_channels);
+	  float sample = 0.0f;
+	  for (unsigned int k = 0; k < nb_input_channels; k++)
+	    sample += gains[k] * convertSampleToFloat<INPUT_FORMAT>(input_frame[k]);
+	  channel_samples[j] = convertFloatToStorageFormat<STORAGE_FORMAT>(sample);
+	}
+      }
+    }
+    else if constexpr (std::is_same_v<INPUT_FORMAT, float> && std::is_same_v<STORAGE_FORMAT, float>) { // Plain deinterleaving: vectorized kernel
+      QVarLengthArray<float*, 8> channel_samples(nb_copied_channels);
+      for (unsigned int i = 0; i < nb_copied_channels; i++)
+	channel_samples[i] = chunk + (i * SAMPLE_STORE_CHUNK_FRAMES) + chunk_offset;
+      SampleConversion::deinterleave(input_samples + (nb_done_frames * nb_input_channels), nb_input_channels, channel_samples.data(), nb_copied_channels, nb_chunk_frames);
+    }
+    else {
+      for (unsigned int i = 0; i < nb_copied_channels; i++) {
+	STORAGE_FORMAT *channel_samples = chunk + (i * SAMPLE_STORE_CHUNK_FRAMES) + chunk_offset;
+	const INPUT_FORMAT *input_frame = input_samples + (nb_done_frames * nb_input_channels) + i;
+	for (qint64 j = 0; j < nb_chunk_frames; j++)
+	  channel_samples[j] = convertFloatToStorageFormat<STORAGE_FORMAT>(convertSampleToFloat<INPUT_FORMAT>(input_frame[j * nb_input_channels]));
+      }
+    }
+
+    QVarLengthArray<const STORAGE_FORMAT*, 8> stored_samples(nb_channels); // Channels missing from the input are silent
+    for (unsigned int i = 0; i < nb_channels; i++)
+      stored_samples[i] = chunk + (i * SAMPLE_STORE_CHUNK_FRAMES) + chunk_offset;
+    waveform_overview->addFrames(frame, stored_samples.data(), nb_channels, nb_chunk_frames);
+
+    nb_done_frames += nb_chunk_frames;
+    frame += nb_chunk_frames;
+  }
+
+  return frame;
+}
+
+
+// Returns the position of each channel of given layout (Qt's default layout for the channel count if unknown, unknown positions if there is none)
+QList<QAudioFormat::AudioChannelPosition> SampleStore::channelPositions(QAudioFormat::ChannelConfig channel_config, unsigned int channel_count)
+{
+  if (channel_config == QAudioFormat::ChannelConfigUnknown)
+    channel_config = QAudioFormat::defaultChannelConfigForChannelCount(static_cast<int>(channel_count));
+
+  // Channels are ordered as positions are
+  QList<QAudioFormat::AudioChannelPosition> positions;
+  for (int position = QAudioFormat::FrontLeft; position <= QAudioFormat::BottomFrontRight; position++)
+    if (static_cast<quint32>(channel_config) & (1u << position))
+      positions.append(static_cast<QAudioFormat::AudioChannelPosition>(position));
+  if (positions.size() != static_cast<qsizetype>(channel_count))
+    positions = QList<QAudioFormat::AudioChannelPosition>(static_cast<qsizetype>(channel_count), QAudioFormat::UnknownPosition);
+  return positions;
+}
+
+
+// Returns the chunk of given index, allocating the chunks up to it if needed
+char* SampleStore::chunkForWriting(qsizetype chunk_index)
+{
+  {
+    QMutexLocker locker(&mutex);
+    if (chunk_index < chunks.size()) [[likely]]
+      return chunks.at(chunk_index);
+  }
+
+  // Chunks are allocated outside of the lock, which readers take too: another writer may have added the chunk meanwhile
+  while (true) {
+    char *chunk = static_cast<char*>(::operator new[](static_cast<size_t>(chunk_size), std::align_val_t(SAMPLE_STORE_ALIGNMENT)));
+    std::memset(chunk, 0, static_cast<size_t>(chunk_size)); // Channels missing from a buffer stay silent
+
+    QMutexLocker locker(&mutex);
+    if (chunk_index < chunks.size()) {
+      ::operator delete[](chunk, std::align_val_t(SAMPLE_STORE_ALIGNMENT));
+      return chunks.at(chunk_index);
+    }
+    chunks.append(chunk);
+    if (chunk_index < chunks.size())
+      return chunk;
+  }
+}
@@ -0,0 +1,91 @@
+// Copyright 2026 François CROLLET
+
+// This file is part of VPS Player.
+// VPS Player is free software; you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation; either version 3 of the License, or (at your option) any later version.
+// VPS Player is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License along with VPS Player. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef SAMPLE_STORE_H
+#define SAMPLE_STORE_H
+
+#include <atomic>
+#include <memory>
+#include <QAudioBuffer>
+#include <QAudioFormat>
+#include <QFile>
+#include <QIODevice>
+#include <QList>
+#include <QMutex>
+
+#include "Waveform_overview.h"
+
+#define SAMPLE_STORE_CHUNK_FRAMES 65536 // Number of frames per chunk (must be a power of 2)
+#define SAMPLE_STORE_ALIGNMENT 64 // Alignment of chunks in memory (in bytes)
+
+
+// Growing store of decoded (or prerendered) audio: samples are kept planar in large aligned chunks, filled by the decoder while the renderer is already reading from them
+class SampleStore
+{
+public:
+  enum StorageFormat
+    {
+     Float32 = 0, // Samples are kept as decoded (as float)
+     Int16 = 1 // Samples are kept as 16-bit integers, which halves memory usage
+    };
+
+private:
+  unsigned int nb_channels;
+  int sample_rate;
+  SampleStore::StorageFormat storage_format;
+  qint64 chunk_size;
+  mutable QMutex mutex; // Protects the chunk list (not the samples themselves)
+  QList<char*> chunks;
+  std::atomic<qint64> nb_frames;
+  std::atomic<bool> complete;
+  std::unique_ptr<QFile> mapped_file; // When set, chunks point into this memory-mapped file instead of being allocated
+  std::shared_ptr<WaveformOverview> waveform_overview; // Kept up to date by every write
+  unsigned int nb_remixed_channels; // Channel count of written samples remixed to the store's channels (0 if none)
+  QList<float> remix_matrix; // Gain of each input channel, stored channel by stored channel
+
+public:
+  SampleStore(unsigned int channel_count, int frame_rate, SampleStore::StorageFormat format = SampleStore::Float32); // Constructor
+  ~SampleStore(); // Destructor
+  void append(const QAudioBuffer &audio_buffer); // Append a decoded buffer (samples are converted to the storage format)
+  void append(const void *samples, QAudioFormat::SampleFormat sample_format, qint64 frame_count, unsigned int channel_count); // Append interleaved samples (converted to the storage format)
+  void append(const float *const *channel_samples, qint64 frame_count); // Append planar float samples, one array per channel (converted to the storage format)
+  unsigned int channelCount() const; // Returns the number of channels
+  qint64 decodedDuration() const; // Returns the duration of decoded audio in microseconds
+  qint64 frameCount() const; // Returns the number of decoded frames
+  qint64 frameForPosition(qint64 position) const; // Returns the frame corresponding to given position (in microseconds)
+  SampleStore::StorageFormat getStorageFormat() const; // Returns the format samples are kept in
+  bool isComplete() const; // Returns true if the whole file has been decoded
+  bool mapFile(std::unique_ptr<QFile> file, qint64 offset, qint64 frame_count); // Maps chunks previously written by writeChunks() from an open file (and reads the waveform overview following them), and marks the store as complete
+  qint64 positionForFrame(qint64 frame) const; // Returns the position (in microseconds) corresponding to given frame
+  qint64 memoryUsage() const; // Returns the memory used by the chunks (in bytes)
+  qint64 readFrames(qint64 frame, qint64 max_frames, const float **channel_data, float *const *conversion_buffer) const; // Points channel_data to contiguous planar float samples starting at given frame (converted into conversion_buffer, which must hold max_frames frames per channel, if samples are not stored as float). Returns the number of frames readable from these pointers
+  int sampleRate() const; // Returns the sample rate
+  void setComplete(); // Mark the store as complete (no more buffer will be appended)
+  void setFrameCount(qint64 frame_count); // Makes the frames before given one readable, once they have been filled by write()
+  void setInputChannels(unsigned int channel_count, QAudioFormat::ChannelConfig channel_config = QAudioFormat::ChannelConfigUnknown); // Sets the channel count (and layout) of samples to be written: if it is not the store's, they are remixed as they are written. Must be called before any write
+  std::shared_ptr<const WaveformOverview> waveformOverview() const; // Returns the waveform overview of the samples written so far
+  void write(qint64 frame, const void *samples, QAudioFormat::SampleFormat sample_format, qint64 frame_count, unsigned int channel_count); // Writes interleaved samples at given frame (converted to the storage format), without making them readable: regions written concurrently by several decoders must not overlap
+  bool writeChunks(QIODevice &device) const; // Writes all chunks, then the waveform overview, to given device, in the layout expected by mapFile()
+
+private:
+  template<typename INPUT_FORMAT>
+  inline float convertSampleToFloat(INPUT_FORMAT sample) const; // Converts a decoded sample to float
+
+  template<typename STORAGE_FORMAT>
+  inline STORAGE_FORMAT convertFloatToStorageFormat(float sample) const; // Converts a float sample to storage format (float or qint16)
+
+  template<typename INPUT_FORMAT>
+  void writeInterleavedSamples(qint64 frame, const INPUT_FORMAT *input_samples, qint64 nb_input_frames, unsigned int nb_input_channels); // Deinterleaves samples into the chunks from given frame, in the storage format
+
+  template<typename INPUT_FORMAT, typename STORAGE_FORMAT>
+  qint64 copyInterleavedSamples(const INPUT_FORMAT *input_samples, qint64 nb_input_frames, unsigned int nb_input_channels, qint64 frame); // Deinterleaves samples into the chunks from given frame, converting them to STORAGE_FORMAT. Returns the frame following the last copied one
+
+  static QList<QAudioFormat::AudioChannelPosition> channelPositions(QAudioFormat::ChannelConfig channel_config, unsigned int channel_count); // Returns the position of each channel of given layout (Qt's default layout for the channel count if unknown, unknown positions if there is none)
+  char* chunkForWriting(qsizetype chunk_index); // Returns the chunk of given index, allocating the chunks up to it if needed
+};
+
+#endif
@@ -0,0 +1,54 @@
+// Copyright 2026 François CROLLET
+
+// This file is part of VPS Player.
+// VPS Player is free software; you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation; either version 3 of the License, or (at your option) any later version.
+// VPS Player is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License along with VPS Player. If not, see <http://www.gnu.org/licenses/>.
+
+#include <cmath>
+
+#include "Stretcher_settings.h"
+
+
+// Constructor (no pitch or speed change, R3 engine, formant preserved, high quality, channels processed sequentially)
+StretcherSettings::StretcherSettings() : time_ratio(1.0),
+					 pitch_scale(1.0),
+					 use_r3_engine(true),
+					 formant_preserved(true),
+					 high_quality(true),
+					 channels_together(false),
+					 parallel_channels(false)
+{
+
+}
+
+
+// Returns options' flag that can be passed to the stretcher (for live playing, or for offline rendering if real_time is false)
+RubberBand::RubberBandStretcher::Options StretcherSettings::generateOptionsFlag(bool real_time) const
+{
+  RubberBand::RubberBandStretcher::Options options = static_cast<RubberBand::RubberBandStretcher::Option>(RubberBand::RubberBandStretcher::DefaultOptions) | RubberBand::RubberBandStretcher::OptionThreadingNever;
+  options |= real_time ? RubberBand::RubberBandStretcher::OptionProcessRealTime : RubberBand::RubberBandStretcher::OptionProcessOffline;
+  if (use_r3_engine)
+    options |= RubberBand::RubberBandStretcher::OptionEngineFiner;
+  if (formant_preserved)
+    options |= RubberBand::RubberBandStretcher::OptionFormantPreserved;
+  if (high_quality)
+    options |= RubberBand::RubberBandStretcher::OptionPitchHighQuality;
+  if (channels_together)
+    options |= RubberBand::RubberBandStretcher::OptionChannelsTogether;
+  return options;
+}
+
+
+// Sets the pitch scale from a pitch change in semitones
+void StretcherSettings::setPitch(double pitch)
+{
+  pitch_scale = std::pow(2.0, pitch / 12.0);
+}
+
+
+// Sets the time ratio from a speed ratio
+void StretcherSettings::setSpeed(double speed_ratio)
+{
+  time_ratio = 1.0 / speed_ratio;
+}
@@ -0,0 +1,31 @@
+// Copyright 2026 François CROLLET
+
+// This file is part of VPS Player.
+// VPS Player is free software; you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation; either version 3 of the License, or (at your option) any later version.
+// VPS Player is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License along with VPS Player. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef STRETCHER_SETTINGS_H
+#define STRETCHER_SETTINGS_H
+
+#include <rubberband/RubberBandStretcher.h>
+
+
+// Pitch, speed and options of a stretcher, shared by live playing and offline rendering
+struct StretcherSettings
+{
+  double time_ratio;
+  double pitch_scale;
+  bool use_r3_engine;
+  bool formant_preserved;
+  bool high_quality;
+  bool channels_together;
+  bool parallel_channels; // Channels (or channel pairs) are processed by separate stretchers in separate threads
+
+  StretcherSettings(); // Constructor (no pitch or speed change, R3 engine, formant preserved, high quality, channels processed sequentially)
+  RubberBand::RubberBandStretcher::Options generateOptionsFlag(bool real_time = true) const; // Returns options' flag that can be passed to the stretcher (for live playing, or for offline rendering if real_time is false)
+  void setPitch(double pitch); // Sets the pitch scale from a pitch change in semitones
+  void setSpeed(double speed_ratio); // Sets the time ratio from a speed ratio
+};
+
+#endif
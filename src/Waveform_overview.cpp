@@ -0,0 +1,223 @@
+// Copyright 2026 François CROLLET
+
+// This file is part of VPS Player.
+// VPS Player is free software; you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation; either version 3 of the License, or (at your option) any later version.
+// VPS Player is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License along with VPS Player. If not, see <http://www.gnu.org/licenses/>.
+
+#include <cmath>
+#include <type_traits>
+#include <QMutexLocker>
+
+#include "Waveform_overview.h"
+
+
+// Constructor
+WaveformOverview::WaveformOverview(int frame_rate) : sample_rate(frame_rate)
+{
+
+}
+
+
+// Destructor
+WaveformOverview::~WaveformOverview()
+{
+  for (WaveformOverview::Bucket *block : blocks)
+    delete[] block;
+}
+
+
+// Summarizes planar float samples written at given frame
+void WaveformOverview::addFrames(qint64 frame, const float *const *channel_samples, unsigned int channel_count, qint64 frame_count)
+{
+  addSamples<float>(frame, channel_samples, channel_count, frame_count);
+}
+
+
+// Summarizes planar 16-bit samples written at given frame
+void WaveformOverview::addFrames(qint64 frame, const qint16 *const *channel_samples, unsigned int channel_count, qint64 frame_count)
+{
+  addSamples<qint16>(frame, channel_samples, channel_count, frame_count);
+}
+
+
+// Summarizes the first frame_count frames in column_count columns of equal length, up to end_frame (columns starting after it are not returned). Reads a few buckets per column, whatever the length of the audio
+QList<WaveformOverview::Peak> WaveformOverview::columnPeaks(qint64 frame_count, int column_count, qint64 end_frame) const
+{
+  QList<WaveformOverview::Peak> peaks;
+  if ((frame_count <= 0) || (column_count <= 0))
+    return peaks;
+
+  // Columns are summarized from the coarsest level whose buckets are not longer than a column
+  const qint64 block_frames = bucketFrames(WAVEFORM_LEVEL_COUNT - 1);
+  const qint64 column_frames = qMax(frame_count / column_count, static_cast<qint64>(1));
+  int level = 0;
+  while ((level < (WAVEFORM_LEVEL_COUNT - 1)) && (bucketFrames(level + 1) <= column_frames))
+    level++;
+  const qint64 nb_bucket_frames = bucketFrames(level);
+
+  QMutexLocker locker(&mutex);
+  end_frame = qMin(qMin(end_frame, frame_count), blocks.size() * block_frames);
+  peaks.reserve(column_count);
+  for (int column = 0; column < column_count; column++) {
+    const qint64 start_frame = (frame_count * column) / column_count;
+    if (start_frame >= end_frame)
+      break;
+    const qint64 column_end_frame = qMin(qMax((frame_count * (column + 1)) / column_count, start_frame + 1), end_frame);
+
+    WaveformOverview::Peak peak{0.0f, 0.0f, 0.0f};
+    float square_sum = 0.0f;
+    qint64 bucket_frame = start_frame - (start_frame % nb_bucket_frames);
+    const qint64 first_bucket_frame = bucket_frame;
+    for (; bucket_frame < column_end_frame; bucket_frame += nb_bucket_frames) {
+      const WaveformOverview::Bucket &bucket = blocks.at(static_cast<qsizetype>(bucket_frame / block_frames))[bucketIndex(level, bucket_frame % block_frames)];
+      peak.min = qMin(peak.min, bucket.min.load(std::memory_order_relaxed));
+      peak.max = qMax(peak.max, bucket.max.load(std::memory_order_relaxed));
+      square_sum += bucket.square_sum.load(std::memory_order_relaxed);
+    }
+    peak.rms = std::sqrt(square_sum / static_cast<float>(qMin(bucket_frame, end_frame) - first_bucket_frame));
+    peaks.append(peak);
+  }
+
+  return peaks;
+}
+
+
+// Reads the buckets summarizing frame_count frames, as written by write()
+bool WaveformOverview::read(QIODevice &device, qint64 frame_count)
+{
+  const qint64 block_frames = bucketFrames(WAVEFORM_LEVEL_COUNT - 1);
+  const qsizetype nb_blocks = static_cast<qsizetype>((frame_count + block_frames - 1) / block_frames);
+  const qsizetype nb_block_buckets = blockBucketCount();
+  QList<float> block_levels(nb_block_buckets * 3);
+  const qint64 block_size = static_cast<qint64>(sizeof(float)) * block_levels.size();
+
+  for (qsizetype i = 0; i < nb_blocks; i++) {
+    if (device.read(reinterpret_cast<char*>(block_levels.data()), block_size) != block_size)
+      return false;
+    WaveformOverview::Bucket *block = blockForWriting(i);
+    for (qsizetype j = 0; j < nb_block_buckets; j++) {
+      block[j].min.store(block_levels.at(3 * j), std::memory_order_relaxed);
+      block[j].max.store(block_levels.at((3 * j) + 1), std::memory_order_relaxed);
+      block[j].square_sum.store(block_levels.at((3 * j) + 2), std::memory_order_relaxed);
+    }
+  }
+  return true;
+}
+
+
+// Returns the sample rate
+int WaveformOverview::sampleRate() const
+{
+  return sample_rate;
+}
+
+
+// Writes the buckets summarizing frame_count frames to given device
+bool WaveformOverview::write(QIODevice &device, qint64 frame_count) const
+{
+  const qint64 block_frames = bucketFrames(WAVEFORM_LEVEL_COUNT - 1);
+  const qsizetype nb_blocks = static_cast<qsizetype>((frame_count + block_frames - 1) / block_frames);
+  const qsizetype nb_block_buckets = blockBucketCount();
+  QList<float> block_levels(nb_block_buckets * 3);
+  const qint64 block_size = static_cast<qint64>(sizeof(float)) * block_levels.size();
+
+  QMutexLocker locker(&mutex);
+  for (qsizetype i = 0; i < nb_blocks; i++) {
+    block_levels.fill(0.0f);
+    if (i < blocks.size()) {
+      const WaveformOverview::Bucket *block = blocks.at(i);
+      for (qsizetype j = 0; j < nb_block_buckets; j++) {
+	block_levels[3 * j] = block[j].min.load(std::memory_order_relaxed);
+	block_levels[(3 * j) + 1] = block[j].max.load(std::memory_order_relaxed);
+	block_levels[(3 * j) + 2] = block[j].square_sum.load(std::memory_order_relaxed);
+      }
+    }
+    if (device.write(reinterpret_cast<const char*>(block_levels.constData()), block_size) != block_size)
+      return false;
+  }
+  return true;
+}
+
+
+// Summarizes planar samples written at given frame, bucket by bucket of the finest level
+template<typename SAMPLE_FORMAT>
+void WaveformOverview::addSamples(qint64 frame, const SAMPLE_FORMAT *const *channel_samples, unsigned int channel_count, qint64 frame_count)
+{
+  constexpr float sample_scale = std::is_same_v<SAMPLE_FORMAT, qint16> ? (1.0f / 32768.0f) : 1.0f;
+  const qint64 block_frames = bucketFrames(WAVEFORM_LEVEL_COUNT - 1);
+  qint64 nb_done_frames = 0;
+
+  while (nb_done_frames < frame_count) {
+    const qint64 bucket_frame = frame + nb_done_frames;
+    const qint64 nb_bucket_frames = qMin(WAVEFORM_BUCKET_FRAMES - (bucket_frame % WAVEFORM_BUCKET_FRAMES), frame_count - nb_done_frames);
+    float min = 0.0f;
+    float max = 0.0f;
+    float square_sum = 0.0f;
+    for (unsigned int i = 0; i < channel_count; i++) {
+      const SAMPLE_FORMAT *samples = channel_samples[i] + nb_done_frames;
+      for (qint64 j = 0; j < nb_bucket_frames; j++) {
+	const float sample = static_cast<float>(samples[j]) * sample_scale;
+	min = qMin(min, sample);
+	max = qMax(max, sample);
+	square_sum += sample * sample;
+      }
+    }
+
+    // The frames belong to one bucket of each level
+    WaveformOverview::Bucket *block = blockForWriting(static_cast<qsizetype>(bucket_frame / block_frames));
+    for (int level = 0; level < WAVEFORM_LEVEL_COUNT; level++)
+      mergeIntoBucket(block[bucketIndex(level, bucket_frame % block_frames)], min, max, square_sum / static_cast<float>(channel_count));
+    nb_done_frames += nb_bucket_frames;
+  }
+}
+
+
+// Returns the number of buckets of a block, all levels together
+qsizetype WaveformOverview::blockBucketCount()
+{
+  return bucketIndex(WAVEFORM_LEVEL_COUNT - 1, 0) + 1;
+}
+
+
+// Returns the buckets of given block, allocating the blocks up to it if needed
+WaveformOverview::Bucket* WaveformOverview::blockForWriting(qsizetype block_index)
+{
+  QMutexLocker locker(&mutex);
+  while (block_index >= blocks.size())
+    blocks.append(new WaveformOverview::Bucket[blockBucketCount()]()); // Zeroed
+  return blocks.at(block_index);
+}
+
+
+// Returns the number of frames summarized by a bucket of given level
+qint64 WaveformOverview::bucketFrames(int level)
+{
+  qint64 nb_frames = WAVEFORM_BUCKET_FRAMES;
+  for (int i = 0; i < level; i++)
+    nb_frames *= WAVEFORM_LEVEL_RATIO;
+  return nb_frames;
+}
+
+
+// Returns the index, within its block, of the bucket of given level holding the frame at given offset from the start of the block
+int WaveformOverview::bucketIndex(int level, qint64 block_offset)
+{
+  const qint64 block_frames = bucketFrames(WAVEFORM_LEVEL_COUNT - 1);
+  qint64 index = 0;
+  for (int i = 0; i < level; i++) // Finer levels come first
+    index += block_frames / bucketFrames(i);
+  return static_cast<int>(index + (block_offset / bucketFrames(level)));
+}
+
+
+// Merges the levels of some frames into a bucket
+void WaveformOverview::mergeIntoBucket(WaveformOverview::Bucket &bucket, float min, float max, float square_sum)
+{
+  // Only buckets spanning the boundary of two concurrently written regions are ever contended
+  float current_min = bucket.min.load(std::memory_order_relaxed);
+  while ((min < current_min) && !bucket.min.compare_exchange_weak(current_min, min, std::memory_order_relaxed));
+  float current_max = bucket.max.load(std::memory_order_relaxed);
+  while ((max > current_max) && !bucket.max.compare_exchange_weak(current_max, max, std::memory_order_relaxed));
+  bucket.square_sum.fetch_add(square_sum, std::memory_order_relaxed);
+}
@@ -0,0 +1,66 @@
+// Copyright 2026 François CROLLET
+
+// This file is part of VPS Player.
+// VPS Player is free software; you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation; either version 3 of the License, or (at your option) any later version.
+// VPS Player is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
+// You should have received a copy of the GNU General Public License along with VPS Player. If not, see <http://www.gnu.org/licenses/>.
+
+#ifndef WAVEFORM_OVERVIEW_H
+#define WAVEFORM_OVERVIEW_H
+
+#include <atomic>
+#include <memory>
+#include <QIODevice>
+#include <QList>
+#include <QMutex>
+
+#define WAVEFORM_BUCKET_FRAMES 1024 // Number of frames summarized by a bucket of the finest level
+#define WAVEFORM_LEVEL_RATIO 4 // Each level summarizes this many buckets of the level below it in a bucket...
+#define WAVEFORM_LEVEL_COUNT 4 // ... and there are this many levels, the coarsest one summarizing WAVEFORM_BUCKET_FRAMES * WAVEFORM_LEVEL_RATIO^(WAVEFORM_LEVEL_COUNT - 1) frames per bucket
+
+
+// Min/max/RMS pyramid of audio, built incrementally as samples are written (possibly by several threads, in any order), so that a waveform can be drawn at any width from a few buckets per column
+class WaveformOverview
+{
+public:
+  struct Peak // Levels of a stretch of audio, all channels together
+  {
+    float min;
+    float max;
+    float rms;
+  };
+
+private:
+  struct Bucket // Buckets start at zero, so that they always span the zero line
+  {
+    std::atomic<float> min;
+    std::atomic<float> max;
+    std::atomic<float> square_sum; // Sum over the frames of the mean square of the channels
+  };
+
+  int sample_rate;
+  mutable QMutex mutex; // Protects the block list (not the buckets themselves)
+  QList<WaveformOverview::Bucket*> blocks; // Each block holds the buckets of all levels summarizing a bucket of the coarsest level, finest level first
+
+public:
+  WaveformOverview(int frame_rate); // Constructor
+  ~WaveformOverview(); // Destructor
+  void addFrames(qint64 frame, const float *const *channel_samples, unsigned int channel_count, qint64 frame_count); // Summarizes planar float samples written at given frame
+  void addFrames(qint64 frame, const qint16 *const *channel_samples, unsigned int channel_count, qint64 frame_count); // Summarizes planar 16-bit samples written at given frame
+  QList<WaveformOverview::Peak> columnPeaks(qint64 frame_count, int column_count, qint64 end_frame) const; // Summarizes the first frame_count frames in column_count columns of equal length, up to end_frame (columns starting after it are not returned). Reads a few buckets per column, whatever the length of the audio
+  bool read(QIODevice &device, qint64 frame_count); // Reads the buckets summarizing frame_count frames, as written by write()
+  int sampleRate() const; // Returns the sample rate
+  bool write(QIODevice &device, qint64 frame_count) const; // Writes the buckets summarizing frame_count frames to given device
+
+private:
+  template<typename SAMPLE_FORMAT>
+  void addSamples(qint64 frame, const SAMPLE_FORMAT *const *channel_samples, unsigned int channel_count, qint64 frame_count); // Summarizes planar samples written at given frame, bucket by bucket of the finest level
+
+  static qsizetype blockBucketCount(); // Returns the number of buckets of a block, all levels together
+  WaveformOverview::Bucket* blockForWriting(qsizetype block_index); // Returns the buckets of given block, allocating the blocks up to it if needed
+  static qint64 bucketFrames(int level); // Returns the number of frames summarized by a bucket of given level
+  static int bucketIndex(int level, qint64 block_offset); // Returns the index, within its block, of the bucket of given level holding the frame at given offset from the start of the block
+  static void mergeIntoBucket(WaveformOverview::Bucket &bucket, float min, float max, float square_sum); // Merges the levels of some frames into a bucket
+};
+
+#endif
@@ -1,42 +1,205 @@
-// Copyright 2018-2020 François CROLLET
+// Copyright 2018-2026 François CROLLET
 
 // This file is part of VPS Player.
 // VPS Player is free software; you can redistribute it and/or modify it under the terms of the GNU General Public License as published by the Free Software Foundation; either version 3 of the License, or (at your option) any later version.
 // VPS Player is distributed in the hope that it will be useful, but WITHOUT ANY WARRANTY; without even the implied warranty of MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU General Public License for more details.
 // You should have received a copy of the GNU General Public License along with VPS Player. If not, see <http://www.gnu.org/licenses/>.
 
+#include <cstring>
+#include <memory>
+#include <utility>
 #include <QApplication>
+#include <QCommandLineOption>
 #include <QCommandLineParser>
 #include <QCoreApplication>
 #include <QIcon>
+#include <QList>
 #include <QString>
 #include <QStringList>
+#include <QTextStream>
+#include <QTimer>
 
+#include "Audio_exporter.h"
+#include "Audio_loader.h"
+#include "Batch_processor.h"
 #include "Player_window.h"
+#include "Stretcher_settings.h"
+
+
+// Returns true if the command line asks for a run without any window
+bool isHeadlessRun(int argc, char *argv[])
+{
+  for (int i = 1; i < argc; i++)
+    if ((std::strcmp(argv[i], "--export") == 0) || (std::strncmp(argv[i], "--export=", 9) == 0) || (std::strcmp(argv[i], "--batch") == 0))
+      return true;
+  return false;
+}
+
+
+// Decodes a file and renders it with given settings to an output file, without any window. Returns the exit code of the application
+int exportFile(const QString &input_filename, const QString &output_filename, const StretcherSettings &settings, bool decode_cache, bool reduced_memory)
+{
+  QTextStream error_stream(stderr);
+  AudioLoader loader(input_filename, reduced_memory ? SampleStore::Int16 : SampleStore::Float32);
+  loader.setDecodeCacheEnabled(decode_cache);
+
+  QObject::connect(&loader, &AudioLoader::loadingProgressChanged, [&error_stream](int progress){ error_stream << QStringLiteral("\rDecoding: %1 %").arg(progress, 3) << Qt::flush; });
+  QObject::connect(&loader, &AudioLoader::decodingError, [&error_stream](QAudioDecoder::Error error){
+    error_stream << "\nError while decoding audio file: " << error << Qt::endl;
+    QCoreApplication::exit(1);
+  });
+  QObject::connect(&loader, &AudioLoader::finished, [&](){
+    error_stream << Qt::endl;
+    AudioExporter exporter(loader.getSamples(), settings, output_filename);
+    QObject::connect(&exporter, &AudioExporter::progressChanged, [&error_stream](int progress){ error_stream << QStringLiteral("\rRendering: %1 %").arg(progress, 3) << Qt::flush; });
+    bool success = exporter.render();
+    error_stream << Qt::endl;
+    if (!success)
+      error_stream << "Error while exporting audio file: " << exporter.errorString() << Qt::endl;
+    QCoreApplication::exit(success ? 0 : 1);
+  });
+
+  QTimer::singleShot(0, &loader, &AudioLoader::start); // Signals may be emitted right away (file in the cache): the event loop must be running
+  return QCoreApplication::exec();
+}
+
+
+// Renders files at given presets with given settings, without any window. Returns the exit code of the application
+int processBatch(const QStringList &filenames, const QList<BatchProcessor::Preset> &presets, const StretcherSettings &settings, const QString &output_directory, const QString &output_suffix, bool decode_cache, bool reduced_memory)
+{
+  BatchProcessor batch_processor(BatchProcessor::listAudioFiles(filenames), presets, settings, output_directory, output_suffix);
+  batch_processor.setDecodeCacheEnabled(decode_cache);
+  batch_processor.setReducedMemoryUsage(reduced_memory);
+  QObject::connect(&batch_processor, &BatchProcessor::finished, [](int nb_failed_jobs){ QCoreApplication::exit((nb_failed_jobs == 0) ? 0 : 1); });
+
+  QTimer::singleShot(0, &batch_processor, &BatchProcessor::start); // finished() may be emitted right away: the event loop must be running
+  return QCoreApplication::exec();
+}
 
 
 int main(int argc, char *argv[])
 {
-  QApplication app(argc, argv);
+  const bool headless = isHeadlessRun(argc, argv);
+  std::unique_ptr<QCoreApplication> app;
+  if (headless) // No widget is needed to export files
+    app = std::make_unique<QCoreApplication>(argc, argv);
+  else
+    app = std::make_unique<QApplication>(argc, argv);
   QCoreApplication::setApplicationName(QStringLiteral("VPS Player"));
   QCoreApplication::setApplicationVersion(QStringLiteral(VERSION_STRING));
-  const QIcon app_icon(QStringLiteral(":/vps-64.png"));
-  app.setWindowIcon(app_icon);
-  
+
   QString filename;
+  QStringList filenames;
+  QString export_filename;
+  bool batch = false;
+  QList<BatchProcessor::Preset> presets;
+  QString output_directory;
+  QString output_suffix;
+  bool decode_cache;
+  bool reduced_memory;
+  int render_ahead = 0;
+  int latency = 0;
+  StretcherSettings settings;
   {
     QCommandLineParser parser;
     parser.setApplicationDescription("High quality Variable Pitch and Speed audio player");
     parser.addHelpOption();
     parser.addVersionOption();
-    parser.addPositionalArgument("file", "Audio file to open (optional)", "[file]");
-    parser.process(app);
-    const QStringList arguments = parser.positionalArguments();
-    if (!arguments.isEmpty())
-      filename = arguments.first();
+    parser.addPositionalArgument("file", "Audio file to open (optional, unless a file is exported). Several files or directories can be given with --batch", "[file...]");
+    const QCommandLineOption decode_cache_option(QStringLiteral("decode-cache"), "Keep decoded files in an on-disk cache, so that reopening them is almost instant");
+    parser.addOption(decode_cache_option);
+    const QCommandLineOption reduced_memory_option(QStringLiteral("reduced-memory"), "Keep decoded audio as 16-bit integers, which halves memory usage for long recordings");
+    parser.addOption(reduced_memory_option);
+    const QCommandLineOption render_ahead_option(QStringLiteral("render-ahead"), "Maximum duration of stretched audio rendered ahead of playback, which absorbs processing peaks (default: 2000)", QStringLiteral("milliseconds"));
+    parser.addOption(render_ahead_option);
+    const QCommandLineOption latency_option(QStringLiteral("latency"), "Latency profile: audio buffered by the sound card, among 20, 50, 100 and 200 (default). Lower values make pausing and settings changes more responsive", QStringLiteral("milliseconds"));
+    parser.addOption(latency_option);
+    const QCommandLineOption export_option(QStringLiteral("export"), "Render the whole file to <output> (WAV, or FLAC if its name ends with \".flac\") without opening any window, then quit", QStringLiteral("output"));
+    parser.addOption(export_option);
+    const QCommandLineOption batch_option(QStringLiteral("batch"), "Render all given files (and audio files in given directories) at each preset without opening any window, one job per core, then quit");
+    parser.addOption(batch_option);
+    const QCommandLineOption preset_option(QStringLiteral("preset"), "Pitch change (in semitones) and speed ratio of a batch rendering, e.g. \"-2:0.8\". May be repeated (default: --pitch and --speed)", QStringLiteral("semitones:ratio"));
+    parser.addOption(preset_option);
+    const QCommandLineOption output_directory_option(QStringLiteral("output-dir"), "Directory where batch renderings are written (default: next to each file)", QStringLiteral("directory"));
+    parser.addOption(output_directory_option);
+    const QCommandLineOption format_option(QStringLiteral("format"), "Format of batch renderings: wav (default) or flac", QStringLiteral("format"), QStringLiteral("wav"));
+    parser.addOption(format_option);
+    const QCommandLineOption pitch_option(QStringLiteral("pitch"), "Pitch change of the exported file, in semitones (default: 0)", QStringLiteral("semitones"), QStringLiteral("0"));
+    parser.addOption(pitch_option);
+    const QCommandLineOption speed_option(QStringLiteral("speed"), "Speed ratio of the exported file (default: 1.0)", QStringLiteral("ratio"), QStringLiteral("1.0"));
+    parser.addOption(speed_option);
+    const QCommandLineOption engine_option(QStringLiteral("engine"), "Rubber Band engine used for exported files: r2 (faster) or r3 (finer, default)", QStringLiteral("engine"), QStringLiteral("r3"));
+    parser.addOption(engine_option);
+    const QCommandLineOption no_formant_option(QStringLiteral("no-formant-preservation"), "Do not preserve formant shape in exported files");
+    parser.addOption(no_formant_option);
+    const QCommandLineOption channels_together_option(QStringLiteral("channels-together"), "Process channels together in exported files");
+    parser.addOption(channels_together_option);
+    const QCommandLineOption parallel_channels_option(QStringLiteral("parallel-channels"), "Process channels (or channel pairs) of the exported file in parallel threads (ignored by --batch, which renders one job per core)");
+    parser.addOption(parallel_channels_option);
+    parser.process(*app);
+    decode_cache = parser.isSet(decode_cache_option);
+    reduced_memory = parser.isSet(reduced_memory_option);
+    if (parser.isSet(render_ahead_option)) {
+      bool render_ahead_valid = false;
+      render_ahead = parser.value(render_ahead_option).toInt(&render_ahead_valid);
+      if (!render_ahead_valid || (render_ahead <= 0)) {
+	QTextStream(stderr) << "A positive render-ahead duration is expected" << Qt::endl;
+	return 1;
+      }
+    }
+    if (parser.isSet(latency_option)) {
+      latency = parser.value(latency_option).toInt();
+      if ((latency != 20) && (latency != 50) && (latency != 100) && (latency != 200)) {
+	QTextStream(stderr) << "A latency among 20, 50, 100 and 200 is expected" << Qt::endl;
+	return 1;
+      }
+    }
+    filenames = parser.positionalArguments();
+    if (!filenames.isEmpty())
+      filename = filenames.first();
+
+    if (headless) {
+      export_filename = parser.value(export_option);
+      batch = parser.isSet(batch_option);
+      output_directory = parser.value(output_directory_option);
+      output_suffix = parser.value(format_option).toLower();
+      QStringList preset_values = parser.values(preset_option);
+      if (preset_values.isEmpty())
+	preset_values.append(parser.value(pitch_option) + QStringLiteral(":") + parser.value(speed_option));
+      bool presets_valid = true;
+      for (const QString &preset_value : std::as_const(preset_values)) {
+	const QStringList preset_fields = preset_value.split(QLatin1Char(':'));
+	bool pitch_valid = false, speed_valid = false;
+	BatchProcessor::Preset preset{0.0, 0.0};
+	if (preset_fields.size() == 2) {
+	  preset.pitch = preset_fields.at(0).toDouble(&pitch_valid);
+	  preset.speed_ratio = preset_fields.at(1).toDouble(&speed_valid);
+	}
+	presets_valid = presets_valid && pitch_valid && speed_valid && (preset.speed_ratio > 0.0);
+	presets.append(preset);
+      }
+      const QString engine = parser.value(engine_option).toLower();
+      if (filename.isEmpty() || !presets_valid || (batch == parser.isSet(export_option)) || ((output_suffix != QStringLiteral("wav")) && (output_suffix != QStringLiteral("flac"))) || ((engine != QStringLiteral("r2")) && (engine != QStringLiteral("r3")))) {
+	QTextStream(stderr) << "Either --export or --batch, input files, valid pitches, positive speed ratios, a format among wav and flac and an engine among r2 and r3 are expected" << Qt::endl;
+	return 1;
+      }
+      settings.setPitch(presets.first().pitch);
+      settings.setSpeed(presets.first().speed_ratio);
+      settings.use_r3_engine = (engine == QStringLiteral("r3"));
+      settings.formant_preserved = !parser.isSet(no_formant_option);
+      settings.channels_together = parser.isSet(channels_together_option);
+      settings.parallel_channels = parser.isSet(parallel_channels_option);
+    }
   }
-  
-  PlayerWindow window(app_icon, filename);
+
+  if (headless && batch)
+    return processBatch(filenames, presets, settings, output_directory, output_suffix, decode_cache, reduced_memory);
+  if (headless)
+    return exportFile(filename, export_filename, settings, decode_cache, reduced_memory);
+
+  const QIcon app_icon(QStringLiteral(":/vps-64.png"));
+  QApplication::setWindowIcon(app_icon);
+  PlayerWindow window(app_icon, filename, decode_cache, reduced_memory, render_ahead, latency);
   window.show();
-  return app.exec();
+  return app->exec();
 }
@@ -0,0 +1,32 @@
+TEMPLATE = app
+CONFIG += qt console warn_on release link_pkgconfig exceptions_off c++20
+CONFIG -= app_bundle
+QT += multimedia
+PKGCONFIG += rubberband
+DEFINES += VERSION_STRING=\\\"2.1.2\\\"
+INCLUDEPATH += src
+MOC_DIR = build_tmp_benchmark
+OBJECTS_DIR = build_tmp_benchmark
+HEADERS = benchmark/Allocation_counter.h \
+          benchmark/Conversion_benchmark.h \
+          benchmark/Pipeline_benchmark.h \
+          src/Audio_prerenderer.h \
+          src/Audio_renderer.h \
+          src/Parallel_stretcher.h \
+          src/Playback_statistics.h \
+          src/Sample_conversion.h \
+          src/Sample_store.h \
+          src/Stretcher_settings.h \
+          src/Waveform_overview.h
+SOURCES = benchmark/main.cpp \
+          benchmark/Allocation_counter.cpp \
+          benchmark/Conversion_benchmark.cpp \
+          benchmark/Pipeline_benchmark.cpp \
+          src/Audio_prerenderer.cpp \
+          src/Audio_renderer.cpp \
+          src/Parallel_stretcher.cpp \
+          src/Sample_conversion.cpp \
+          src/Sample_store.cpp \
+          src/Stretcher_settings.cpp \
+          src/Waveform_overview.cpp
+TARGET = vpsplayer-benchmark
@@ -9,14 +9,45 @@ DEFINES += NO_EXCEPTIONS
 MOC_DIR = build_tmp
 OBJECTS_DIR = build_tmp
 RCC_DIR = build_tmp
-HEADERS = src/Audio_player.h \
+HEADERS = src/Audio_exporter.h \
+          src/Audio_file_writer.h \
+          src/Audio_loader.h \
+          src/Audio_player.h \
+          src/Audio_prerenderer.h \
+          src/Audio_renderer.h \
+          src/Batch_processor.h \
+          src/Decode_cache.h \
+          src/Flac_file_decoder.h \
+          src/Native_decoder.h \
+          src/Parallel_stretcher.h \
+          src/Pcm_file_decoder.h \
+          src/Playback_statistics.h \
           src/Player_window.h \
           src/Playing_progress.h \
+          src/Sample_conversion.h \
+          src/Sample_store.h \
+          src/Stretcher_settings.h \
+          src/Waveform_overview.h \
           src/tools.h
 SOURCES = src/main.cpp \
+          src/Audio_exporter.cpp \
+          src/Audio_file_writer.cpp \
+          src/Audio_loader.cpp \
           src/Audio_player.cpp \
+          src/Audio_prerenderer.cpp \
+          src/Audio_renderer.cpp \
+          src/Batch_processor.cpp \
+          src/Decode_cache.cpp \
+          src/Flac_file_decoder.cpp \
+          src/Native_decoder.cpp \
+          src/Parallel_stretcher.cpp \
+          src/Pcm_file_decoder.cpp \
           src/Player_window.cpp \
           src/Playing_progress.cpp \
+          src/Sample_conversion.cpp \
+          src/Sample_store.cpp \
+          src/Stretcher_settings.cpp \
+          src/Waveform_overview.cpp \
           src/tools.cpp \
           rubberband/single/RubberBandSingle.cpp
 RESOURCES = icons.qrc